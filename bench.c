@@ -0,0 +1,461 @@
+// Claude Statusline - Benchmark Driver
+//
+// Times complete statusline invocations the way Claude Code makes them:
+// each run posix_spawns the binary with stdin on a pipe that already holds
+// the JSON payload (so the child never waits on us) and stdout on
+// /dev/null, and the clock covers spawn through waitpid. The driver pins
+// itself, and with it every child, to one CPU, discards warm-up runs, and
+// records each run in an HDR-style log-linear histogram (<1% bucket error)
+// to report tail latency rather than just an average.
+//
+// Scenarios, per binary:
+//   hit   caches warm from the previous run
+//   miss  the state directory emptied before every run (state table, Odin
+//         cache files), so each render rediscovers the repo and recomputes
+//         git status
+//
+// Renders get a scratch state directory of their own through
+// STATUSLINE_STATE_DIR (/dev/shm/statusline-bench-XXXXXX, removed at the
+// end), so the miss runs never pull the table out from under live sessions
+// or a running server or watcher. With -s, a server that is already up
+// keeps its own directory, and misses against it are only partly cold.
+//
+// The resident server and git watcher are disabled (STATUSLINE_NO_SERVER,
+// STATUSLINE_NO_WATCH) so every run renders in-process; -s leaves them on.
+//
+// Every run sends the same mid-session payload unless -p names a directory
+// of recorded payloads (payloads/, which `make pgo` trains on): its *.json
+// files are then sent in turn, with @CWD@ replaced by our working
+// directory. An empty file is a render with nothing on stdin.
+//
+// Build: cc -O2 -o statusline_bench bench.c   (or `make bench`)
+// Usage: statusline_bench [-n runs] [-w warmup] [-c cpu] [-p dir] [-s] binary...
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char **environ;
+
+//~ Base Types
+
+typedef uint8_t   U8;
+typedef uint32_t  U32;
+typedef int32_t   S32;
+typedef int64_t   S64;
+typedef uint64_t  U64;
+typedef int       B32;
+
+#define internal static
+#define true     1
+#define false    0
+
+#define Min(a, b)   ((a) < (b) ? (a) : (b))
+#define Max(a, b)   ((a) > (b) ? (a) : (b))
+
+//~ Timing
+
+internal U64
+time_nanoseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (U64)now.tv_sec * 1000000000ull + (U64)now.tv_nsec;
+}
+
+//~ Latency Histogram
+//
+// Log-linear buckets as in HdrHistogram: values below 2^(SUB_BUCKET_BITS+1)
+// are exact; above that, each power of two is split into 2^SUB_BUCKET_BITS
+// equal buckets, so a recorded value is off by less than 1/128 of itself.
+
+#define HISTOGRAM_SUB_BUCKET_BITS  7
+#define HISTOGRAM_SUB_BUCKETS      (1u << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKET_COUNT     (2*HISTOGRAM_SUB_BUCKETS + 64*HISTOGRAM_SUB_BUCKETS)
+
+typedef struct Histogram Histogram;
+struct Histogram
+{
+    U64 counts[HISTOGRAM_BUCKET_COUNT];
+    U64 total;
+    U64 minimum;
+    U64 maximum;
+    U64 sum;
+};
+
+internal U32
+histogram_index(U64 value)
+{
+    if(value < 2*HISTOGRAM_SUB_BUCKETS) return (U32)value;
+    U32 shift = (U32)(63 - __builtin_clzll(value)) - HISTOGRAM_SUB_BUCKET_BITS;
+    return 2*HISTOGRAM_SUB_BUCKETS + (shift - 1)*HISTOGRAM_SUB_BUCKETS +
+           (U32)(value >> shift) - HISTOGRAM_SUB_BUCKETS;
+}
+
+// Highest value that lands in bucket `index`
+internal U64
+histogram_bucket_top(U32 index)
+{
+    if(index < 2*HISTOGRAM_SUB_BUCKETS) return index;
+    U32 shift = (index - 2*HISTOGRAM_SUB_BUCKETS) / HISTOGRAM_SUB_BUCKETS + 1;
+    U64 mantissa = (index - 2*HISTOGRAM_SUB_BUCKETS) % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+internal void
+histogram_record(Histogram *histogram, U64 value)
+{
+    histogram->counts[histogram_index(value)]++;
+    if(histogram->total == 0 || value < histogram->minimum) histogram->minimum = value;
+    if(value > histogram->maximum) histogram->maximum = value;
+    histogram->total++;
+    histogram->sum += value;
+}
+
+// Value at or below which `percentile` percent of the runs fell
+internal U64
+histogram_percentile(const Histogram *histogram, double percentile)
+{
+    if(histogram->total == 0) return 0;
+    U64 rank = (U64)(percentile / 100.0 * (double)histogram->total + 0.5);
+    rank = Max(rank, 1);
+    U64 seen = 0;
+    for(U32 index = 0; index < HISTOGRAM_BUCKET_COUNT; index++)
+    {
+        seen += histogram->counts[index];
+        if(seen >= rank) return Min(histogram_bucket_top(index), histogram->maximum);
+    }
+    return histogram->maximum;
+}
+
+//~ Runner
+
+// Written whole into the pipe before the spawn, so it must fit the pipe
+#define PAYLOAD_MAX_BYTES  65536
+
+typedef struct Bench_Payload Bench_Payload;
+struct Bench_Payload
+{
+    char *data;
+    U64   length;
+};
+
+typedef struct Bench_Options Bench_Options;
+struct Bench_Options
+{
+    int            runs;
+    int            warmup;
+    int            cpu;
+    B32            allow_resident;
+    const char    *payload_directory;
+    Bench_Payload *payloads;
+    U32            payload_count;
+};
+
+internal char **bench_environment;
+internal char   bench_state_directory[64];
+
+// Everything in the renders' state directory: the C state table and the
+// Odin cache files
+internal void
+clear_shared_state(void)
+{
+    DIR *directory = opendir(bench_state_directory);
+    if(directory == NULL) return;
+    struct dirent *entry;
+    while((entry = readdir(directory)) != NULL)
+        if(entry->d_name[0] != '.') unlinkat(dirfd(directory), entry->d_name, 0);
+    closedir(directory);
+}
+
+// One render, spawn to exit. Returns elapsed nanoseconds, 0 on failure.
+internal U64
+bench_run_once(const char *binary, const Bench_Payload *payload)
+{
+    int pipe_fds[2];
+    if(pipe2(pipe_fds, O_CLOEXEC) != 0) return 0;
+    if(write(pipe_fds[1], payload->data, payload->length) != (ssize_t)payload->length)
+    {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        return 0;
+    }
+    close(pipe_fds[1]);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pipe_fds[0], STDIN_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+    char *argv[] = {(char *)binary, NULL};
+    pid_t child_pid;
+    U64 start = time_nanoseconds();
+    int spawn_result = posix_spawn(&child_pid, binary, &actions, NULL, argv, bench_environment);
+    int status = 0;
+    if(spawn_result == 0) waitpid(child_pid, &status, 0);
+    U64 elapsed = time_nanoseconds() - start;
+
+    posix_spawn_file_actions_destroy(&actions);
+    close(pipe_fds[0]);
+    if(spawn_result != 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return 0;
+    return Max(elapsed, 1);
+}
+
+internal B32
+bench_scenario(const char *binary, B32 cold, const Bench_Options *options, Histogram *histogram)
+{
+    memset(histogram, 0, sizeof(*histogram));
+    for(int run = 0; run < options->warmup + options->runs; run++)
+    {
+        if(cold) clear_shared_state();
+        U64 elapsed = bench_run_once(binary, &options->payloads[run % options->payload_count]);
+        if(elapsed == 0) return false;
+        if(run >= options->warmup) histogram_record(histogram, elapsed);
+    }
+    return true;
+}
+
+internal void
+print_microseconds(U64 nanoseconds)
+{
+    printf(" %9.1f", (double)nanoseconds / 1000.0);
+}
+
+internal void
+print_result(const char *binary, const char *scenario, const Histogram *histogram)
+{
+    printf("%-24s %-5s %6llu", binary, scenario, (unsigned long long)histogram->total);
+    print_microseconds(histogram->sum / Max(histogram->total, 1));
+    print_microseconds(histogram_percentile(histogram, 50.0));
+    print_microseconds(histogram_percentile(histogram, 90.0));
+    print_microseconds(histogram_percentile(histogram, 99.0));
+    print_microseconds(histogram_percentile(histogram, 99.9));
+    print_microseconds(histogram->maximum);
+    printf("\n");
+}
+
+//~ Setup
+
+internal void
+add_payload(Bench_Options *options, char *data, U64 length)
+{
+    options->payloads = realloc(options->payloads, (options->payload_count + 1) * sizeof(Bench_Payload));
+    options->payloads[options->payload_count].data = data;
+    options->payloads[options->payload_count].length = length;
+    options->payload_count++;
+}
+
+// Same payload as a mid-session Claude Code render, rooted at the cwd
+internal void
+build_input(Bench_Options *options, const char *directory)
+{
+    char *input = malloc(4096);
+    int length = snprintf(input, 4096,
+        "{\n"
+        "  \"model\": {\"id\": \"claude-sonnet-4-20250514\", \"display_name\": \"Sonnet 4\"},\n"
+        "  \"workspace\": {\"current_dir\": \"%s\"},\n"
+        "  \"cost\": {\"total_cost_usd\": 2.47, \"total_duration_ms\": 847293, \"total_lines_added\": 312, \"total_lines_removed\": 89},\n"
+        "  \"context_window\": {\"total_input_tokens\": 283432, \"total_output_tokens\": 42847, \"context_window_size\": 200000, \"used_percentage\": 67, \"current_usage\": {\"input_tokens\": 89432, \"output_tokens\": 12847, \"cache_creation_input_tokens\": 24680, \"cache_read_input_tokens\": 156320}},\n"
+        "  \"vim\": {\"mode\": \"NORMAL\"}\n"
+        "}\n", directory);
+    add_payload(options, input, (U64)Min(Max(length, 0), 4095));
+}
+
+internal int
+is_payload_file(const struct dirent *entry)
+{
+    U64 length = strlen(entry->d_name);
+    return entry->d_name[0] != '.' && length > 5 && strcmp(entry->d_name + length - 5, ".json") == 0;
+}
+
+// Every *.json in `path`, in name order, with @CWD@ replaced by `directory`
+internal B32
+load_payloads(Bench_Options *options, const char *path, const char *directory)
+{
+    struct dirent **names;
+    int name_count = scandir(path, &names, is_payload_file, alphasort);
+    if(name_count < 0) { fprintf(stderr, "%s: cannot read payload directory\n", path); return false; }
+
+    B32 ok = true;
+    U64 directory_length = strlen(directory);
+    for(int index = 0; index < name_count; index++)
+    {
+        char file_path[4096];
+        snprintf(file_path, sizeof(file_path), "%s/%s", path, names[index]->d_name);
+        free(names[index]);
+        if(!ok) continue;
+
+        static char raw[PAYLOAD_MAX_BYTES + 1];
+        int fd = open(file_path, O_RDONLY | O_CLOEXEC);
+        ssize_t raw_length = fd >= 0 ? read(fd, raw, sizeof(raw)) : -1;
+        if(fd >= 0) close(fd);
+        if(raw_length < 0 || raw_length > PAYLOAD_MAX_BYTES)
+        {
+            fprintf(stderr, "%s: unreadable, or over %d bytes\n", file_path, PAYLOAD_MAX_BYTES);
+            ok = false;
+            continue;
+        }
+
+        U64 capacity = (U64)raw_length + 1;
+        for(ssize_t at = 0; at + 5 <= raw_length; at++)
+            if(memcmp(raw + at, "@CWD@", 5) == 0) capacity += directory_length;
+        char *data = malloc(capacity);
+        U64 length = 0;
+        for(ssize_t at = 0; at < raw_length; )
+        {
+            if(raw_length - at >= 5 && memcmp(raw + at, "@CWD@", 5) == 0)
+            {
+                memcpy(data + length, directory, directory_length);
+                length += directory_length;
+                at += 5;
+            }
+            else data[length++] = raw[at++];
+        }
+        if(length > PAYLOAD_MAX_BYTES)
+        {
+            fprintf(stderr, "%s: over %d bytes with @CWD@ replaced\n", file_path, PAYLOAD_MAX_BYTES);
+            free(data);
+            ok = false;
+            continue;
+        }
+        add_payload(options, data, length);
+    }
+    free(names);
+    if(ok && options->payload_count == 0) { fprintf(stderr, "%s: no *.json payloads\n", path); ok = false; }
+    return ok;
+}
+
+internal B32
+build_environment(B32 allow_resident)
+{
+    strcpy(bench_state_directory, "/dev/shm/statusline-bench-XXXXXX");
+    if(mkdtemp(bench_state_directory) == NULL)
+    {
+        perror("statusline_bench: scratch state directory");
+        return false;
+    }
+    static char state_directory_variable[96];
+    snprintf(state_directory_variable, sizeof(state_directory_variable), "STATUSLINE_STATE_DIR=%s",
+             bench_state_directory);
+
+    U64 count = 0;
+    while(environ[count]) count++;
+    bench_environment = calloc(count + 4, sizeof(char *));
+    U64 used = 0;
+    for(U64 index = 0; index < count; index++)
+    {
+        // Ours win over whatever the caller exported
+        if(strncmp(environ[index], "STATUSLINE_", 11) == 0) continue;
+        bench_environment[used++] = environ[index];
+    }
+    if(!allow_resident)
+    {
+        bench_environment[used++] = "STATUSLINE_NO_SERVER=1";
+        bench_environment[used++] = "STATUSLINE_NO_WATCH=1";
+    }
+    bench_environment[used++] = state_directory_variable;
+    bench_environment[used] = NULL;
+    return true;
+}
+
+// Pin to `cpu`, or to the last CPU we're allowed on (the one least likely
+// to be busy with interrupts)
+internal int
+pin_cpu(int cpu)
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return -1;
+    if(cpu < 0)
+        for(int candidate = CPU_SETSIZE - 1; candidate >= 0 && cpu < 0; candidate--)
+            if(CPU_ISSET(candidate, &allowed)) cpu = candidate;
+    if(cpu < 0) return -1;
+
+    cpu_set_t pinned;
+    CPU_ZERO(&pinned);
+    CPU_SET(cpu, &pinned);
+    return sched_setaffinity(0, sizeof(pinned), &pinned) == 0 ? cpu : -1;
+}
+
+internal void
+print_usage(void)
+{
+    fprintf(stderr, "usage: statusline_bench [-n runs] [-w warmup] [-c cpu] [-p dir] [-s] binary...\n"
+                    "  -n runs    timed runs per scenario (default 1000)\n"
+                    "  -w warmup  discarded runs before each scenario (default 20)\n"
+                    "  -c cpu     CPU to pin to (default: last allowed)\n"
+                    "  -p dir     send dir's *.json payloads in turn (default: one built-in)\n"
+                    "  -s         leave the resident server and git watcher enabled\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    Bench_Options options;
+    memset(&options, 0, sizeof(options));
+    options.runs = 1000;
+    options.warmup = 20;
+    options.cpu = -1;
+
+    int option;
+    while((option = getopt(argc, argv, "n:w:c:p:sh")) != -1)
+    {
+        switch(option)
+        {
+        case 'n': options.runs = atoi(optarg); break;
+        case 'w': options.warmup = atoi(optarg); break;
+        case 'c': options.cpu = atoi(optarg); break;
+        case 'p': options.payload_directory = optarg; break;
+        case 's': options.allow_resident = true; break;
+        default:  print_usage(); return 2;
+        }
+    }
+    if(optind >= argc || options.runs <= 0 || options.warmup < 0) { print_usage(); return 2; }
+
+    char directory[1024];
+    if(getcwd(directory, sizeof(directory)) == NULL) strcpy(directory, "/");
+    if(options.payload_directory == NULL) build_input(&options, directory);
+    else if(!load_payloads(&options, options.payload_directory, directory)) return 2;
+    if(!build_environment(options.allow_resident)) return 1;
+    int cpu = pin_cpu(options.cpu);
+
+    if(cpu >= 0) printf("pinned to cpu %d, ", cpu);
+    else printf("not pinned, ");
+    printf("%d runs after %d warm-up per scenario", options.runs, options.warmup);
+    if(options.payload_directory) printf(", %u payloads from %s", options.payload_count, options.payload_directory);
+    printf(", latencies in us\n\n");
+    printf("%-24s %-5s %6s %9s %9s %9s %9s %9s %9s\n",
+           "binary", "cache", "runs", "mean", "p50", "p90", "p99", "p99.9", "max");
+
+    int exit_code = 0;
+    static Histogram histogram;
+    for(int index = optind; index < argc; index++)
+    {
+        const char *binary = argv[index];
+        if(access(binary, X_OK) != 0)
+        {
+            fprintf(stderr, "%s: not executable, skipped\n", binary);
+            exit_code = 1;
+            continue;
+        }
+
+        // Miss first: it leaves the caches warm for the hit scenario
+        if(bench_scenario(binary, true, &options, &histogram)) print_result(binary, "miss", &histogram);
+        else { fprintf(stderr, "%s: run failed\n", binary); exit_code = 1; continue; }
+        if(bench_scenario(binary, false, &options, &histogram)) print_result(binary, "hit", &histogram);
+        else { fprintf(stderr, "%s: run failed\n", binary); exit_code = 1; }
+    }
+
+    clear_shared_state();
+    rmdir(bench_state_directory);
+    return exit_code;
+}
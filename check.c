@@ -0,0 +1,84 @@
+// Claude Statusline - Git Correctness Checks
+//
+// The native git paths stand in for `git status`, so they have to give its
+// answers. check.sh builds scratch repos, puts them through the states
+// that matter (staged, unmerged, renamed, submodules, attributes, diverged
+// upstreams, packed refs) and diffs this driver's output against git's own.
+// statusline.c is included as-is (its main renamed), so every case runs
+// exactly the code the binary runs.
+//
+//   statusline_check engine <worktree>        modified/staged from the index engine
+//   statusline_check ahead-behind <worktree>  ahead/behind from the commit walk
+//   statusline_check porcelain <chunk>        `git status --porcelain=v2 -z` on
+//                                             stdin, fed <chunk> bytes at a time
+//
+// Each prints one line, or "defer" when the native path hands the repo to
+// git.
+//
+// Build: make check   (builds statusline_check and runs check.sh)
+
+#define main statusline_main
+#include "statusline.c"
+#undef main
+
+internal B32
+check_locate(const char *directory, Git_Repo *repo)
+{
+    char resolved[PATH_MAX];
+    if(realpath(directory, resolved) == NULL) return false;
+    memset(repo, 0, sizeof(*repo));
+    return git_repo_locate(resolved, repo);
+}
+
+internal int
+check_engine(const char *directory)
+{
+    Git_Repo repo;
+    if(!check_locate(directory, &repo)) return 1;
+    U32 modified, staged;
+    if(git_engine_status(&repo, 0, &modified, &staged)) printf("%u %u\n", modified, staged);
+    else printf("defer\n");
+    return 0;
+}
+
+internal int
+check_ahead_behind(const char *directory)
+{
+    Git_Repo repo;
+    if(!check_locate(directory, &repo)) return 1;
+    U32 ahead, behind;
+    if(git_ahead_behind(&repo, &ahead, &behind)) printf("%u %u\n", ahead, behind);
+    else printf("defer\n");
+    return 0;
+}
+
+internal int
+check_porcelain(U64 chunk)
+{
+    static char input[1 << 22];
+    U64 length = 0;
+    ssize_t bytes_read;
+    while(length < sizeof(input) && (bytes_read = read(STDIN_FILENO, input + length, sizeof(input) - length)) > 0)
+        length += (U64)bytes_read;
+
+    Git_Porcelain porcelain;
+    memset(&porcelain, 0, sizeof(porcelain));
+    for(U64 offset = 0; offset < length; offset += chunk)
+        git_porcelain_feed(&porcelain, input + offset, Min(chunk, length - offset));
+
+    printf("%u %u %u %u %lld %s\n", porcelain.modified, porcelain.staged, porcelain.ahead, porcelain.behind,
+           (long long)porcelain.stashes, porcelain.detached ? "(detached)" : porcelain.head);
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    if(argc == 3 && strcmp(argv[1], "engine") == 0) return check_engine(argv[2]);
+    if(argc == 3 && strcmp(argv[1], "ahead-behind") == 0) return check_ahead_behind(argv[2]);
+    if(argc == 3 && strcmp(argv[1], "porcelain") == 0 && atoll(argv[2]) > 0)
+        return check_porcelain((U64)atoll(argv[2]));
+    fprintf(stderr, "usage: statusline_check engine|ahead-behind <worktree>\n"
+                    "       statusline_check porcelain <chunk> < porcelain-v2-z-output\n");
+    return 2;
+}
@@ -0,0 +1,230 @@
+#!/bin/bash
+# Diff the native git paths against git itself (see check.c)
+#
+# Builds scratch repos, walks them through the states the index engine, the
+# ahead/behind walk and the porcelain parser have to get right, and after
+# each step compares statusline_check's answers with git's:
+#   engine        modified/staged, counted from `git status --porcelain=v2`
+#   ahead-behind  `git rev-list --left-right --count HEAD...@{upstream}`
+#   porcelain     the same output parsed whole by awk, against the parser
+#                 fed 1, 2, 3, 5, 8, 13, 64 and 4096 bytes at a time
+# A state marked defer-ok may be handed to git instead (filters, CRLF).
+#
+# Usage: ./check.sh [./statusline_check]   (or `make check`)
+
+CHECK="$(realpath "${1:-./statusline_check}")"
+SCRATCH="$(mktemp -d)"
+trap 'rm -rf "$SCRATCH"' EXIT
+
+# None of the caller's git setup: no global or system config
+export HOME="$SCRATCH/home" XDG_CONFIG_HOME="$SCRATCH/home/.config" GIT_CONFIG_NOSYSTEM=1
+export GIT_AUTHOR_NAME=check GIT_AUTHOR_EMAIL=check@example.com
+export GIT_COMMITTER_NAME=check GIT_COMMITTER_EMAIL=check@example.com
+mkdir -p "$HOME"
+git config --global init.defaultBranch main
+git config --global protocol.file.allow always
+git config --global advice.detachedHead false
+
+PASSED=0
+FAILED=0
+
+# modified/staged the way git_porcelain_record counts them
+git_counts() {
+    git -C "$1" --no-optional-locks status --porcelain=v2 -uno |
+        awk '/^[12u] / { if($1 == "u" || substr($2, 1, 1) != ".") staged++
+                         if($1 == "u" || substr($2, 2, 1) != ".") modified++ }
+             END { print modified + 0, staged + 0 }'
+}
+
+# Everything git_porcelain_record keeps, from -z output on stdin
+porcelain_fields() {
+    tr '\0' '\n' |
+        awk 'skip { skip = 0; next }
+             /^[12u] / { if($1 == "u" || substr($2, 1, 1) != ".") staged++
+                         if($1 == "u" || substr($2, 2, 1) != ".") modified++
+                         skip = $1 == "2"; next }
+             /^# branch.head / { head = $3 }
+             /^# branch.ab /   { ahead = substr($3, 2); behind = substr($4, 2) }
+             /^# stash /       { stashes = $3 }
+             END { print modified + 0, staged + 0, ahead + 0, behind + 0, stashes + 0, head }'
+}
+
+compare() {
+    local label="$1" actual="$2" expected="$3" defer_ok="$4"
+    if [ "$actual" = "$expected" ] || { [ "$actual" = defer ] && [ -n "$defer_ok" ]; }; then
+        PASSED=$((PASSED + 1))
+    else
+        echo "FAIL $label: got '$actual', git says '$expected'"
+        FAILED=$((FAILED + 1))
+    fi
+}
+
+# check <label> <worktree> [defer-ok]
+check() {
+    local label="$1" worktree="$2" defer_ok="$3"
+
+    # The engine first: git status may refresh stat data in the index
+    local engine
+    engine="$("$CHECK" engine "$worktree")"
+    compare "$label: engine" "$engine" "$(git_counts "$worktree")" "$defer_ok"
+
+    local expected
+    expected="$(git -C "$worktree" rev-list --left-right --count 'HEAD...@{upstream}' 2>/dev/null | tr '\t' ' ')"
+    compare "$label: ahead-behind" "$("$CHECK" ahead-behind "$worktree")" "${expected:-0 0}" ""
+
+    git -C "$worktree" --no-optional-locks status --porcelain=v2 -z --branch --show-stash -uno > "$SCRATCH/porcelain"
+    expected="$(porcelain_fields < "$SCRATCH/porcelain")"
+    for chunk in 1 2 3 5 8 13 64 4096; do
+        compare "$label: porcelain/$chunk" "$("$CHECK" porcelain "$chunk" < "$SCRATCH/porcelain")" "$expected" ""
+    done
+}
+
+commit() { git commit -q --allow-empty -m "$1"; }
+
+cd "$SCRATCH" || exit 1
+git init -q --bare upstream.git
+git init -q work
+cd work || exit 1
+git remote add origin ../upstream.git
+for i in $(seq 1 60); do
+    mkdir -p "dir$((i % 6))/sub$((i % 2))"
+    echo "line $i" > "dir$((i % 6))/sub$((i % 2))/file$i.txt"
+done
+ln -s dir1/sub1/file1.txt link
+printf '#!/bin/sh\n' > run.sh
+chmod +x run.sh
+git add -A
+commit initial
+git push -q -u origin main 2>/dev/null
+# The walk needs a commit-graph; later commits are newer than this one
+git commit-graph write --reachable
+check "clean" .
+
+echo more >> dir1/sub1/file1.txt
+check "appended" .
+echo "line X" > dir2/sub0/file2.txt
+check "same-size edit" .
+git add dir1/sub1/file1.txt
+echo new > new.txt
+git add new.txt
+git rm -q dir3/sub1/file3.txt
+check "staged" .
+git mv dir4/sub0/file4.txt renamed.txt
+check "exact rename" .
+chmod +x dir0/sub0/file6.txt
+rm dir5/sub1/file5.txt
+check "mode change and delete" .
+rm link
+ln -s dir2 link
+check "symlink retargeted" .
+rm dir0/sub0/file12.txt
+ln -s run.sh dir0/sub0/file12.txt
+check "file became a symlink" .
+git stash -q
+check "stashed" .
+git stash pop -q
+echo intent > intent.txt
+git add -N intent.txt
+check "intent to add" .
+git add -A
+commit changes
+check "ahead" .
+
+git clone -q ../upstream.git ../other 2>/dev/null
+(cd ../other && for i in 1 2 3; do echo "other $i" >> "dir1/sub1/file1.txt"; git commit -qam "other $i"; done &&
+     git push -q origin main 2>/dev/null)
+git fetch -q origin
+check "diverged" .
+git pack-refs --all
+git gc -q 2>/dev/null
+check "packed refs and objects" .
+
+echo conflict > dir1/sub1/file1.txt
+git commit -qam conflict
+git merge -q origin/main > /dev/null 2>&1
+check "unmerged" .
+git merge --abort
+git merge -q -X theirs origin/main -m merge > /dev/null 2>&1
+check "merged upstream" .
+echo after >> dir0/sub0/file6.txt
+git commit -qam "after merge"
+check "ahead after merge" .
+
+git checkout -q --detach HEAD~1
+check "detached" .
+git checkout -q main
+git branch -q --unset-upstream
+check "no upstream" .
+git branch -q -u origin/main
+git update-ref -d refs/remotes/origin/main
+check "upstream gone" .
+git fetch -q origin
+
+git worktree add -q ../linked -b side 2>/dev/null
+echo linked >> ../linked/run.sh
+check "linked worktree" ../linked
+
+git init -q ../module
+(cd ../module && echo module > module.txt && git add module.txt && git commit -qm module)
+git submodule -q add ../module module 2>/dev/null
+commit "add module"
+check "submodule clean" .
+echo dirty >> module/module.txt
+check "submodule dirty" .
+(cd module && git commit -qam moved)
+check "submodule moved" .
+(cd module && git reset -q --hard HEAD~1)
+rm -rf module
+check "submodule removed" .
+git submodule -q update --force 2>/dev/null
+check "submodule restored" .
+git config submodule.module.ignore dirty
+echo dirty >> module/module.txt
+check "submodule ignored" . defer-ok
+git config --unset submodule.module.ignore
+(cd module && git checkout -q -- .)
+
+printf '*.txt -diff\n# text eol=crlf\n' > .gitattributes
+git add .gitattributes
+commit attributes
+echo "line Y" > dir2/sub0/file2.txt
+check "attributes without conversion" .
+printf '*.txt text\n' > .gitattributes
+echo "line Z" > dir2/sub0/file2.txt
+check "text attribute" . defer-ok
+git checkout -q -- .gitattributes
+git config core.autocrlf true
+echo "line W" > dir2/sub0/file2.txt
+check "autocrlf" . defer-ok
+git config core.autocrlf false
+git add -A
+commit "before index formats"
+
+# DIRC v4 prefix-compressed paths, a split index (link extension and
+# sharedindex.<oid>), and both together
+git update-index --index-version 4
+echo v4 >> dir1/sub1/file1.txt
+git add dir1/sub1/file1.txt
+echo v4 >> dir2/sub0/file2.txt
+git rm -q --cached dir3/sub1/file9.txt
+check "index v4" .
+# Separately: git 2.39 doesn't split when the version changes in the same run
+git update-index --index-version 2
+git update-index --split-index
+echo split >> dir4/sub0/file10.txt
+git add dir4/sub0/file10.txt
+echo split > split.txt
+git add split.txt
+echo split >> dir5/sub1/file11.txt
+check "split index" .
+git update-index --index-version 4
+echo "split v4" >> dir0/sub0/file18.txt
+git add dir0/sub0/file18.txt
+git rm -q dir1/sub1/file13.txt
+echo "split v4" >> dir2/sub0/file14.txt
+check "split index v4" .
+ls .git/sharedindex.* > /dev/null 2>&1 || compare "split index kept" "no sharedindex" "sharedindex" ""
+git update-index --no-split-index --index-version 2
+
+echo "$PASSED passed, $FAILED failed"
+[ "$FAILED" -eq 0 ]
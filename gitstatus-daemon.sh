@@ -45,7 +45,9 @@ start_daemon() {
     rm -f "$REQ_FIFO" "$RESP_FIFO"
     mkfifo "$REQ_FIFO" "$RESP_FIFO"
 
-    # Start daemon with persistent FIFO (sleep keeps write end open to prevent EOF)
+    # Start daemon with persistent FIFO (sleep keeps write end open to prevent EOF).
+    # The response FIFO is opened read-write so the daemon never blocks waiting
+    # for a reader and never takes SIGPIPE between statusline requests.
     ( sleep infinity > "$REQ_FIFO" ) &
     local keep_open_pid=$!
 
@@ -54,7 +56,7 @@ start_daemon() {
         --max-num-staged=-1 \
         --max-num-unstaged=-1 \
         --max-num-untracked=-1 \
-        < "$REQ_FIFO" > "$RESP_FIFO" &
+        < "$REQ_FIFO" 1<> "$RESP_FIFO" &
     local pid=$!
 
     echo "$keep_open_pid" > "${FIFO_PREFIX}.keep"
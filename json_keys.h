@@ -0,0 +1,81 @@
+// Claude Statusline - JSON Key Table
+//
+// The hash the stdin extractor looks keys up with. Shared by statusline.c
+// and json_keys_gen.c, which turns the keys of JSON_OBJECTS and
+// STATE_FIELDS (state_schema.h) into the minimal perfect hash in
+// json_keys_table.h. Expects U8/U32/U64, `internal`, <stdint.h> and
+// <string.h> from the includer.
+
+#ifndef JSON_KEYS_H
+#define JSON_KEYS_H
+
+#include "state_schema.h"
+
+// `head` and `tail` are json_key_words of the name, so the confirming
+// compare is two integer compares for keys up to 16 bytes
+typedef struct Json_Key Json_Key;
+struct Json_Key
+{
+    U64         head;
+    U64         tail;
+    U8          scope;
+    U8          target;
+    U8          length;
+    const char *name;
+};
+
+// Up to eight bytes of a key, zero-extended, reading only the key
+internal U64
+json_key_load(const char *bytes, U64 length)
+{
+    U64 word = 0;
+    memcpy(&word, bytes, length < 8 ? length : 8);
+    return word;
+}
+
+// The same word with one unaligned load whenever it can't run into the next
+// page. Only for keys inside the payload, where the bytes past a key are
+// readable, merely not ours; a short literal has nothing behind it.
+internal U64
+json_key_load_in_payload(const char *bytes, U64 length)
+{
+    if(((uintptr_t)bytes & 4095) > 4096 - 8) return json_key_load(bytes, length);
+    U64 word;
+    memcpy(&word, bytes, 8);
+    if(length < 8) word &= (1ull << (8 * length)) - 1;
+    return word;
+}
+
+// The first and last eight bytes of a key (overlapping for short keys;
+// tail is 0 up to 8 bytes). `in_payload` picks the wide load for the
+// extractor; literals pass 0.
+internal void
+json_key_words(const char *name, U64 length, int in_payload, U64 *head, U64 *tail)
+{
+    *head = in_payload ? json_key_load_in_payload(name, length) : json_key_load(name, length);
+    *tail = length > 8 ? json_key_load(name + length - 8, 8) : 0;
+}
+
+// Mixes both words with the length and the scope, so the same name under
+// two objects lands in two slots. Keys that differ only between the words
+// make json_keys_gen fail loudly.
+internal U32
+json_key_hash(U32 scope, U64 head, U64 tail, U64 length)
+{
+    U64 hash = (head * 0x9e3779b97f4a7c15ull) ^ (tail * 0xbf58476d1ce4e5b9ull) ^
+               ((length << 8 | scope) * 0x94d049bb133111ebull);
+    return (U32)(hash >> 32) ^ (U32)hash;
+}
+
+// Second level: remix the hash with its bucket's displacement and reduce
+// it onto [0, slot_count) with a multiply instead of a divide
+internal U32
+json_key_slot(U32 hash, U32 displacement, U32 slot_count)
+{
+    U32 mixed = (hash ^ displacement) * 0x9e3779b1u;
+    mixed ^= mixed >> 15;
+    mixed *= 0x85ebca6bu;
+    return (U32)(((U64)mixed * slot_count) >> 32);
+}
+
+#endif
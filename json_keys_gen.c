@@ -0,0 +1,163 @@
+// Claude Statusline - JSON Key Hash Generator
+//
+// Builds a minimal perfect hash over the keys of JSON_OBJECTS and
+// STATE_FIELDS in state_schema.h (hash and displace): keys are grouped
+// into buckets by json_key_hash, and each bucket, largest first, gets the
+// smallest displacement that sends all its keys through json_key_slot to
+// still-free slots. With as many slots as keys, a lookup is one hash, one
+// table read and one confirming compare.
+//
+// Build: make (runs it whenever state_schema.h or json_keys.h changes)
+// Usage: json_keys_gen > json_keys_table.h
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t   U8;
+typedef uint16_t  U16;
+typedef uint32_t  U32;
+typedef uint64_t  U64;
+
+#define internal static
+
+#include "json_keys.h"
+
+typedef struct Key_Entry Key_Entry;
+struct Key_Entry
+{
+    U32         scope;
+    const char *scope_name;
+    const char *target_name;
+    const char *name;
+    U64         head;
+    U64         tail;
+    U32         hash;
+};
+
+#define OBJECT_ENTRY(target, scope, name) {JSON_TARGET_##scope, #scope, #target, name, 0, 0, 0},
+#define FIELD_ENTRY(target, member, scope, name, kind, capacity, persist, merge) \
+    {JSON_TARGET_##scope, #scope, #target, name, 0, 0, 0},
+
+internal Key_Entry entries[] = {
+    JSON_OBJECTS(OBJECT_ENTRY)
+    STATE_FIELDS(FIELD_ENTRY)
+};
+
+#define ENTRY_COUNT     (sizeof(entries) / sizeof(entries[0]))
+#define MAX_DISPLACEMENT 65535
+
+internal int
+compare_buckets_by_size(const void *left, const void *right, void *sizes)
+{
+    U32 a = ((U32 *)sizes)[*(const U32 *)left], b = ((U32 *)sizes)[*(const U32 *)right];
+    if(a != b) return a > b ? -1 : 1;
+    return *(const U32 *)left < *(const U32 *)right ? -1 : 1;
+}
+
+// Try to place every bucket; fills displacements and slots on success
+internal int
+build(U32 buckets, U16 *displacements, int *slots)
+{
+    U32 sizes[ENTRY_COUNT], order[ENTRY_COUNT];
+    memset(sizes, 0, sizeof(sizes));
+    for(U32 index = 0; index < ENTRY_COUNT; index++) sizes[entries[index].hash % buckets]++;
+    for(U32 bucket = 0; bucket < buckets; bucket++) order[bucket] = bucket;
+    qsort_r(order, buckets, sizeof(U32), compare_buckets_by_size, sizes);
+
+    for(U32 slot = 0; slot < ENTRY_COUNT; slot++) slots[slot] = -1;
+    for(U32 rank = 0; rank < buckets; rank++)
+    {
+        U32 bucket = order[rank];
+        displacements[bucket] = 0;
+        if(sizes[bucket] == 0) continue;
+
+        int placed = 0;
+        for(U32 displacement = 0; displacement <= MAX_DISPLACEMENT && !placed; displacement++)
+        {
+            U32 claimed[ENTRY_COUNT], claimed_count = 0;
+            placed = 1;
+            for(U32 index = 0; index < ENTRY_COUNT && placed; index++)
+            {
+                if(entries[index].hash % buckets != bucket) continue;
+                U32 slot = json_key_slot(entries[index].hash, displacement, ENTRY_COUNT);
+                if(slots[slot] >= 0) { placed = 0; break; }
+                for(U32 other = 0; other < claimed_count; other++)
+                    if(claimed[other] == slot) placed = 0;
+                claimed[claimed_count++] = slot;
+            }
+            if(!placed) continue;
+
+            displacements[bucket] = (U16)displacement;
+            for(U32 index = 0; index < ENTRY_COUNT; index++)
+                if(entries[index].hash % buckets == bucket)
+                    slots[json_key_slot(entries[index].hash, displacement, ENTRY_COUNT)] = (int)index;
+        }
+        if(!placed) return 0;
+    }
+    return 1;
+}
+
+int
+main(void)
+{
+    for(U32 index = 0; index < ENTRY_COUNT; index++)
+    {
+        Key_Entry *entry = &entries[index];
+        U64 length = strlen(entry->name);
+        if(length > 255) { fprintf(stderr, "json_keys_gen: \"%s\" is too long\n", entry->name); return 1; }
+        json_key_words(entry->name, length, 0, &entry->head, &entry->tail);
+        entry->hash = json_key_hash(entry->scope, entry->head, entry->tail, length);
+        for(U32 other = 0; other < index; other++)
+        {
+            if(entries[other].scope == entry->scope && strcmp(entries[other].name, entry->name) == 0)
+            {
+                fprintf(stderr, "json_keys_gen: \"%s\" listed twice under %s\n", entry->name, entry->scope_name);
+                return 1;
+            }
+            if(entries[other].hash == entry->hash)
+            {
+                fprintf(stderr, "json_keys_gen: \"%s\" and \"%s\" hash alike; change json_key_hash\n",
+                        entries[other].name, entry->name);
+                return 1;
+            }
+        }
+    }
+
+    U16 displacements[ENTRY_COUNT];
+    int slots[ENTRY_COUNT];
+    U32 bucket_count;
+    for(bucket_count = (ENTRY_COUNT + 1) / 2; bucket_count <= ENTRY_COUNT; bucket_count++)
+        if(build(bucket_count, displacements, slots)) break;
+    if(bucket_count > ENTRY_COUNT)
+    {
+        fprintf(stderr, "json_keys_gen: no perfect hash found\n");
+        return 1;
+    }
+
+    printf("// Generated by json_keys_gen from state_schema.h; do not edit.\n"
+           "// %u keys: bucket = hash %% JSON_KEY_BUCKETS,\n"
+           "// slot = json_key_slot(hash, json_key_displacements[bucket], JSON_KEY_SLOTS)\n\n",
+           (U32)ENTRY_COUNT);
+    printf("#define JSON_KEY_BUCKETS %u\n", bucket_count);
+    printf("#define JSON_KEY_SLOTS   %u\n\n", (U32)ENTRY_COUNT);
+
+    printf("internal const U16 json_key_displacements[JSON_KEY_BUCKETS] = {");
+    for(U32 bucket = 0; bucket < bucket_count; bucket++)
+        printf("%s%u,", bucket % 12 == 0 ? "\n    " : " ", displacements[bucket]);
+    printf("\n};\n\n");
+
+    printf("internal const Json_Key json_key_slots[JSON_KEY_SLOTS] = {\n");
+    for(U32 slot = 0; slot < ENTRY_COUNT; slot++)
+    {
+        const Key_Entry *entry = &entries[slots[slot]];
+        printf("    {0x%016llxull, 0x%016llxull, JSON_TARGET_%s, JSON_TARGET_%s, %u, \"%s\"},\n",
+               (unsigned long long)entry->head, (unsigned long long)entry->tail,
+               entry->scope_name, entry->target_name, (U32)strlen(entry->name), entry->name);
+    }
+    printf("};\n");
+    return 0;
+}
@@ -0,0 +1,40 @@
+// Generated by json_keys_gen from state_schema.h; do not edit.
+// 26 keys: bucket = hash % JSON_KEY_BUCKETS,
+// slot = json_key_slot(hash, json_key_displacements[bucket], JSON_KEY_SLOTS)
+
+#define JSON_KEY_BUCKETS 13
+#define JSON_KEY_SLOTS   26
+
+internal const U16 json_key_displacements[JSON_KEY_BUCKETS] = {
+    8, 0, 3, 8, 0, 1, 0, 0, 7, 0, 2, 132,
+    33,
+};
+
+internal const Json_Key json_key_slots[JSON_KEY_SLOTS] = {
+    {0x0000000074736f63ull, 0x0000000000000000ull, JSON_TARGET_ROOT, JSON_TARGET_COST, 4, "cost"},
+    {0x75645f6c61746f74ull, 0x736d5f6e6f697461ull, JSON_TARGET_COST, JSON_TARGET_DURATION_MS, 17, "total_duration_ms"},
+    {0x636170736b726f77ull, 0x65636170736b726full, JSON_TARGET_ROOT, JSON_TARGET_WORKSPACE, 9, "workspace"},
+    {0x615f737465736572ull, 0x74615f7374657365ull, JSON_TARGET_FIVE_HOUR, JSON_TARGET_FIVE_HOUR_RESETS_AT, 9, "resets_at"},
+    {0x5f6e6f6973736573ull, 0x64695f6e6f697373ull, JSON_TARGET_ROOT, JSON_TARGET_SESSION_ID, 10, "session_id"},
+    {0x6e695f6c61746f74ull, 0x736e656b6f745f74ull, JSON_TARGET_CONTEXT_WINDOW, JSON_TARGET_TOTAL_INPUT_TOKENS, 18, "total_input_tokens"},
+    {0x61645f6e65766573ull, 0x7961645f6e657665ull, JSON_TARGET_RATE_LIMITS, JSON_TARGET_SEVEN_DAY, 9, "seven_day"},
+    {0x0064656c62616e65ull, 0x0000000000000000ull, JSON_TARGET_THINKING, JSON_TARGET_THINKING_ENABLED, 7, "enabled"},
+    {0x696c5f6c61746f74ull, 0x6465766f6d65725full, JSON_TARGET_COST, JSON_TARGET_LINES_REMOVED, 19, "total_lines_removed"},
+    {0x5f73646565637865ull, 0x736e656b6f745f6bull, JSON_TARGET_ROOT, JSON_TARGET_EXCEEDS_200K, 19, "exceeds_200k_tokens"},
+    {0x756f685f65766966ull, 0x72756f685f657669ull, JSON_TARGET_RATE_LIMITS, JSON_TARGET_FIVE_HOUR, 9, "five_hour"},
+    {0x696c5f6c61746f74ull, 0x64656464615f7365ull, JSON_TARGET_COST, JSON_TARGET_LINES_ADDED, 17, "total_lines_added"},
+    {0x7265705f64657375ull, 0x656761746e656372ull, JSON_TARGET_CONTEXT_WINDOW, JSON_TARGET_USED_PERCENTAGE, 15, "used_percentage"},
+    {0x5f79616c70736964ull, 0x656d616e5f79616cull, JSON_TARGET_MODEL, JSON_TARGET_DISPLAY_NAME, 12, "display_name"},
+    {0x5f747865746e6f63ull, 0x776f646e69775f74ull, JSON_TARGET_ROOT, JSON_TARGET_CONTEXT_WINDOW, 14, "context_window"},
+    {0x0000000065646f6dull, 0x0000000000000000ull, JSON_TARGET_VIM, JSON_TARGET_MODE, 4, "mode"},
+    {0x6d696c5f65746172ull, 0x7374696d696c5f65ull, JSON_TARGET_ROOT, JSON_TARGET_RATE_LIMITS, 11, "rate_limits"},
+    {0x6f635f6c61746f74ull, 0x6473755f74736f63ull, JSON_TARGET_COST, JSON_TARGET_TOTAL_COST_USD, 14, "total_cost_usd"},
+    {0x615f737465736572ull, 0x74615f7374657365ull, JSON_TARGET_SEVEN_DAY, JSON_TARGET_SEVEN_DAY_RESETS_AT, 9, "resets_at"},
+    {0x7265705f64657375ull, 0x656761746e656372ull, JSON_TARGET_FIVE_HOUR, JSON_TARGET_FIVE_HOUR_PCT, 15, "used_percentage"},
+    {0x5f747865746e6f63ull, 0x657a69735f776f64ull, JSON_TARGET_CONTEXT_WINDOW, JSON_TARGET_CONTEXT_WINDOW_SIZE, 19, "context_window_size"},
+    {0x0000006c65646f6dull, 0x0000000000000000ull, JSON_TARGET_ROOT, JSON_TARGET_MODEL, 5, "model"},
+    {0x5f746e6572727563ull, 0x7269645f746e6572ull, JSON_TARGET_WORKSPACE, JSON_TARGET_CURRENT_DIR, 11, "current_dir"},
+    {0x00000000006d6976ull, 0x0000000000000000ull, JSON_TARGET_ROOT, JSON_TARGET_VIM, 3, "vim"},
+    {0x7265705f64657375ull, 0x656761746e656372ull, JSON_TARGET_SEVEN_DAY, JSON_TARGET_SEVEN_DAY_PCT, 15, "used_percentage"},
+    {0x676e696b6e696874ull, 0x0000000000000000ull, JSON_TARGET_ROOT, JSON_TARGET_THINKING, 8, "thinking"},
+};
@@ -0,0 +1,382 @@
+// Claude Statusline - Microbenchmarks
+//
+// Times the render path's formatting and parsing functions in-process, with
+// no exec, dynamic linking or cache I/O in the way. statusline.c is
+// included as-is (its main renamed), so every case calls exactly the code
+// the binary runs, built with the same flags.
+//
+// Each case runs its function over a small rotating set of realistic inputs
+// for -n iterations, -r times after a warm-up round, and reports ns/op and
+// cycles/op for the best round and the median round. Cycles are TSC ticks
+// (rdtsc), i.e. reference cycles at the nominal clock rather than core
+// cycles; off x86 only ns/op is reported.
+//
+// Results are kept alive with empty asm barriers: inputs are reloaded from
+// memory every iteration and outputs are escaped, so the compiler can
+// neither hoist a call out of its loop nor delete it.
+//
+// Build: make microbench   (builds statusline_microbench and runs it)
+// Usage: statusline_microbench [-n iterations] [-r rounds] [-c cpu] [case...]
+
+#define main statusline_main
+#include "statusline.c"
+#undef main
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define MICROBENCH_HAS_TSC 1
+#else
+#define MICROBENCH_HAS_TSC 0
+#endif
+
+//~ Optimization Barriers
+
+// The compiler must assume the asm reads `pointer` and anything in memory
+#define bench_escape(pointer) __asm__ volatile("" : : "g"(pointer) : "memory")
+// ...and that it may have changed any memory, so inputs are reloaded
+#define bench_clobber()       __asm__ volatile("" : : : "memory")
+#define bench_keep(value)     __asm__ volatile("" : : "r"(value))
+
+//~ Timing
+
+internal U64
+time_nanoseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (U64)now.tv_sec * 1000000000ull + (U64)now.tv_nsec;
+}
+
+internal U64
+time_cycles(void)
+{
+#if MICROBENCH_HAS_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+//~ Inputs
+// Shaped like what Claude Code sends and what the render path sees. Kept
+// non-const so the barriers can force them to be reloaded.
+
+#define INPUT_COUNT 4
+#define INPUT_MASK  (INPUT_COUNT - 1)
+
+internal char bench_json[INPUT_COUNT][2048];
+
+internal const char *bench_json_shapes[INPUT_COUNT][4] = {
+    // current_dir, display_name, vim mode, used_percentage
+    {"/home/user/projects/claude-statusline",            "Sonnet 4.5",        "NORMAL", "67"},
+    {"/home/user/src/github.com/acme/platform/services", "Opus 4.6",          "INSERT", "12"},
+    {"/home/user",                                       "Claude 3.5 Sonnet", "NORMAL", "94"},
+    {"/srv/build/workspace/monorepo/packages/web/app",   "Haiku 4.5",         "",       "41"},
+};
+
+internal char *bench_paths[INPUT_COUNT] = {
+    "/home/user/projects/claude-statusline",
+    "/home/user/src/github.com/acme/platform/services/billing/internal",
+    "/home/user",
+    "/srv/build/workspace/monorepo/packages/web/app",
+};
+
+internal char *bench_models[INPUT_COUNT] = {
+    "Sonnet 4.5", "Opus 4.6", "Claude 3.5 Sonnet", "Haiku 4.5",
+};
+
+internal double bench_costs[INPUT_COUNT]     = {2.47, 0.0312, 14.8, 137.055};
+internal S64    bench_percents[INPUT_COUNT]  = {67, 12, 94, 41};
+internal S64    bench_durations[INPUT_COUNT] = {847293, 4200, 61000, 11734000};
+
+internal Display_State bench_states[INPUT_COUNT];
+internal Git_Status    bench_git;
+
+internal void
+build_inputs(void)
+{
+    // abbreviate_path substitutes ~ for $HOME; pin it so results don't
+    // depend on who runs the benchmark
+    setenv("HOME", "/home/user", 1);
+
+    for(int index = 0; index < INPUT_COUNT; index++)
+    {
+        const char **shape = bench_json_shapes[index];
+        snprintf(bench_json[index], sizeof(bench_json[index]),
+            "{\n"
+            "  \"session_id\": \"3f7c2a91-8d4e-4b6a-9c1f-52e8d0a7b6c4\",\n"
+            "  \"transcript_path\": \"/home/user/.claude/projects/-home-user-projects/3f7c2a91-8d4e-4b6a-9c1f-52e8d0a7b6c4.jsonl\",\n"
+            "  \"cwd\": \"%s\",\n"
+            "  \"model\": {\"id\": \"claude-sonnet-4-5-20250929\", \"display_name\": \"%s\"},\n"
+            "  \"workspace\": {\"current_dir\": \"%s\", \"project_dir\": \"%s\"},\n"
+            "  \"version\": \"2.0.14\",\n"
+            "  \"output_style\": {\"name\": \"default\"},\n"
+            "  \"cost\": {\"total_cost_usd\": 2.47, \"total_duration_ms\": 847293, \"total_api_duration_ms\": 203114, \"total_lines_added\": 312, \"total_lines_removed\": 89},\n"
+            "  \"exceeds_200k_tokens\": false,\n"
+            "  \"context_window\": {\"total_input_tokens\": 283432, \"total_output_tokens\": 42847, \"context_window_size\": 200000, \"used_percentage\": %s, \"current_usage\": {\"input_tokens\": 89432, \"output_tokens\": 12847, \"cache_creation_input_tokens\": 24680, \"cache_read_input_tokens\": 156320}},\n"
+            "  \"vim\": {\"mode\": \"%s\"}\n"
+            "}\n",
+            shape[0], shape[1], shape[0], shape[0], shape[3], shape[2]);
+
+        Display_State *state = &bench_states[index];
+        memset(state, 0, sizeof(*state));
+        snprintf(state->working_directory, sizeof(state->working_directory), "%s", bench_paths[index]);
+        snprintf(state->model, sizeof(state->model), "%s", bench_models[index]);
+        snprintf(state->vim_mode, sizeof(state->vim_mode), "%s", shape[2]);
+        state->cost_usd          = bench_costs[index];
+        state->lines_added       = 312;
+        state->lines_removed     = 89;
+        state->total_duration_ms = bench_durations[index];
+        state->used_percent      = bench_percents[index];
+        state->context_size      = 200000;
+        state->five_hour_pct     = 23.5;
+        state->seven_day_pct     = 61.0;
+    }
+
+    memset(&bench_git, 0, sizeof(bench_git));
+    bench_git.valid = true;
+    strcpy(bench_git.branch, "feature/render-path-microbenchmarks");
+    bench_git.stashes  = 1;
+    bench_git.modified = 3;
+    bench_git.staged   = 1;
+    bench_git.ahead    = 2;
+    bench_git.behind   = 0;
+}
+
+//~ Cases
+
+internal void
+case_json_parse_all(U64 iterations)
+{
+    Json_Parsed_Fields fields;
+    for(U64 iteration = 0; iteration < iterations; iteration++)
+    {
+        bench_clobber();
+        json_parse_all(bench_json[iteration & INPUT_MASK], &fields);
+        bench_escape(&fields);
+    }
+}
+
+internal void
+case_abbreviate_path(U64 iterations)
+{
+    char output[512];
+    for(U64 iteration = 0; iteration < iterations; iteration++)
+    {
+        bench_clobber();
+        U64 length = abbreviate_path(bench_paths[iteration & INPUT_MASK], output, sizeof(output));
+        bench_keep(length);
+        bench_escape(output);
+    }
+}
+
+internal void
+case_abbreviate_model(U64 iterations)
+{
+    char output[64];
+    for(U64 iteration = 0; iteration < iterations; iteration++)
+    {
+        bench_clobber();
+        U64 length = abbreviate_model(bench_models[iteration & INPUT_MASK], output, sizeof(output));
+        bench_keep(length);
+        bench_escape(output);
+    }
+}
+
+internal void
+case_format_f64(U64 iterations)
+{
+    char output[64];
+    for(U64 iteration = 0; iteration < iterations; iteration++)
+    {
+        bench_clobber();
+        int length = format_f64(output, bench_costs[iteration & INPUT_MASK], 2);
+        bench_keep(length);
+        bench_escape(output);
+    }
+}
+
+internal void
+case_format_duration(U64 iterations)
+{
+    char output[64];
+    for(U64 iteration = 0; iteration < iterations; iteration++)
+    {
+        bench_clobber();
+        U64 length = format_duration(bench_durations[iteration & INPUT_MASK], output);
+        bench_keep(length);
+        bench_escape(output);
+    }
+}
+
+internal void
+case_make_context_bar(U64 iterations)
+{
+    char output[256];
+    for(U64 iteration = 0; iteration < iterations; iteration++)
+    {
+        bench_clobber();
+        U64 length = make_context_bar(bench_percents[iteration & INPUT_MASK], 200000, output, sizeof(output));
+        bench_keep(length);
+        bench_escape(output);
+    }
+}
+
+internal void
+case_build_statusline(U64 iterations)
+{
+    Output_Buffer buffer;
+    memset(&buffer, 0, sizeof(buffer));
+    for(U64 iteration = 0; iteration < iterations; iteration++)
+    {
+        bench_clobber();
+        buffer.length = 0;
+        buffer.previous_background = NULL;
+        buffer.previous_background_length = 0;
+        build_statusline(&buffer, &bench_states[iteration & INPUT_MASK], &bench_git);
+        bench_escape(&buffer);
+    }
+}
+
+typedef struct Bench_Case Bench_Case;
+struct Bench_Case
+{
+    const char *name;
+    void      (*run)(U64 iterations);
+};
+
+internal const Bench_Case bench_cases[] = {
+    {"json_parse_all",   case_json_parse_all},
+    {"abbreviate_path",  case_abbreviate_path},
+    {"abbreviate_model", case_abbreviate_model},
+    {"format_f64",       case_format_f64},
+    {"format_duration",  case_format_duration},
+    {"make_context_bar", case_make_context_bar},
+    {"build_statusline", case_build_statusline},
+};
+
+//~ Driver
+
+#define MAX_ROUNDS 64
+
+typedef struct Round_Result Round_Result;
+struct Round_Result
+{
+    U64 nanoseconds;
+    U64 cycles;
+};
+
+internal int
+compare_rounds(const void *left, const void *right)
+{
+    U64 a = ((const Round_Result *)left)->nanoseconds;
+    U64 b = ((const Round_Result *)right)->nanoseconds;
+    return (a > b) - (a < b);
+}
+
+internal void
+run_case(const Bench_Case *bench_case, U64 iterations, int rounds)
+{
+    // Warm caches, branch predictors and the CPU clock before timing
+    bench_case->run(iterations / 10 + 1);
+
+    Round_Result results[MAX_ROUNDS];
+    for(int round = 0; round < rounds; round++)
+    {
+        U64 start_ns = time_nanoseconds();
+        U64 start_cycles = time_cycles();
+        bench_case->run(iterations);
+        U64 end_cycles = time_cycles();
+        results[round].nanoseconds = time_nanoseconds() - start_ns;
+        results[round].cycles = end_cycles - start_cycles;
+    }
+    qsort(results, (size_t)rounds, sizeof(results[0]), compare_rounds);
+
+    Round_Result *best = &results[0];
+    Round_Result *median = &results[rounds / 2];
+    printf("%-18s %10.1f %10.1f", bench_case->name,
+           (double)best->nanoseconds / (double)iterations,
+           (double)median->nanoseconds / (double)iterations);
+    if(MICROBENCH_HAS_TSC)
+        printf(" %10.1f %10.1f\n",
+               (double)best->cycles / (double)iterations,
+               (double)median->cycles / (double)iterations);
+    else
+        printf(" %10s %10s\n", "-", "-");
+}
+
+internal int
+pin_cpu(int cpu)
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return -1;
+    if(cpu < 0)
+        for(int candidate = CPU_SETSIZE - 1; candidate >= 0 && cpu < 0; candidate--)
+            if(CPU_ISSET(candidate, &allowed)) cpu = candidate;
+    if(cpu < 0) return -1;
+
+    cpu_set_t pinned;
+    CPU_ZERO(&pinned);
+    CPU_SET(cpu, &pinned);
+    return sched_setaffinity(0, sizeof(pinned), &pinned) == 0 ? cpu : -1;
+}
+
+internal B32
+case_selected(const char *name, int argc, char **argv, int first)
+{
+    if(first >= argc) return true;
+    for(int index = first; index < argc; index++)
+        if(strstr(name, argv[index])) return true;
+    return false;
+}
+
+internal void
+print_usage(void)
+{
+    fprintf(stderr, "usage: statusline_microbench [-n iterations] [-r rounds] [-c cpu] [case...]\n"
+                    "  -n iterations  calls per round (default 1000000)\n"
+                    "  -r rounds      timed rounds per case, best and median reported (default 5)\n"
+                    "  -c cpu         CPU to pin to (default: last allowed)\n"
+                    "  case           run only cases whose name contains this\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    S64 iterations = 1000000;
+    int rounds = 5;
+    int cpu = -1;
+
+    int option;
+    while((option = getopt(argc, argv, "n:r:c:h")) != -1)
+    {
+        switch(option)
+        {
+        case 'n': iterations = atoll(optarg); break;
+        case 'r': rounds = atoi(optarg); break;
+        case 'c': cpu = atoi(optarg); break;
+        default:  print_usage(); return 2;
+        }
+    }
+    if(iterations <= 0 || rounds <= 0 || rounds > MAX_ROUNDS) { print_usage(); return 2; }
+
+    build_inputs();
+    cpu = pin_cpu(cpu);
+
+    if(cpu >= 0) printf("pinned to cpu %d, ", cpu);
+    else printf("not pinned, ");
+    printf("%lld iterations x %d rounds per case, cycles are %s\n\n", (long long)iterations, rounds,
+           MICROBENCH_HAS_TSC ? "TSC ticks" : "unavailable");
+    printf("%-18s %10s %10s %10s %10s\n", "case", "ns/op", "ns/op(med)", "cyc/op", "cyc/op(med)");
+
+    int matched = 0;
+    for(U64 index = 0; index < sizeof(bench_cases) / sizeof(bench_cases[0]); index++)
+    {
+        if(!case_selected(bench_cases[index].name, argc, argv, optind)) continue;
+        run_case(&bench_cases[index], (U64)iterations, rounds);
+        matched++;
+    }
+    if(matched == 0) { fprintf(stderr, "no case matches\n"); return 1; }
+    return 0;
+}
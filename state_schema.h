@@ -0,0 +1,101 @@
+// Claude Statusline - State Schema
+//
+// Every field the statusline reads from stdin, declared once. statusline.c
+// generates the parsed-field, cached and display structs, the extractor's
+// value stores and the cache merge in resolve_state from STATE_FIELDS
+// (session_id also names the session; see Session Identity there);
+// json_keys_gen.c builds the key hash in json_keys_table.h from both lists
+// (`make` regenerates it when this file changes).
+//
+// JSON_OBJECTS entries are (target, scope, "key"): objects to descend into,
+// which double as scopes. STATE_FIELDS entries are
+//
+//     (target, member, scope, "key", kind, capacity, persist, merge)
+//
+//   kind      STRING, S64, F64 or B32 (true/false)
+//   capacity  bytes of a STRING's copies, NUL included; 0 otherwise
+//   persist   PERSIST keeps it in the session cache for renders without
+//             stdin; TRANSIENT fields are zero there
+//   merge     how this frame's value meets the cached one:
+//             MAX       shown: frame value if > 0, else cached;
+//                       cached: the larger of the two
+//             FALLBACK  shown and cached: frame value if set, else cached
+//             LATEST    shown and cached: the frame value, even when absent
+//
+// A key is only recognized inside an object of type `scope`. Strings can't
+// be MAX, and transient fields must be LATEST (checked at compile time).
+// Changing a PERSIST field changes Cached_State: bump STATE_TABLE_VERSION.
+
+#ifndef STATE_SCHEMA_H
+#define STATE_SCHEMA_H
+
+#define JSON_OBJECTS(OBJECT)                                                               \
+    OBJECT(MODEL,               ROOT,           "model")                                   \
+    OBJECT(WORKSPACE,           ROOT,           "workspace")                               \
+    OBJECT(COST,                ROOT,           "cost")                                    \
+    OBJECT(CONTEXT_WINDOW,      ROOT,           "context_window")                          \
+    OBJECT(VIM,                 ROOT,           "vim")                                     \
+    OBJECT(THINKING,            ROOT,           "thinking")                                \
+    OBJECT(RATE_LIMITS,         ROOT,           "rate_limits")                             \
+    OBJECT(FIVE_HOUR,           RATE_LIMITS,    "five_hour")                               \
+    OBJECT(SEVEN_DAY,           RATE_LIMITS,    "seven_day")
+
+#define STATE_FIELDS(FIELD)                                                                \
+    FIELD(SESSION_ID,          session_id,          ROOT,           "session_id",           \
+          STRING, 64,  TRANSIENT, LATEST)                                                  \
+    FIELD(CURRENT_DIR,         working_directory,   WORKSPACE,      "current_dir",          \
+          STRING, 512, PERSIST,   FALLBACK)                                                \
+    FIELD(DISPLAY_NAME,        model,               MODEL,          "display_name",         \
+          STRING, 64,  PERSIST,   FALLBACK)                                                \
+    FIELD(MODE,                vim_mode,            VIM,            "mode",                 \
+          STRING, 32,  TRANSIENT, LATEST)                                                  \
+    FIELD(TOTAL_COST_USD,      cost_usd,            COST,           "total_cost_usd",       \
+          F64,    0,   PERSIST,   MAX)                                                     \
+    FIELD(LINES_ADDED,         lines_added,         COST,           "total_lines_added",    \
+          S64,    0,   PERSIST,   MAX)                                                     \
+    FIELD(LINES_REMOVED,       lines_removed,       COST,           "total_lines_removed",  \
+          S64,    0,   PERSIST,   MAX)                                                     \
+    FIELD(DURATION_MS,         total_duration_ms,   COST,           "total_duration_ms",    \
+          S64,    0,   PERSIST,   MAX)                                                     \
+    FIELD(USED_PERCENTAGE,     used_percent,        CONTEXT_WINDOW, "used_percentage",      \
+          S64,    0,   PERSIST,   FALLBACK)                                                \
+    FIELD(CONTEXT_WINDOW_SIZE, context_size,        CONTEXT_WINDOW, "context_window_size",  \
+          S64,    0,   PERSIST,   MAX)                                                     \
+    FIELD(TOTAL_INPUT_TOKENS,  total_input_tokens,  CONTEXT_WINDOW, "total_input_tokens",   \
+          S64,    0,   PERSIST,   FALLBACK)                                                \
+    FIELD(EXCEEDS_200K,        exceeds_200k,        ROOT,           "exceeds_200k_tokens",  \
+          B32,    0,   PERSIST,   LATEST)                                                  \
+    FIELD(THINKING_ENABLED,    thinking_enabled,    THINKING,       "enabled",              \
+          B32,    0,   PERSIST,   LATEST)                                                  \
+    FIELD(FIVE_HOUR_PCT,       five_hour_pct,       FIVE_HOUR,      "used_percentage",      \
+          F64,    0,   PERSIST,   LATEST)                                                  \
+    FIELD(FIVE_HOUR_RESETS_AT, five_hour_resets_at, FIVE_HOUR,      "resets_at",            \
+          S64,    0,   PERSIST,   LATEST)                                                  \
+    FIELD(SEVEN_DAY_PCT,       seven_day_pct,       SEVEN_DAY,      "used_percentage",      \
+          F64,    0,   PERSIST,   LATEST)                                                  \
+    FIELD(SEVEN_DAY_RESETS_AT, seven_day_resets_at, SEVEN_DAY,      "resets_at",            \
+          S64,    0,   PERSIST,   LATEST)
+
+#define JSON_OBJECT_ENUM(target, scope, name) JSON_TARGET_##target,
+#define STATE_FIELD_ENUM(target, member, scope, name, kind, capacity, persist, merge) JSON_TARGET_##target,
+
+// Objects, then fields; the marker between them is how the parser tells
+// the two apart
+enum Json_Target
+{
+    JSON_TARGET_NONE,
+    JSON_TARGET_ROOT,
+    JSON_OBJECTS(JSON_OBJECT_ENUM)
+    JSON_TARGET_FIELDS,
+    STATE_FIELDS(STATE_FIELD_ENUM)
+    JSON_TARGET_COUNT,
+};
+
+enum State_Merge
+{
+    STATE_MERGE_MAX,
+    STATE_MERGE_FALLBACK,
+    STATE_MERGE_LATEST,
+};
+
+#endif
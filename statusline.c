@@ -1,40 +1,81 @@
 // Claude Code Statusline - C Version
 //
 // Full port of the Odin statusline with all features:
-//   - State cache in /dev/shm for flicker prevention
-//   - Git cache with mtime invalidation + background refresh (double-fork)
-//   - fork/exec git directly (no shell, no daemon)
-//   - Stdin poll with 50ms timeout
+//   - State cache in shared memory for flicker prevention
+//   - Git cache with mtime invalidation + detached background refresh
+//   - gitstatusd over FIFOs when running, else an in-process index engine,
+//     else a spawned git
+//   - Streaming stdin read (any size) with a 50ms deadline
 //   - Vim mode, context bar, duration, context warnings
+//   - Optional resident server (--server) with thin exec client
+//   - inotify git watcher (--watch) that keeps the git cache current
 //
-// Build: cc -O3 -march=native -o statusline statusline.c
+// Build: cc -O3 -march=native -pthread -o statusline statusline.c -lz
+//        (`make static` links it as a static PIE, which starts faster;
+//        `make pgo` rebuilds it from a profile of the payloads/ corpus)
 // Usage: Set in ~/.claude/settings.json statusLine.command
+//        statusline --server   (normally auto-started by the first render)
+//        statusline --watch [repo]  (likewise, on the first git cache miss)
+//        statusline --stats [session]  (render latency percentiles)
+//        statusline --reap  (removes dead sessions' files; started by renders)
+//        statusline --refresh-git <repo>, --refresh-usage <session>
+//          (background refreshes; started by renders)
 //
 // Shared state files:
-//   /dev/shm/statusline-cache.<gppid>   - Per-session cached state
-//   /dev/shm/statusline-usage.<gppid>   - Per-session usage quota cache
-//   /dev/shm/statusline-cleanup         - Sentinel for cleanup interval
-//   /dev/shm/claude-git-<hash>          - Per-repo git status cache
-//   /tmp/statusline-<uid>/<pid>.log     - Debug timing logs
+//   /dev/shm/statusline-<uid>/          - Per-user directory (0700;
+//                                         STATUSLINE_STATE_DIR overrides):
+//     state-v8.table                    - Session state, usage quota,
+//                                         per-repo git status, repo
+//                                         discovery (seqlock table) and
+//                                         the registry of session files
+//     timing-<session>.ring             - Per-session render timing ring
+//     gitstatusd.lock                   - Serializes gitstatusd exchanges
+//   /tmp/statusline-<uid>/<session>.log - Debug timing and perf counter logs
+//     (<session> is the payload's session_id, else pid-<Claude's pid>)
+//   $XDG_RUNTIME_DIR/statusline.sock    - Resident server socket
+//     (or /tmp/statusline-<uid>/server.sock)
+//   $XDG_RUNTIME_DIR/statusline-watch.sock - Git watcher socket
+//     (or /tmp/statusline-<uid>/watch.sock)
 
 #define _GNU_SOURCE
 #include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <poll.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
+#include <spawn.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
+#include <zlib.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include <linux/perf_event.h>
 
 //~ Base Types
 
 typedef uint8_t   U8;
+typedef uint16_t  U16;
 typedef uint32_t  U32;
+typedef int32_t   S32;
 typedef int64_t   S64;
 typedef uint64_t  U64;
 typedef int       B32;
@@ -106,6 +147,7 @@ time_milliseconds_realtime(void)
 #define ICON_STAGED   "\xef\x80\x8c"  // U+F00C (checkmark)
 #define ICON_MODIFIED "\xef\x81\x80"  // U+F040 (pencil)
 #define ICON_WARN     "\xef\x81\xb1"  // U+F071 (warning triangle)
+#define ICON_BRAIN    "\xf3\xb0\xa7\x91"  // U+F09D1 (extended thinking on)
 
 // UTF-8 box drawing
 #define UTF8_LCAP   "\xe2\x95\xba"  // ╺
@@ -223,6 +265,82 @@ output_f64(Output_Buffer *buffer, double value, int decimals)
     output_string(buffer, temp, length);
 }
 
+//~ String Builder (paths and names without snprintf)
+//
+// A bounded, always NUL-terminated string. Like snprintf's return value,
+// `length` counts everything appended, so length >= capacity means the
+// result was truncated.
+
+typedef struct String_Builder String_Builder;
+struct String_Builder
+{
+    char *data;
+    U64   capacity;
+    U64   length;
+};
+
+internal String_Builder
+string_builder(char *data, U64 capacity)
+{
+    String_Builder builder = {data, capacity, 0};
+    if(capacity > 0) data[0] = '\0';
+    return builder;
+}
+
+internal void
+string_append(String_Builder *builder, const char *string, U64 string_length)
+{
+    if(builder->length < builder->capacity)
+    {
+        U64 copy_length = Min(string_length, builder->capacity - 1 - builder->length);
+        memcpy(builder->data + builder->length, string, copy_length);
+        builder->data[builder->length + copy_length] = '\0';
+    }
+    builder->length += string_length;
+}
+
+#define string_append_literal(builder, string) string_append(builder, string, sizeof(string) - 1)
+
+internal void
+string_append_cstring(String_Builder *builder, const char *string)
+{
+    string_append(builder, string, strlen(string));
+}
+
+internal void
+string_append_char(String_Builder *builder, char character)
+{
+    string_append(builder, &character, 1);
+}
+
+internal void
+string_append_s64(String_Builder *builder, S64 value)
+{
+    char digits[24];
+    string_append(builder, digits, (U64)format_s64(digits, value));
+}
+
+// `directory` followed by `suffix`, which brings its own '/'
+internal U64
+path_join(char *output, U64 output_capacity, const char *directory, const char *suffix)
+{
+    String_Builder path = string_builder(output, output_capacity);
+    string_append_cstring(&path, directory);
+    string_append_cstring(&path, suffix);
+    return path.length;
+}
+
+// `prefix`, a decimal number, then `suffix` ("/proc/" pid "/stat")
+internal U64
+string_number(char *output, U64 output_capacity, const char *prefix, S64 number, const char *suffix)
+{
+    String_Builder string = string_builder(output, output_capacity);
+    string_append_cstring(&string, prefix);
+    string_append_s64(&string, number);
+    string_append_cstring(&string, suffix);
+    return string.length;
+}
+
 //~ Segment Builder
 
 // All ANSI BG strings have format \x1b[48;2;R;G;Bm
@@ -295,165 +413,517 @@ segment_end(Output_Buffer *buffer)
     }
 }
 
-//~ Single-Pass JSON Parser
+//~ JSON Structural Scanner
+//
+// simdjson-style stage 1 over the stdin payload, 64 bytes per step: compare
+// the block against '"', '\\', '{' and '}' into bitmasks (AVX2, SSE2 or a
+// scalar loop, whichever the build targets), drop quotes escaped by an odd
+// run of backslashes, and prefix-XOR the remaining quotes into an in-string
+// mask. What comes out is where strings start and end and where objects
+// open and close outside strings, so the extractor below only ever looks
+// at real keys and values, never at bytes inside a string.
+
+typedef struct Json_Scanner Json_Scanner;
+struct Json_Scanner
+{
+    U64 previous_escaped;      // 1 if the next block's first byte is escaped
+    U64 previous_in_string;    // all ones if a string is still open
+};
+
+typedef struct Json_Block_Masks Json_Block_Masks;
+struct Json_Block_Masks
+{
+    U64 string_starts;         // opening '"' of every key and string value
+    U64 string_ends;           // and its closing '"'
+    U64 object_opens;          // '{' outside strings
+    U64 object_closes;         // '}' outside strings
+};
+
+internal void
+json_classify_block(const U8 *block, U64 *quotes, U64 *backslashes, U64 *opens, U64 *closes)
+{
+#if defined(__AVX2__)
+    __m256i low  = _mm256_loadu_si256((const __m256i *)block);
+    __m256i high = _mm256_loadu_si256((const __m256i *)(block + 32));
+#define JSON_MASK(character) \
+    ((U64)(U32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, _mm256_set1_epi8(character))) | \
+     (U64)(U32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, _mm256_set1_epi8(character))) << 32)
+    *quotes      = JSON_MASK('"');
+    *backslashes = JSON_MASK('\\');
+    *opens       = JSON_MASK('{');
+    *closes      = JSON_MASK('}');
+#undef JSON_MASK
+#elif defined(__SSE2__)
+    __m128i lanes[4];
+    for(int lane = 0; lane < 4; lane++) lanes[lane] = _mm_loadu_si128((const __m128i *)(block + 16 * lane));
+#define JSON_MASK(character) \
+    ((U64)(U16)_mm_movemask_epi8(_mm_cmpeq_epi8(lanes[0], _mm_set1_epi8(character)))       | \
+     (U64)(U16)_mm_movemask_epi8(_mm_cmpeq_epi8(lanes[1], _mm_set1_epi8(character))) << 16 | \
+     (U64)(U16)_mm_movemask_epi8(_mm_cmpeq_epi8(lanes[2], _mm_set1_epi8(character))) << 32 | \
+     (U64)(U16)_mm_movemask_epi8(_mm_cmpeq_epi8(lanes[3], _mm_set1_epi8(character))) << 48)
+    *quotes      = JSON_MASK('"');
+    *backslashes = JSON_MASK('\\');
+    *opens       = JSON_MASK('{');
+    *closes      = JSON_MASK('}');
+#undef JSON_MASK
+#else
+    U64 quote_bits = 0, backslash_bits = 0, open_bits = 0, close_bits = 0;
+    for(int index = 0; index < 64; index++)
+    {
+        U64 bit = 1ull << index;
+        switch(block[index])
+        {
+        case '"':  quote_bits |= bit;     break;
+        case '\\': backslash_bits |= bit; break;
+        case '{':  open_bits |= bit;      break;
+        case '}':  close_bits |= bit;     break;
+        }
+    }
+    *quotes = quote_bits; *backslashes = backslash_bits; *opens = open_bits; *closes = close_bits;
+#endif
+}
+
+// Bits after an odd-length run of backslashes (simdjson's find_escaped)
+internal U64
+json_escaped_bits(Json_Scanner *scanner, U64 backslashes)
+{
+    const U64 even_bits = 0x5555555555555555ull;
+    backslashes &= ~scanner->previous_escaped;
+    U64 follows_escape = backslashes << 1 | scanner->previous_escaped;
+    U64 odd_sequence_starts = backslashes & ~even_bits & ~follows_escape;
+    U64 sequences_starting_on_even_bits;
+    scanner->previous_escaped = __builtin_add_overflow(odd_sequence_starts, backslashes,
+                                                       &sequences_starting_on_even_bits);
+    U64 invert_mask = sequences_starting_on_even_bits << 1;
+    return (even_bits ^ invert_mask) & follows_escape;
+}
+
+// Bit i = XOR of bits 0..i: set from an opening quote up to (not including)
+// its closing quote
+internal U64
+json_prefix_xor(U64 bits)
+{
+#if defined(__PCLMUL__)
+    __m128i product = _mm_clmulepi64_si128(_mm_set_epi64x(0, (S64)bits), _mm_set1_epi8((char)0xff), 0);
+    return (U64)_mm_cvtsi128_si64(product);
+#else
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+#endif
+}
+
+// Per-block and per-structural steps of json_parser_feed. It has more than
+// one caller, so GCC stops inlining these into it, and the calls cost ~15%
+// of a parse.
+#define JSON_HOT inline __attribute__((always_inline))
+
+internal JSON_HOT Json_Block_Masks
+json_scan_block(Json_Scanner *scanner, const U8 *block)
+{
+    U64 quotes, backslashes, opens, closes;
+    json_classify_block(block, &quotes, &backslashes, &opens, &closes);
+
+    quotes &= ~json_escaped_bits(scanner, backslashes);
+    U64 in_string = json_prefix_xor(quotes) ^ scanner->previous_in_string;
+    scanner->previous_in_string = (U64)((S64)in_string >> 63);
+
+    Json_Block_Masks masks;
+    masks.string_starts = quotes & in_string;
+    masks.string_ends   = quotes & ~in_string;
+    masks.object_opens  = opens & ~in_string;
+    masks.object_closes = closes & ~in_string;
+    return masks;
+}
+
+//~ Path-Scoped JSON Extractor
+//
+// Stage 2 over the structural index: walk the string starts/ends and the
+// braces in order, keeping a stack of the objects we're inside. A string
+// followed by ':' is a key and is looked up in the current scope only, so
+// the three `used_percentage` keys (context_window, rate_limits.five_hour,
+// rate_limits.seven_day) land in three fields, and `mode` only counts
+// under `vim`. Values come back as zero-copy slices of the payload;
+// escapes are decoded only when a field is actually copied out
+// (json_string_copy).
+
+typedef struct Json_String Json_String;
+struct Json_String
+{
+    const char *data;          // raw bytes between the quotes, escapes intact
+    U64         length;
+};
+
+// The field list, the key list and its perfect hash are generated (see
+// state_schema.h and json_keys_gen.c)
+#include "json_keys.h"
+#include "json_keys_table.h"
+
+#define JSON_FIELD_STRING(member, capacity) Json_String member;
+#define JSON_FIELD_S64(member, capacity)    S64         member;
+#define JSON_FIELD_F64(member, capacity)    double      member;
+#define JSON_FIELD_B32(member, capacity)    B32         member;
+#define JSON_FIELD(target, member, scope, name, kind, capacity, persist, merge) \
+    JSON_FIELD_##kind(member, capacity)
 
 typedef struct Json_Parsed_Fields Json_Parsed_Fields;
 struct Json_Parsed_Fields
 {
-    const char *current_dir;      U64 current_dir_length;
-    const char *display_name;     U64 display_name_length;
-    const char *mode;             U64 mode_length;
-    double total_cost_usd;
-    S64    total_lines_added;
-    S64    total_lines_removed;
-    S64    total_duration_ms;
-    S64    used_percentage;
-    S64    context_window_size;
+    STATE_FIELDS(JSON_FIELD)
 };
 
-// Pre-computed key strings with lengths (no snprintf needle building)
-#define KEY_CURRENT_DIR       "\"current_dir\":"
-#define KEY_DISPLAY_NAME      "\"display_name\":"
-#define KEY_MODE              "\"mode\":"
-#define KEY_TOTAL_COST_USD    "\"total_cost_usd\":"
-#define KEY_LINES_ADDED       "\"total_lines_added\":"
-#define KEY_LINES_REMOVED     "\"total_lines_removed\":"
-#define KEY_DURATION_MS       "\"total_duration_ms\":"
-#define KEY_USED_PCT          "\"used_percentage\":"
-#define KEY_CTX_SIZE          "\"context_window_size\":"
-
-// Parse a JSON string value at current position (cursor points past ':')
-// Returns pointer into json, sets *length. Advances *cursor past closing quote.
-internal const char *
-parse_json_string(const char **cursor, U64 *length)
-{
-    const char *scanner = *cursor;
-    while(*scanner == ' ' || *scanner == '\t') scanner++;
-    if(*scanner != '"') { *length = 0; return NULL; }
-    scanner++;
-    const char *start = scanner;
-    while(*scanner && *scanner != '"') scanner++;
-    *length = (U64)(scanner - start);
-    if(*scanner == '"') scanner++;
-    *cursor = scanner;
-    return start;
+// Keys are compared raw: none of ours need escaping, and a key spelled with
+// escapes just goes unrecognized
+internal enum Json_Target
+json_lookup_key(U8 scope, const char *name, U64 length)
+{
+    if(scope == JSON_TARGET_NONE) return JSON_TARGET_NONE;
+    U64 head, tail;
+    json_key_words(name, length, 1, &head, &tail);
+    U32 hash = json_key_hash(scope, head, tail, length);
+    U32 displacement = json_key_displacements[hash % JSON_KEY_BUCKETS];
+    const Json_Key *key = &json_key_slots[json_key_slot(hash, displacement, JSON_KEY_SLOTS)];
+    if(key->head == head && key->tail == tail && key->length == length && key->scope == scope &&
+       (length <= 16 || memcmp(key->name + 8, name + 8, length - 16) == 0))
+        return (enum Json_Target)key->target;
+    return JSON_TARGET_NONE;
+}
+
+#define JSON_MAX_DEPTH 32
+
+// Incremental: bytes can be fed as they arrive (json_parser_feed). A block
+// is only committed once all 64 of its bytes are in, and a key whose ':'
+// or scalar value isn't in yet is left for the next feed.
+typedef struct Json_Parser Json_Parser;
+struct Json_Parser
+{
+    Json_Scanner scanner;      // state at the start of block_start
+    U64 block_start;           // the block being walked
+    U64 unhandled;             // its structurals not handled yet
+    U64 string_start;          // offset just past the open string's quote
+    U8  pending;               // target of the key whose value comes next
+    B32 complete;              // the root object has closed
+    U32 depth;                 // may exceed JSON_MAX_DEPTH; scopes[] stops there
+    U8  scopes[JSON_MAX_DEPTH];
+};
+
+internal U8
+json_parser_scope(Json_Parser *parser)
+{
+    if(parser->depth == 0 || parser->depth > JSON_MAX_DEPTH) return JSON_TARGET_NONE;
+    return parser->scopes[parser->depth - 1];
 }
 
 // Parse a JSON number at current position (cursor points past ':')
 internal S64
-parse_json_s64(const char **cursor)
+parse_json_s64(const char *cursor)
 {
-    const char *scanner = *cursor;
-    while(*scanner == ' ' || *scanner == '\t') scanner++;
-    S64 value = strtoll(scanner, (char **)&scanner, 10);
-    *cursor = scanner;
-    return value;
+    while(*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r') cursor++;
+    return strtoll(cursor, NULL, 10);
 }
 
 internal double
-parse_json_f64(const char **cursor)
+parse_json_f64(const char *cursor)
 {
-    const char *scanner = *cursor;
-    while(*scanner == ' ' || *scanner == '\t') scanner++;
-    double value = strtod(scanner, (char **)&scanner);
-    *cursor = scanner;
-    return value;
+    while(*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r') cursor++;
+    return strtod(cursor, NULL);
 }
 
-// Match a key at position. Returns length of key if matched, 0 otherwise.
-#define TRY_KEY(position, key) \
-    (memcmp(position, key, sizeof(key)-1) == 0 ? sizeof(key)-1 : 0)
+internal B32
+parse_json_b32(const char *cursor)
+{
+    while(*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r') cursor++;
+    return *cursor == 't';
+}
+
+// Scalars are parsed as soon as their key is seen; returns false for
+// strings and objects, whose values come later
+#define JSON_STORE_SCALAR_STRING(target, member)
+#define JSON_STORE_SCALAR_S64(target, member) case target: fields->member = parse_json_s64(value); return true;
+#define JSON_STORE_SCALAR_F64(target, member) case target: fields->member = parse_json_f64(value); return true;
+#define JSON_STORE_SCALAR_B32(target, member) case target: fields->member = parse_json_b32(value); return true;
+#define JSON_STORE_SCALAR(target, member, scope, name, kind, capacity, persist, merge) \
+    JSON_STORE_SCALAR_##kind(JSON_TARGET_##target, member)
+
+internal B32
+json_store_scalar(enum Json_Target target, const char *value, Json_Parsed_Fields *fields)
+{
+    switch(target)
+    {
+    STATE_FIELDS(JSON_STORE_SCALAR)
+    default: return false;
+    }
+}
+
+#define JSON_STORE_STRING_STRING(target, member) case target: fields->member = value; break;
+#define JSON_STORE_STRING_S64(target, member)
+#define JSON_STORE_STRING_F64(target, member)
+#define JSON_STORE_STRING_B32(target, member)
+#define JSON_STORE_STRING(target, member, scope, name, kind, capacity, persist, merge) \
+    JSON_STORE_STRING_##kind(JSON_TARGET_##target, member)
 
 internal void
-json_parse_all(const char *json, Json_Parsed_Fields *fields)
+json_store_string(enum Json_Target target, Json_String value, Json_Parsed_Fields *fields)
 {
-    memset(fields, 0, sizeof(*fields));
-    const char *cursor = json;
+    switch(target)
+    {
+    STATE_FIELDS(JSON_STORE_STRING)
+    default: break;
+    }
+}
 
-    while(*cursor)
+internal B32
+json_is_space(char character)
+{
+    return character == ' ' || character == '\t' || character == '\n' || character == '\r';
+}
+
+// Whether a scalar starting at `cursor` (just past a ':') is followed by a
+// delimiter before `end`, i.e. strtoll/strtod would see all of it
+internal B32
+json_scalar_complete(const char *cursor, const char *end)
+{
+    while(cursor < end && json_is_space(*cursor)) cursor++;
+    while(cursor < end && *cursor != ',' && *cursor != '}' && *cursor != ']' && !json_is_space(*cursor)) cursor++;
+    return cursor < end;
+}
+
+// One structural character at `offset`: a string's opening or closing
+// quote, or a brace outside strings. Returns false, having changed
+// nothing, when the bytes it needs past `length` aren't in yet (never once
+// `finished`).
+internal JSON_HOT B32
+json_parser_structural(Json_Parser *parser, const char *json, U64 length, B32 finished,
+                       U64 offset, B32 string_start, Json_Parsed_Fields *fields)
+{
+    char character = json[offset];
+    if(character == '{')
+    {
+        // The outermost object is the root; nested ones we don't know get
+        // a scope no key matches in
+        U8 scope = parser->depth == 0 ? JSON_TARGET_ROOT :
+                   parser->pending < JSON_TARGET_FIELDS ? parser->pending : JSON_TARGET_NONE;
+        if(parser->depth < JSON_MAX_DEPTH) parser->scopes[parser->depth] = scope;
+        parser->depth++;
+        parser->pending = JSON_TARGET_NONE;
+    }
+    else if(character == '}')
+    {
+        if(parser->depth > 0 && --parser->depth == 0) parser->complete = true;
+        parser->pending = JSON_TARGET_NONE;
+    }
+    else if(string_start)
+        parser->string_start = offset + 1;
+    else
     {
-        // Scan for next '"'
-        while(*cursor && *cursor != '"') cursor++;
-        if(*cursor == 0) break;
+        Json_String string = {json + parser->string_start, offset - parser->string_start};
+        const char *end = json + length;
+        const char *after = json + offset + 1;
+        while(after < end && json_is_space(*after)) after++;
+        if(after == end && !finished) return false;
+        if(after < end && *after == ':')
+        {
+            // A key: scalars are parsed on the spot, everything else waits
+            // for the value's own structurals
+            U8 target = json_lookup_key(json_parser_scope(parser), string.data, string.length);
+            if(target > JSON_TARGET_FIELDS && !finished && !json_scalar_complete(after + 1, end)) return false;
+            parser->pending = target;
+            if(target > JSON_TARGET_FIELDS && json_store_scalar(target, after + 1, fields))
+                parser->pending = JSON_TARGET_NONE;
+        }
+        else
+        {
+            json_store_string(parser->pending, string, fields);
+            parser->pending = JSON_TARGET_NONE;
+        }
+    }
+    return true;
+}
 
-        U64 key_length;
+internal void
+json_parser_begin(Json_Parser *parser, Json_Parsed_Fields *fields)
+{
+    memset(parser, 0, sizeof(*parser));
+    parser->unhandled = ~0ull;
+    memset(fields, 0, sizeof(*fields));
+}
 
-        // Dispatch on first char after '"' for fast rejection
-        switch(cursor[1])
+// Walk `json[0, length)` from where the last feed stopped; `finished`
+// means no more bytes are coming. Stops early once the root closes.
+internal void
+json_parser_feed(Json_Parser *parser, const char *json, U64 length, B32 finished,
+                 Json_Parsed_Fields *fields)
+{
+    while(!parser->complete && parser->block_start < length)
+    {
+        U64 available = length - parser->block_start;
+        const U8 *block = (const U8 *)json + parser->block_start;
+        U8 padded[64];
+        if(available < 64)
         {
-        case 'c':
-            if((key_length = TRY_KEY(cursor, KEY_CURRENT_DIR)))
-            {
-                cursor += key_length;
-                fields->current_dir = parse_json_string(&cursor, &fields->current_dir_length);
-                continue;
-            }
-            if((key_length = TRY_KEY(cursor, KEY_CTX_SIZE)))
-            {
-                cursor += key_length;
-                fields->context_window_size = parse_json_s64(&cursor);
-                continue;
-            }
-            break;
+            memset(padded, 0, sizeof(padded));
+            memcpy(padded, block, available);
+            block = padded;
+        }
 
-        case 'd':
-            if((key_length = TRY_KEY(cursor, KEY_DISPLAY_NAME)))
+        // Scanned from a copy, so a partial block can be scanned again
+        // once the rest of it arrives
+        Json_Scanner scanner = parser->scanner;
+        Json_Block_Masks masks = json_scan_block(&scanner, block);
+        U64 structurals = (masks.string_starts | masks.string_ends | masks.object_opens | masks.object_closes) &
+                          parser->unhandled;
+        for(; structurals; structurals &= structurals - 1)
+        {
+            U64 bit = structurals & -structurals;
+            if(!json_parser_structural(parser, json, length, finished,
+                                       parser->block_start + __builtin_ctzll(structurals),
+                                       (masks.string_starts & bit) != 0, fields))
             {
-                cursor += key_length;
-                fields->display_name = parse_json_string(&cursor, &fields->display_name_length);
-                continue;
+                parser->unhandled = ~(bit - 1);
+                return;
             }
-            break;
+            if(parser->complete) return;
+        }
+        if(available < 64)
+        {
+            // Everything before `available` is handled; the rest comes later
+            parser->unhandled = ~0ull << available;
+            return;
+        }
 
-        case 'm':
-            if((key_length = TRY_KEY(cursor, KEY_MODE)))
-            {
-                cursor += key_length;
-                fields->mode = parse_json_string(&cursor, &fields->mode_length);
-                continue;
-            }
-            break;
+        parser->scanner = scanner;
+        parser->block_start += 64;
+        parser->unhandled = ~0ull;
+    }
+}
 
-        case 't':
-            if((key_length = TRY_KEY(cursor, KEY_TOTAL_COST_USD)))
-            {
-                cursor += key_length;
-                fields->total_cost_usd = parse_json_f64(&cursor);
-                continue;
-            }
-            if((key_length = TRY_KEY(cursor, KEY_LINES_ADDED)))
-            {
-                cursor += key_length;
-                fields->total_lines_added = parse_json_s64(&cursor);
-                continue;
-            }
-            if((key_length = TRY_KEY(cursor, KEY_LINES_REMOVED)))
-            {
-                cursor += key_length;
-                fields->total_lines_removed = parse_json_s64(&cursor);
-                continue;
-            }
-            if((key_length = TRY_KEY(cursor, KEY_DURATION_MS)))
-            {
-                cursor += key_length;
-                fields->total_duration_ms = parse_json_s64(&cursor);
-                continue;
-            }
-            break;
+// A whole payload at once; false if it ends inside the root object
+internal B32
+json_parse_all(const char *json, Json_Parsed_Fields *fields)
+{
+    Json_Parser parser;
+    json_parser_begin(&parser, fields);
+    json_parser_feed(&parser, json, strlen(json), true, fields);
+    return parser.complete;
+}
+
+internal U64
+json_hex_digit(char character)
+{
+    if(character >= '0' && character <= '9') return (U64)(character - '0');
+    if(character >= 'a' && character <= 'f') return (U64)(character - 'a' + 10);
+    if(character >= 'A' && character <= 'F') return (U64)(character - 'A' + 10);
+    return 16;
+}
+
+// \uXXXX at `escape` (pointing at the 'u'); 0x110000 if malformed
+internal U32
+json_read_unicode(const char *escape, const char *end)
+{
+    if(end - escape < 5) return 0x110000;
+    U32 code_point = 0;
+    for(int index = 1; index <= 4; index++)
+    {
+        U64 digit = json_hex_digit(escape[index]);
+        if(digit > 15) return 0x110000;
+        code_point = (code_point << 4) | (U32)digit;
+    }
+    return code_point;
+}
+
+internal U64
+utf8_encode(U32 code_point, char *output)
+{
+    if(code_point < 0x80) { output[0] = (char)code_point; return 1; }
+    if(code_point < 0x800)
+    {
+        output[0] = (char)(0xc0 | (code_point >> 6));
+        output[1] = (char)(0x80 | (code_point & 0x3f));
+        return 2;
+    }
+    if(code_point < 0x10000)
+    {
+        output[0] = (char)(0xe0 | (code_point >> 12));
+        output[1] = (char)(0x80 | ((code_point >> 6) & 0x3f));
+        output[2] = (char)(0x80 | (code_point & 0x3f));
+        return 3;
+    }
+    output[0] = (char)(0xf0 | (code_point >> 18));
+    output[1] = (char)(0x80 | ((code_point >> 12) & 0x3f));
+    output[2] = (char)(0x80 | ((code_point >> 6) & 0x3f));
+    output[3] = (char)(0x80 | (code_point & 0x3f));
+    return 4;
+}
+
+// Decode `string` into output (NUL-terminated, truncated to fit). Strings
+// without a backslash, which is nearly all of them, are a single memcpy.
+internal U64
+json_string_copy(Json_String string, char *output, U64 output_capacity)
+{
+    if(output_capacity == 0) return 0;
+    U64 limit = output_capacity - 1;
+    if(string.length == 0 || memchr(string.data, '\\', string.length) == NULL)
+    {
+        U64 length = Min(string.length, limit);
+        memcpy(output, string.data, length);
+        output[length] = '\0';
+        return length;
+    }
 
-        case 'u':
-            if((key_length = TRY_KEY(cursor, KEY_USED_PCT)))
+    const char *cursor = string.data;
+    const char *end = string.data + string.length;
+    U64 position = 0;
+    while(cursor < end)
+    {
+        char decoded[4];
+        U64 decoded_length = 1;
+        if(*cursor != '\\' || cursor + 1 >= end)
+        {
+            decoded[0] = *cursor++;
+        }
+        else
+        {
+            char escape = cursor[1];
+            cursor += 2;
+            switch(escape)
             {
-                cursor += key_length;
-                fields->used_percentage = parse_json_s64(&cursor);
-                continue;
+            case 'b': decoded[0] = '\b'; break;
+            case 'f': decoded[0] = '\f'; break;
+            case 'n': decoded[0] = '\n'; break;
+            case 'r': decoded[0] = '\r'; break;
+            case 't': decoded[0] = '\t'; break;
+            case 'u':
+            {
+                U32 code_point = json_read_unicode(cursor - 1, end);
+                if(code_point <= 0xffff) cursor += 4;
+                // A high surrogate followed by \uDC00-\uDFFF is one code point
+                if(code_point >= 0xd800 && code_point <= 0xdbff && end - cursor >= 6 && cursor[0] == '\\')
+                {
+                    U32 low = json_read_unicode(cursor + 1, end);
+                    if(low >= 0xdc00 && low <= 0xdfff)
+                    {
+                        code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low - 0xdc00);
+                        cursor += 6;
+                    }
+                }
+                if(code_point > 0x10ffff || (code_point >= 0xd800 && code_point <= 0xdfff))
+                    code_point = 0xfffd;
+                decoded_length = utf8_encode(code_point, decoded);
+            } break;
+            default: decoded[0] = escape; break;  // \" \\ \/
             }
-            break;
         }
 
-        // Not a key we care about — skip past this '"'
-        cursor++;
+        if(position + decoded_length > limit) break;
+        memcpy(output + position, decoded, decoded_length);
+        position += decoded_length;
     }
+    output[position] = '\0';
+    return position;
 }
 
 //~ Path Abbreviation
@@ -504,7 +974,7 @@ abbreviate_path(const char *path, char *output, U64 output_capacity)
 
     while(scan_position < working_length && output_position < output_capacity - 1)
     {
-        if(scan_position > 0 && working[scan_position] == '/')
+        if(working[scan_position] == '/')
         {
             output[output_position++] = '/';
             scan_position++;
@@ -658,11 +1128,23 @@ struct Git_Status
     enum Cache_State cache_state;
 };
 
+// Where a repo's files live, as resolved by git_repo_discover. For a plain
+// repo git_directory is <worktree>/.git and common_directory is the same; a
+// linked worktree or submodule has its own git_directory (HEAD, index), and
+// a linked worktree shares refs, objects and config through common_directory.
+typedef struct __attribute__((packed)) Git_Repo Git_Repo;
+struct __attribute__((packed)) Git_Repo
+{
+    char worktree[256];
+    char git_directory[256];
+    char common_directory[256];
+};
+
 internal S64
-git_read_stash_count(const char *repo_directory)
+git_read_stash_count(const char *common_directory)
 {
     char path[512];
-    snprintf(path, sizeof(path), "%s/.git/logs/refs/stash", repo_directory);
+    path_join(path, sizeof(path), common_directory, "/logs/refs/stash");
 
     int file_desc = open(path, O_RDONLY);
     if(file_desc < 0) return 0;
@@ -681,10 +1163,10 @@ git_read_stash_count(const char *repo_directory)
 }
 
 internal B32
-git_read_branch_fast(const char *repo_directory, char *branch_output, U64 branch_capacity)
+git_read_branch_fast(const char *git_directory, char *branch_output, U64 branch_capacity)
 {
     char head_path[512];
-    snprintf(head_path, sizeof(head_path), "%s/.git/HEAD", repo_directory);
+    path_join(head_path, sizeof(head_path), git_directory, "/HEAD");
 
     int file_desc = open(head_path, O_RDONLY);
     if(file_desc < 0) return false;
@@ -721,1188 +1203,6542 @@ git_read_branch_fast(const char *repo_directory, char *branch_output, U64 branch
     return false;
 }
 
-//~ State Cache
+//~ Cache Records
+//
+// Record layouts held in the shared state table below. Cached_State is the
+// PERSIST fields of STATE_FIELDS (state_schema.h).
+
+#define STATE_MEMBER_STRING(member, capacity) char   member[capacity];
+#define STATE_MEMBER_S64(member, capacity)    S64    member;
+#define STATE_MEMBER_F64(member, capacity)    double member;
+#define STATE_MEMBER_B32(member, capacity)    B32    member;
+
+#define STATE_SIZE_STRING(capacity) + (capacity)
+#define STATE_SIZE_S64(capacity)    + sizeof(S64)
+#define STATE_SIZE_F64(capacity)    + sizeof(double)
+#define STATE_SIZE_B32(capacity)    + sizeof(B32)
+
+#define STATE_IF_PERSIST(...) __VA_ARGS__
+#define STATE_IF_TRANSIENT(...)
 
-#define CACHE_PATH_PREFIX "/dev/shm/statusline-cache."
-#define CLEANUP_INTERVAL_S 300
+#define CACHED_STATE_MEMBER(target, member, scope, name, kind, capacity, persist, merge) \
+    STATE_IF_##persist(STATE_MEMBER_##kind(member, capacity))
+#define CACHED_STATE_SIZE(target, member, scope, name, kind, capacity, persist, merge) \
+    STATE_IF_##persist(STATE_SIZE_##kind(capacity))
 
 typedef struct __attribute__((packed)) Cached_State Cached_State;
 struct __attribute__((packed)) Cached_State
 {
-    S64    used_percent;
-    S64    context_size;
-    double cost_usd;
-    S64    lines_added;
-    S64    lines_removed;
-    S64    duration_ms;
-    S64    last_update_sec;
-    char   working_directory[256];
-    char   model[64];
+    S64 last_update_sec;
+    STATE_FIELDS(CACHED_STATE_MEMBER)
 };
 
-internal int
-get_grandparent_pid(void)
-{
-    pid_t parent_pid = getppid();
+_Static_assert(sizeof(Cached_State) == sizeof(S64) STATE_FIELDS(CACHED_STATE_SIZE),
+               "Cached_State must hold exactly the PERSIST fields");
+
+// Rules resolve_state relies on
+#define STATE_IS_STRING_STRING 1
+#define STATE_IS_STRING_S64    0
+#define STATE_IS_STRING_F64    0
+#define STATE_IS_STRING_B32    0
+#define STATE_IS_PERSISTED_PERSIST   1
+#define STATE_IS_PERSISTED_TRANSIENT 0
+#define STATE_FIELD_CHECK(target, member, scope, name, kind, capacity, persist, merge)               \
+    _Static_assert(STATE_IS_STRING_##kind ? (capacity) > 1 && (capacity) <= 512 : (capacity) == 0,   \
+                   #target ": only strings have a capacity");                                      \
+    _Static_assert(!STATE_IS_STRING_##kind || STATE_MERGE_##merge != STATE_MERGE_MAX,               \
+                   #target ": strings can't merge by MAX");                                        \
+    _Static_assert(STATE_IS_PERSISTED_##persist || STATE_MERGE_##merge == STATE_MERGE_LATEST,       \
+                   #target ": transient fields have nothing to merge with");
+STATE_FIELDS(STATE_FIELD_CHECK)
 
-    char path[32];
-    snprintf(path, sizeof(path), "/proc/%d/status", parent_pid);
+typedef struct __attribute__((packed)) Usage_Cache Usage_Cache;
+struct __attribute__((packed)) Usage_Cache
+{
+    S64    fetch_time_sec;
+    double five_hour_pct;
+    double seven_day_pct;
+};
 
-    int file_desc = open(path, O_RDONLY);
-    if(file_desc < 0) return parent_pid;
+typedef struct __attribute__((packed)) Git_Cache Git_Cache;
+struct __attribute__((packed)) Git_Cache
+{
+    S64  index_mtime_sec;
+    S64  index_mtime_nsec;
+    U32  modified;
+    U32  staged;
+    U32  ahead;
+    U32  behind;
+    S64  watched_until_sec;  // git watcher lease: trusted regardless of age until then
+    S64  refresh_until_milliseconds;  // a background refresh is running until then
+    char branch[64];
+    char repo_path[256];
+};
 
-    char buffer[1024];
-    ssize_t bytes_read = read(file_desc, buffer, sizeof(buffer) - 1);
-    close(file_desc);
-    if(bytes_read <= 0) return parent_pid;
-    buffer[bytes_read] = '\0';
+// Memoized git_repo_discover result for one directory (is_repo false
+// remembers "not in a repo"), trusted while the directory's identity and
+// mtime are unchanged
+typedef struct __attribute__((packed)) Git_Discovery_Cache Git_Discovery_Cache;
+struct __attribute__((packed)) Git_Discovery_Cache
+{
+    U64      directory_device;
+    U64      directory_inode;
+    S64      directory_mtime_sec;
+    S64      directory_mtime_nsec;
+    B32      is_repo;
+    char     directory[256];
+    Git_Repo repo;
+};
 
-    const char *needle = "PPid:\t";
-    char *cursor = strstr(buffer, needle);
-    if(cursor == NULL) return parent_pid;
+//~ Shared State Table
+//
+// Every cache record lives in one MAP_SHARED region per user,
+// /dev/shm/statusline-<uid>/state-v<version>.table (directory 0700, file
+// 0600), so a warm render reads its state with plain loads instead of
+// open/read/fstat/close per file.
+// The table is open-addressed on 64-bit FNV-1a keys (session by name,
+// session alias by Claude's pid, repo and directory by path) with linear
+// probing over a bounded window; full windows evict their least recently
+// written slot.
+//
+// Each slot is a seqlock: a writer claims the slot's writer word (its pid and
+// when it took it, in one CAS), makes the sequence odd, updates, and bumps it
+// even again; readers copy the slot and retry if the sequence moved, so a
+// torn record is never observed. A writer that died, or has held the slot
+// past STATE_TABLE_LOCK_TIMEOUT_MS (its pid may since have been reused), is
+// taken over, and the slot cleared if it was left odd.
+//
+// The file is built complete (header with magic, version, length and CRC)
+// in an O_TMPFILE and linked into place, so nobody maps a half-made table;
+// a header that fails validation gets the file replaced. Every slot also
+// carries a CRC of its contents that readers check after the copy. The
+// layout version is part of the file name, so builds with different
+// layouts never share a table.
+
+#define STATE_TABLE_VERSION        8
+#define STATE_TABLE_MAGIC          0x31545353u  // "SST1"
+#define STATE_TABLE_SLOTS          512          // power of two
+#define STATE_TABLE_PROBES         16
+#define STATE_TABLE_READ_RETRIES   64
+#define STATE_TABLE_LOCK_RETRIES   256
+#define STATE_TABLE_LOCK_TIMEOUT_MS 1000  // writers hold a slot for microseconds
+#define STATE_TABLE_RETRY_MS       5000  // resident processes, after a failed map
+
+#define STATE_KEY_EMPTY            0
+#define STATE_KEY_TOMBSTONE        1
+
+enum State_Slot_Kind
+{
+    STATE_SLOT_NONE,
+    STATE_SLOT_SESSION,
+    STATE_SLOT_REPO,
+    STATE_SLOT_DIRECTORY,
+    STATE_SLOT_SESSION_ALIAS,
+};
 
-    cursor += 6;  // strlen("PPid:\t")
-    return (int)strtol(cursor, NULL, 10);
-}
+// A session_id, or "pid-<n>"; see Session Identity
+#define SESSION_NAME_CAPACITY 64
 
-internal void
-get_cache_path(char *output, U64 output_capacity)
+typedef struct State_Session_Record State_Session_Record;
+struct State_Session_Record
 {
-    int grandparent_pid = get_grandparent_pid();
-    snprintf(output, output_capacity, "%s%d", CACHE_PATH_PREFIX, grandparent_pid);
-}
+    B32          has_state;
+    B32          has_usage;
+    Cached_State state;
+    Usage_Cache  usage;
+};
 
-internal B32
-read_cached_state(Cached_State *state)
+// The session a Claude pid rendered last, keyed by the pid
+typedef struct State_Session_Alias State_Session_Alias;
+struct State_Session_Alias
 {
-    char path[64];
-    get_cache_path(path, sizeof(path));
-
-    int file_desc = open(path, O_RDONLY);
-    if(file_desc < 0) return false;
+    S32  grandparent_pid;
+    char name[SESSION_NAME_CAPACITY];
+};
 
-    ssize_t bytes_read = read(file_desc, state, sizeof(Cached_State));
-    close(file_desc);
-    return bytes_read == sizeof(Cached_State);
-}
+_Static_assert(sizeof(State_Session_Record) <= sizeof(Git_Discovery_Cache),
+               "session state must not grow the table's slots");
 
-internal void
-write_cached_state(const Cached_State *state)
+typedef struct State_Table_Slot State_Table_Slot;
+struct __attribute__((aligned(64))) State_Table_Slot
 {
-    char path[64];
-    get_cache_path(path, sizeof(path));
+    U64 writer;                // pid << 32 | monotonic ms when taken; 0 while free
+    U32 sequence;              // seqlock: odd while a writer is inside
+    U32 checksum;              // CRC-32 of everything from `kind` on
+    U32 kind;
+    U64 key;                   // STATE_KEY_EMPTY ends a probe chain
+    S64 written_milliseconds;
+    union
+    {
+        State_Session_Record session;
+        State_Session_Alias  alias;
+        Git_Cache            git;
+        Git_Discovery_Cache  discovery;
+    };
+};
 
-    int file_desc = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
-    if(file_desc < 0) return;
+typedef struct State_Table_Header State_Table_Header;
+struct State_Table_Header
+{
+    U32 magic;
+    U32 version;
+    U64 length;                // whole file
+    U32 slot_count;
+    U32 slot_size;
+    U32 checksum;              // CRC-32 of the fields above
+    U8  reserved[36];
+};
 
-    write(file_desc, state, sizeof(Cached_State));
-    close(file_desc);
-}
+// Which per-session files a Claude process owns; see Session File Reaping
+#define OWNED_REGISTRY_SLOTS   256          // power of two
+#define OWNED_REGISTRY_PROBES  16
+#define OWNED_PID_BUSY         (-1)         // being claimed or reaped
 
-//~ Usage Quota Cache
+enum Owned_File
+{
+    OWNED_SESSION_SLOT  = 1 << 0,
+    OWNED_TIMING_RING   = 1 << 1,
+    OWNED_DEBUG_LOG     = 1 << 2,
+    OWNED_SESSION_ALIAS = 1 << 3,
+};
 
-#define USAGE_CACHE_TTL_S 60
-#define USAGE_CACHE_PREFIX "/dev/shm/statusline-usage."
+typedef struct Owned_Entry Owned_Entry;
+struct Owned_Entry
+{
+    S32  pid;                  // owner (Claude); 0 if free
+    U32  files;                // Owned_File bits
+    U64  start_ticks;          // owner's start time; 0 if it was already gone
+    U64  session_key;
+    char session_name[SESSION_NAME_CAPACITY];
+};
 
-typedef struct __attribute__((packed)) Usage_Cache Usage_Cache;
-struct __attribute__((packed)) Usage_Cache
+typedef struct Owned_Registry Owned_Registry;
+struct Owned_Registry
 {
-    S64    fetch_time_sec;
-    double five_hour_pct;
-    double seven_day_pct;
+    S64         next_reap_sec;
+    U32         legacy_swept;  // pre-registry files cleaned up once
+    U32         reserved;
+    Owned_Entry entries[OWNED_REGISTRY_SLOTS];
 };
 
-internal void
-get_usage_cache_path(int gppid, char *output, U64 output_capacity)
+typedef struct State_Table State_Table;
+struct State_Table
 {
-    snprintf(output, output_capacity, "%s%d", USAGE_CACHE_PREFIX, gppid);
-}
+    State_Table_Header header;
+    State_Table_Slot   slots[STATE_TABLE_SLOTS];
+    Owned_Registry     registry;
+};
 
-// Extract a JSON string value for a given key from raw JSON text.
-// Returns pointer into json, sets *length. Key must include quotes and colon.
-internal const char *
-json_extract_string(const char *json, const char *key, U64 *length)
+internal State_Table *state_table;
+internal U64          state_table_retry_us;   // set while a failed map holds off retries
+internal B32          state_table_resident;   // --server/--watch retry; a render gives up
+
+internal U64
+hash64(U64 hash, const void *data, U64 size)
 {
-    *length = 0;
-    const char *found = strstr(json, key);
-    if(!found) return NULL;
-    const char *cursor = found + strlen(key);
-    while(*cursor == ' ' || *cursor == '\t') cursor++;
-    if(*cursor != '"') return NULL;
-    cursor++;
-    const char *start = cursor;
-    while(*cursor && *cursor != '"') cursor++;
-    *length = (U64)(cursor - start);
-    return start;
+    for(U64 index = 0; index < size; index++)
+    {
+        hash ^= (U64)((const U8 *)data)[index];
+        hash *= 1099511628211ull;
+    }
+    return hash;
 }
 
-// Extract a double value for key like "utilization": 0.39
-internal double
-json_extract_f64(const char *json, const char *key)
+internal U64
+state_key_finish(U64 hash)
 {
-    const char *found = strstr(json, key);
-    if(!found) return 0.0;
-    const char *cursor = found + strlen(key);
-    while(*cursor == ' ' || *cursor == '\t' || *cursor == ':') cursor++;
-    return strtod(cursor, NULL);
+    return hash > STATE_KEY_TOMBSTONE ? hash : hash + 2;
 }
 
-// Find the start of a JSON object for a given key, e.g. "five_hour": {
-internal const char *
-json_find_object(const char *json, const char *key)
+internal U64
+state_key_for_session(const char *session_name)
 {
-    const char *found = strstr(json, key);
-    if(!found) return NULL;
-    const char *cursor = found + strlen(key);
-    while(*cursor && *cursor != '{') cursor++;
-    return *cursor == '{' ? cursor : NULL;
+    return state_key_finish(hash64(hash64(14695981039346656037ull, "session", 7), session_name, strlen(session_name)));
 }
 
-internal void
-refresh_usage_cache(int gppid)
+internal U64
+state_key_for_session_alias(int grandparent_pid)
 {
-    pid_t first_fork = fork();
-    if(first_fork < 0) return;
-    if(first_fork > 0) { waitpid(first_fork, NULL, 0); return; }
-
-    // Middle child — fork grandchild and exit
-    if(fork() != 0) _exit(0);
-
-    // Grandchild: read credentials, curl, parse, write cache
-
-    // Read ~/.claude/.credentials.json
-    const char *home = getenv("HOME");
-    if(!home) _exit(1);
-
-    char cred_path[512];
-    snprintf(cred_path, sizeof(cred_path),
-             "%s/.claude/.credentials.json", home);
-
-    int cred_fd = open(cred_path, O_RDONLY);
-    if(cred_fd < 0) _exit(1);
-
-    char cred_buf[4096];
-    ssize_t cred_len = read(cred_fd, cred_buf, sizeof(cred_buf) - 1);
-    close(cred_fd);
-    if(cred_len <= 0) _exit(1);
-    cred_buf[cred_len] = '\0';
-
-    // Find claudeAiOauth object, then extract accessToken
-    const char *oauth_obj = json_find_object(cred_buf,
-                                             "\"claudeAiOauth\"");
-    if(!oauth_obj) _exit(1);
-
-    U64 token_len;
-    const char *token = json_extract_string(oauth_obj,
-                                            "\"accessToken\":",
-                                            &token_len);
-    if(!token || token_len == 0) _exit(1);
-
-    // Build Authorization header
-    char auth_header[2048];
-    int auth_len = snprintf(auth_header, sizeof(auth_header),
-                            "Authorization: Bearer %.*s",
-                            (int)token_len, token);
-    if(auth_len <= 0 || auth_len >= (int)sizeof(auth_header))
-        _exit(1);
+    S32 pid = grandparent_pid;
+    return state_key_finish(hash64(hash64(14695981039346656037ull, "alias", 5), &pid, sizeof(pid)));
+}
 
-    // Fork/exec curl
-    int pipe_fds[2];
-    if(pipe(pipe_fds) != 0) _exit(1);
+internal U64
+state_key_for_repo(const char *repo_path)
+{
+    return state_key_finish(hash64(hash64(14695981039346656037ull, "repo", 4), repo_path, strlen(repo_path)));
+}
 
-    pid_t curl_pid = fork();
-    if(curl_pid < 0) _exit(1);
+internal U64
+state_key_for_directory(const char *directory)
+{
+    return state_key_finish(hash64(hash64(14695981039346656037ull, "directory", 9), directory, strlen(directory)));
+}
 
-    if(curl_pid == 0)
-    {
-        close(pipe_fds[0]);
-        dup2(pipe_fds[1], STDOUT_FILENO);
-        int dev_null = open("/dev/null", O_WRONLY);
-        if(dev_null >= 0)
-        {
-            dup2(dev_null, STDERR_FILENO);
-            close(dev_null);
-        }
-        close(pipe_fds[1]);
+internal U32
+state_table_header_checksum(const State_Table_Header *header)
+{
+    return (U32)crc32(0, (const Bytef *)header, offsetof(State_Table_Header, checksum));
+}
 
-        char *argv[] = {
-            "curl", "-s", "--max-time", "10",
-            "-H", auth_header,
-            "-H", "anthropic-beta: oauth-2025-04-20",
-            "https://api.anthropic.com/api/oauth/usage",
-            NULL
-        };
-        execvp("curl", argv);
-        _exit(127);
-    }
+internal U32
+state_slot_checksum(const State_Table_Slot *slot)
+{
+    return (U32)crc32(0, (const Bytef *)&slot->kind, sizeof(State_Table_Slot) - offsetof(State_Table_Slot, kind));
+}
 
-    close(pipe_fds[1]);
+internal B32
+state_table_header_valid(const void *mapping)
+{
+    const State_Table_Header *header = mapping;
+    return header->magic == STATE_TABLE_MAGIC && header->version == STATE_TABLE_VERSION &&
+           header->length == sizeof(State_Table) && header->slot_count == STATE_TABLE_SLOTS &&
+           header->slot_size == sizeof(State_Table_Slot) &&
+           header->checksum == state_table_header_checksum(header);
+}
 
-    char response[8192];
-    int total_read = 0;
-    for(;;)
+// Per-user directory for shared state: created 0700, and only trusted if it
+// is a real directory owned by us with no group/other access. An absolute
+// STATUSLINE_STATE_DIR replaces it (the benchmark's scratch directory).
+internal int
+state_directory_open(void)
+{
+    char default_path[64];
+    const char *path = getenv("STATUSLINE_STATE_DIR");
+    if(path == NULL || path[0] != '/')
     {
-        int remaining = (int)sizeof(response) - total_read - 1;
-        if(remaining <= 0) break;
-        ssize_t n = read(pipe_fds[0], response + total_read, remaining);
-        if(n <= 0) break;
-        total_read += (int)n;
+        string_number(default_path, sizeof(default_path), "/dev/shm/statusline-", getuid(), "");
+        path = default_path;
     }
-    close(pipe_fds[0]);
-    waitpid(curl_pid, NULL, 0);
-    response[total_read] = '\0';
-
-    // Parse: find five_hour and seven_day objects, extract utilization
-    double five_hour_pct = 0.0;
-    double seven_day_pct = 0.0;
-
-    const char *five_hour_obj = json_find_object(response,
-                                                  "\"five_hour\"");
-    if(five_hour_obj)
-        five_hour_pct = json_extract_f64(five_hour_obj,
-                                          "\"utilization\"");
-
-    const char *seven_day_obj = json_find_object(response,
-                                                  "\"seven_day\"");
-    if(seven_day_obj)
-        seven_day_pct = json_extract_f64(seven_day_obj,
-                                          "\"utilization\"");
-
-    // Write cache
-    Usage_Cache cache;
-    cache.fetch_time_sec = (S64)time(NULL);
-    cache.five_hour_pct  = five_hour_pct;
-    cache.seven_day_pct  = seven_day_pct;
+    mkdir(path, 0700);
 
-    char cache_path[64];
-    get_usage_cache_path(gppid, cache_path, sizeof(cache_path));
-
-    int cache_fd = open(cache_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
-    if(cache_fd >= 0)
+    int directory_fd = open(path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if(directory_fd < 0) return -1;
+    struct stat directory_stat;
+    if(fstat(directory_fd, &directory_stat) != 0 || directory_stat.st_uid != getuid() ||
+       (directory_stat.st_mode & 077) != 0)
     {
-        write(cache_fd, &cache, sizeof(cache));
-        close(cache_fd);
+        close(directory_fd);
+        return -1;
     }
-    _exit(0);
+    return directory_fd;
 }
 
-internal Usage_Cache
-read_usage_cache(int gppid)
+// Build a complete file off to the side and link it in under `name`: the
+// first header_size bytes are `header`, the rest of `length` is zeroes.
+// Losing the race to another process (EEXIST) is fine: theirs is as good.
+internal void
+shared_file_create(int directory_fd, const char *name, const void *header, U64 header_size, U64 length)
 {
-    Usage_Cache cache;
-    memset(&cache, 0, sizeof(cache));
-
-    char cache_path[64];
-    get_usage_cache_path(gppid, cache_path, sizeof(cache_path));
-
-    int fd = open(cache_path, O_RDONLY);
-    if(fd < 0)
+    int file_desc = openat(directory_fd, ".", O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    char temporary_name[128] = "";
+    if(file_desc < 0)
     {
-        // No cache — trigger background fetch, return zeros
-        refresh_usage_cache(gppid);
-        return cache;
+        // No O_TMPFILE: a private name, hard-linked into place below
+        String_Builder temporary = string_builder(temporary_name, sizeof(temporary_name));
+        string_append_cstring(&temporary, name);
+        string_append_char(&temporary, '.');
+        string_append_s64(&temporary, getpid());
+        file_desc = openat(directory_fd, temporary_name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if(file_desc < 0) return;
     }
 
-    ssize_t n = read(fd, &cache, sizeof(cache));
-    close(fd);
-    if(n != sizeof(cache))
+    if(ftruncate(file_desc, (off_t)length) == 0 &&
+       pwrite(file_desc, header, header_size, 0) == (ssize_t)header_size)
     {
-        memset(&cache, 0, sizeof(cache));
-        refresh_usage_cache(gppid);
-        return cache;
+        if(temporary_name[0])
+            linkat(directory_fd, temporary_name, directory_fd, name, 0);
+        else
+        {
+            char fd_path[32];
+            string_number(fd_path, sizeof(fd_path), "/proc/self/fd/", file_desc, "");
+            linkat(AT_FDCWD, fd_path, directory_fd, name, AT_SYMLINK_FOLLOW);
+        }
     }
+    if(temporary_name[0]) unlinkat(directory_fd, temporary_name, 0);
+    close(file_desc);
+}
 
-    // Check TTL
-    S64 now = (S64)time(NULL);
-    if(now - cache.fetch_time_sec > USAGE_CACHE_TTL_S)
+// Map `name` read-write and shared, creating it from `header` if needed. A
+// file with the wrong owner or size, or whose header fails `header_valid`,
+// is replaced; processes that still have the old file mapped keep using it
+// until they exit.
+internal void *
+shared_file_map(int directory_fd, const char *name, const void *header, U64 header_size, U64 length,
+                B32 (*header_valid)(const void *mapping))
+{
+    for(int attempt = 0; attempt < 2; attempt++)
     {
-        // Stale — return stale data, refresh in background
-        refresh_usage_cache(gppid);
-    }
+        int file_desc = openat(directory_fd, name, O_RDWR | O_NOFOLLOW | O_CLOEXEC);
+        if(file_desc < 0 && errno == ENOENT)
+        {
+            shared_file_create(directory_fd, name, header, header_size, length);
+            file_desc = openat(directory_fd, name, O_RDWR | O_NOFOLLOW | O_CLOEXEC);
+        }
+        if(file_desc < 0) return NULL;
 
-    return cache;
+        struct stat file_stat;
+        void *mapping = MAP_FAILED;
+        if(fstat(file_desc, &file_stat) == 0 && file_stat.st_uid == getuid() &&
+           file_stat.st_size == (off_t)length)
+            mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, file_desc, 0);
+        close(file_desc);
+
+        if(mapping != MAP_FAILED && header_valid(mapping)) return mapping;
+        if(mapping != MAP_FAILED) munmap(mapping, length);
+        unlinkat(directory_fd, name, 0);
+    }
+    return NULL;
 }
 
-//~ Cache Cleanup
+// Map the table on first use, creating it if needed. A render that fails
+// once does without for the rest of its run; resident processes try again
+// after STATE_TABLE_RETRY_MS.
+internal State_Table *
+state_table_get(void)
+{
+    if(state_table) return state_table;
+    U64 now_us = time_microseconds();
+    if(state_table_retry_us && (!state_table_resident || now_us < state_table_retry_us)) return NULL;
+    state_table_retry_us = now_us + STATE_TABLE_RETRY_MS * 1000;
+
+    int directory_fd = state_directory_open();
+    if(directory_fd < 0) return NULL;
+
+    char name[32];
+    string_number(name, sizeof(name), "state-v", STATE_TABLE_VERSION, ".table");
+
+    State_Table_Header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = STATE_TABLE_MAGIC;
+    header.version = STATE_TABLE_VERSION;
+    header.length = sizeof(State_Table);
+    header.slot_count = STATE_TABLE_SLOTS;
+    header.slot_size = sizeof(State_Table_Slot);
+    header.checksum = state_table_header_checksum(&header);
+
+    State_Table *table = shared_file_map(directory_fd, name, &header, sizeof(header), sizeof(State_Table),
+                                         state_table_header_valid);
+    close(directory_fd);
+    if(table == NULL) return NULL;
+
+    state_table = table;
+    state_table_retry_us = 0;
+    return state_table;
+}
 
-internal void
-cleanup_stale_caches(void)
+internal B32
+state_slot_copy(const State_Table_Slot *slot, State_Table_Slot *out)
 {
-    struct stat stat_info;
-    S64 now_milliseconds = time_milliseconds_realtime();
-    if(stat("/dev/shm/statusline-cleanup", &stat_info) == 0)
+    for(int attempt = 0; attempt < STATE_TABLE_READ_RETRIES; attempt++)
     {
-        S64 last_seconds = (S64)stat_info.st_mtim.tv_sec;
-        if(now_milliseconds / 1000 - last_seconds < CLEANUP_INTERVAL_S) return;
+        U32 begin = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        if(begin & 1) { sched_yield(); continue; }
+        memcpy(out, slot, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == begin)
+            return out->checksum == state_slot_checksum(out);
     }
+    return false;
+}
 
-    int sentinel_file_desc = open("/dev/shm/statusline-cleanup", O_WRONLY | O_CREAT | O_TRUNC, 0666);
-    if(sentinel_file_desc >= 0) close(sentinel_file_desc);
+enum State_Lock_Result
+{
+    STATE_LOCK_FAILED,
+    STATE_LOCK_HELD,
+    STATE_LOCK_RECOVERED,      // previous writer died mid-update: contents are suspect
+};
 
-    DIR *shared_memory_dir = opendir("/dev/shm");
-    if(shared_memory_dir == NULL) return;
+internal U32
+state_slot_lock_clock(void)
+{
+    return (U32)(time_microseconds() / 1000);
+}
 
-    struct dirent *entry;
-    while((entry = readdir(shared_memory_dir)) != NULL)
+internal enum State_Lock_Result
+state_slot_lock(State_Table_Slot *slot)
+{
+    U64 pid = (U64)(U32)getpid();
+    for(int attempt = 0; attempt < STATE_TABLE_LOCK_RETRIES; attempt++)
     {
-        int pid = 0;
-        if(strncmp(entry->d_name, "statusline-cache.", 17) == 0)
-            pid = (int)strtol(entry->d_name + 17, NULL, 10);
-        else if(strncmp(entry->d_name, "statusline-usage.", 17) == 0)
-            pid = (int)strtol(entry->d_name + 17, NULL, 10);
-        else
+        U64 writer = __atomic_load_n(&slot->writer, __ATOMIC_RELAXED);
+        if(writer != 0)
+        {
+            // Held: wait, unless the holder died or has held it for too long
+            S32 writer_pid = (S32)(writer >> 32);
+            U32 held_milliseconds = state_slot_lock_clock() - (U32)writer;
+            if(held_milliseconds <= STATE_TABLE_LOCK_TIMEOUT_MS &&
+               (kill(writer_pid, 0) == 0 || errno != ESRCH))
+            {
+                sched_yield();
+                continue;
+            }
+        }
+        if(!__atomic_compare_exchange_n(&slot->writer, &writer, pid << 32 | state_slot_lock_clock(), false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
             continue;
 
-        if(pid <= 0) continue;
-        if(kill(pid, 0) == 0) continue;
-
-        char remove_path[300];
-        snprintf(remove_path, sizeof(remove_path), "/dev/shm/%s", entry->d_name);
-        unlink(remove_path);
+        // Odd here means the previous writer died mid-update; keep it odd
+        U32 sequence = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+        __atomic_store_n(&slot->sequence, sequence + ((sequence & 1) ? 2 : 1), __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        return (sequence & 1) ? STATE_LOCK_RECOVERED : STATE_LOCK_HELD;
     }
-    closedir(shared_memory_dir);
+    return STATE_LOCK_FAILED;
+}
 
-    uid_t uid = getuid();
-    char log_directory[64];
-    snprintf(log_directory, sizeof(log_directory), "/tmp/statusline-%d", uid);
+internal void
+state_slot_unlock(State_Table_Slot *slot)
+{
+    // Taken over after STATE_TABLE_LOCK_TIMEOUT_MS: the slot is no longer ours
+    if((S32)(__atomic_load_n(&slot->writer, __ATOMIC_RELAXED) >> 32) != (S32)getpid()) return;
+    __atomic_add_fetch(&slot->sequence, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&slot->writer, 0, __ATOMIC_RELEASE);
+}
 
-    DIR *log_dir_handle = opendir(log_directory);
-    if(log_dir_handle == NULL) return;
+// Consistent copy of the slot holding `key`
+internal B32
+state_table_read(U64 key, State_Table_Slot *out)
+{
+    State_Table *table = state_table_get();
+    if(table == NULL) return false;
 
-    while((entry = readdir(log_dir_handle)) != NULL)
+    for(U32 probe = 0; probe < STATE_TABLE_PROBES; probe++)
     {
-        U64 name_length = strlen(entry->d_name);
-        if(name_length < 5 || strcmp(entry->d_name + name_length - 4, ".log") != 0)
-            continue;
-
-        char pid_string[32];
-        U64 copy_length = Min(name_length - 4, sizeof(pid_string) - 1);
-        memcpy(pid_string, entry->d_name, copy_length);
-        pid_string[copy_length] = '\0';
+        const State_Table_Slot *slot = &table->slots[(key + probe) & (STATE_TABLE_SLOTS - 1)];
+        U64 slot_key = __atomic_load_n(&slot->key, __ATOMIC_RELAXED);
+        if(slot_key == STATE_KEY_EMPTY) return false;
+        if(slot_key != key) continue;
 
-        int log_pid = (int)strtol(pid_string, NULL, 10);
-        if(log_pid <= 0) continue;
-        if(kill(log_pid, 0) == 0) continue;
-
-        char remove_path[96];
-        snprintf(remove_path, sizeof(remove_path), "%s/%s", log_directory, entry->d_name);
-        unlink(remove_path);
+        if(!state_slot_copy(slot, out)) return false;
+        if(out->key == key) return true;
     }
-    closedir(log_dir_handle);
+    return false;
 }
 
-//~ Git Status Cache
-
-typedef struct __attribute__((packed)) Git_Cache Git_Cache;
-struct __attribute__((packed)) Git_Cache
+internal void
+state_slot_reset(State_Table_Slot *slot, U64 key, enum State_Slot_Kind kind)
 {
-    S64  index_mtime_sec;
-    S64  index_mtime_nsec;
-    U32  modified;
-    U32  staged;
-    U32  ahead;
-    U32  behind;
-    char branch[64];
-    char repo_path[256];
-};
-
-#define GIT_CACHE_TTL_MS 5000
+    memset((U8 *)slot + offsetof(State_Table_Slot, kind), 0,
+           sizeof(State_Table_Slot) - offsetof(State_Table_Slot, kind));
+    slot->kind = kind;
+    __atomic_store_n(&slot->key, key, __ATOMIC_RELAXED);
+}
 
-internal U32
-hash_path(const char *path)
+// Locked slot for `key`, claimed (and cleared) if the key wasn't present or
+// its record doesn't check out. Returns NULL if the table is unavailable or
+// contended; caches are best-effort, so callers just skip the write. Pair
+// with state_table_end_write.
+internal State_Table_Slot *
+state_table_begin_write(U64 key, enum State_Slot_Kind kind)
 {
-    U32 hash = 2166136261u;
-    for(const char *cursor = path; *cursor; cursor++)
+    State_Table *table = state_table_get();
+    if(table == NULL) return NULL;
+
+    State_Table_Slot *candidate = NULL;
+    State_Table_Slot *oldest = NULL;
+    for(U32 probe = 0; probe < STATE_TABLE_PROBES; probe++)
     {
-        hash ^= (U32)(unsigned char)*cursor;
-        hash *= 16777619u;
+        State_Table_Slot *slot = &table->slots[(key + probe) & (STATE_TABLE_SLOTS - 1)];
+        U64 slot_key = __atomic_load_n(&slot->key, __ATOMIC_RELAXED);
+        if(slot_key == key) { candidate = slot; break; }
+        if(slot_key == STATE_KEY_EMPTY) { if(candidate == NULL) candidate = slot; break; }
+        if(slot_key == STATE_KEY_TOMBSTONE) { if(candidate == NULL) candidate = slot; continue; }
+        if(oldest == NULL || slot->written_milliseconds < oldest->written_milliseconds) oldest = slot;
     }
-    return hash;
+    if(candidate == NULL) candidate = oldest;
+    if(candidate == NULL) return NULL;
+
+    // The key may have moved in or out since the unlocked probe; either way
+    // the slot ends up ours
+    enum State_Lock_Result lock = state_slot_lock(candidate);
+    if(lock == STATE_LOCK_FAILED) return NULL;
+    if(lock == STATE_LOCK_RECOVERED || candidate->key != key || candidate->kind != kind ||
+       candidate->checksum != state_slot_checksum(candidate))
+        state_slot_reset(candidate, key, kind);
+    return candidate;
 }
 
 internal void
-get_git_cache_path(const char *repo_path, char *output, U64 output_capacity)
+state_table_end_write(State_Table_Slot *slot)
 {
-    U32 path_hash = hash_path(repo_path);
-    snprintf(output, output_capacity, "/dev/shm/claude-git-%08x", path_hash);
+    slot->written_milliseconds = time_milliseconds_realtime();
+    slot->checksum = state_slot_checksum(slot);
+    state_slot_unlock(slot);
 }
 
-internal enum Cache_State
-read_git_cache(const char *repo_path, Git_Cache *cache)
+// For bookkeeping that doesn't make the record any fresher (a lease): its
+// age, which the caches judge staleness by, stays as it was
+internal void
+state_table_end_write_keeping_age(State_Table_Slot *slot)
 {
-    char cache_path[64];
-    get_git_cache_path(repo_path, cache_path, sizeof(cache_path));
-
-    int file_desc = open(cache_path, O_RDONLY);
-    if(file_desc < 0) return CACHE_NONE;
+    slot->checksum = state_slot_checksum(slot);
+    state_slot_unlock(slot);
+}
 
-    ssize_t bytes_read = read(file_desc, cache, sizeof(Git_Cache));
-    if(bytes_read != sizeof(Git_Cache)) { close(file_desc); return CACHE_NONE; }
+//~ Process Spawning
+//
+// Every child goes through posix_spawn, which glibc runs as
+// clone(CLONE_VM|CLONE_VFORK): the child borrows our address space until it
+// execs, so there are no page tables to copy and the parent is held only
+// for the exec. A detached child gets a session of its own
+// (POSIX_SPAWN_SETSID) instead of a double fork; once we exit it belongs to
+// init, and the long-lived server reaps the ones it spawned from its accept
+// loop.
+
+// Run argv[0] (searched on PATH) in `directory` (NULL: ours) with stdout on
+// `stdout_fd` (-1: /dev/null) and stderr on /dev/null; detached children
+// also get stdin on /dev/null. Pipe ends the child shouldn't keep must be
+// O_CLOEXEC. Returns the pid, or -1.
+internal pid_t
+spawn_process(char *const argv[], const char *directory, int stdout_fd, B32 detached)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attributes;
+    if(posix_spawn_file_actions_init(&actions) != 0) return -1;
+    if(posix_spawnattr_init(&attributes) != 0) { posix_spawn_file_actions_destroy(&actions); return -1; }
+
+    if(detached) posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    if(stdout_fd >= 0) posix_spawn_file_actions_adddup2(&actions, stdout_fd, STDOUT_FILENO);
+    else posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    if(directory) posix_spawn_file_actions_addchdir_np(&actions, directory);
+
+    // Neither an inherited SIG_IGN on SIGCHLD nor the server's on SIGPIPE
+    // should reach git or curl
+    sigset_t default_signals;
+    sigemptyset(&default_signals);
+    sigaddset(&default_signals, SIGCHLD);
+    sigaddset(&default_signals, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attributes, &default_signals);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGDEF | (detached ? POSIX_SPAWN_SETSID : 0));
+
+    pid_t child_pid;
+    int result = posix_spawnp(&child_pid, argv[0], &actions, &attributes, argv, environ);
+    posix_spawnattr_destroy(&attributes);
+    posix_spawn_file_actions_destroy(&actions);
+    return result == 0 ? child_pid : -1;
+}
 
-    if(strncmp(cache->repo_path, repo_path, sizeof(cache->repo_path)) != 0)
+// Everything `child_pid` writes to the pipe, up to `capacity` bytes; then
+// waits for it. Returns the byte count.
+internal U64
+spawn_read_output(pid_t child_pid, int read_fd, char *buffer, U64 capacity)
+{
+    U64 total_bytes_read = 0;
+    while(total_bytes_read < capacity)
     {
-        close(file_desc);
-        return CACHE_NONE;
+        ssize_t bytes_read = read(read_fd, buffer + total_bytes_read, capacity - total_bytes_read);
+        if(bytes_read < 0 && errno == EINTR) continue;
+        if(bytes_read <= 0) break;
+        total_bytes_read += (U64)bytes_read;
     }
+    close(read_fd);
+    waitpid(child_pid, NULL, 0);
+    return total_bytes_read;
+}
 
-    struct stat cache_stat;
-    if(fstat(file_desc, &cache_stat) != 0) { close(file_desc); return CACHE_STALE; }
-    close(file_desc);
-
-    S64 cache_age_milliseconds = time_milliseconds_realtime() -
-        ((S64)cache_stat.st_mtim.tv_sec * 1000 + (S64)cache_stat.st_mtim.tv_nsec / 1000000);
-    if(cache_age_milliseconds > GIT_CACHE_TTL_MS) return CACHE_STALE;
+//~ Resident Processes
+//
+// Shared plumbing for the per-user background processes (--server, --watch):
+// socket placement, detached spawning, and noticing a replaced executable.
 
-    char index_path[512];
-    snprintf(index_path, sizeof(index_path), "%s/.git/index", repo_path);
-    struct stat index_stat;
-    if(stat(index_path, &index_stat) != 0) return CACHE_STALE;
+internal B32
+runtime_socket_path(const char *runtime_name, const char *fallback_name,
+                    char *output, U64 output_capacity)
+{
+    const char *runtime_directory = getenv("XDG_RUNTIME_DIR");
+    String_Builder path = string_builder(output, output_capacity);
+    if(runtime_directory && runtime_directory[0])
+    {
+        string_append_cstring(&path, runtime_directory);
+        string_append_char(&path, '/');
+        string_append_cstring(&path, runtime_name);
+    }
+    else
+    {
+        char directory_path[64];
+        string_number(directory_path, sizeof(directory_path), "/tmp/statusline-", getuid(), "");
+        mkdir(directory_path, 0700);
+        string_append_cstring(&path, directory_path);
+        string_append_char(&path, '/');
+        string_append_cstring(&path, fallback_name);
+    }
+    return path.length > 0 && path.length < output_capacity;
+}
+
+// Start `<self> <mode_flag> [argument]` detached (see spawn_process), so
+// it never holds Claude's stdout pipe open
+internal void
+spawn_detached_self(const char *mode_flag, const char *argument)
+{
+    char exe_path[512];
+    ssize_t exe_length = readlink("/proc/self/exe", exe_path, sizeof(exe_path) - 1);
+    if(exe_length <= 0) return;
+    exe_path[exe_length] = '\0';
+
+    char *argv[] = {exe_path, (char *)mode_flag, (char *)argument, NULL};
+    spawn_process(argv, NULL, -1, true);
+}
+
+internal B32
+executable_changed(const char *exe_path, const struct stat *original)
+{
+    struct stat current;
+    if(stat(exe_path, &current) != 0) return true;
+    return current.st_ino != original->st_ino || current.st_dev != original->st_dev ||
+           current.st_mtim.tv_sec != original->st_mtim.tv_sec ||
+           current.st_mtim.tv_nsec != original->st_mtim.tv_nsec;
+}
+
+//~ State Cache
+
+// Parent of an arbitrary pid, via /proc/<pid>/status. Falls back to pid itself.
+internal int
+get_parent_pid_of(pid_t parent_pid)
+{
+    char path[32];
+    string_number(path, sizeof(path), "/proc/", parent_pid, "/status");
+
+    int file_desc = open(path, O_RDONLY);
+    if(file_desc < 0) return parent_pid;
+
+    char buffer[1024];
+    ssize_t bytes_read = read(file_desc, buffer, sizeof(buffer) - 1);
+    close(file_desc);
+    if(bytes_read <= 0) return parent_pid;
+    buffer[bytes_read] = '\0';
+
+    const char *needle = "PPid:\t";
+    char *cursor = strstr(buffer, needle);
+    if(cursor == NULL) return parent_pid;
+
+    cursor += 6;  // strlen("PPid:\t")
+    return (int)strtol(cursor, NULL, 10);
+}
+
+//~ Session Identity
+//
+// A session is named by the payload's session_id when it has a usable one,
+// else "pid-<n>" after Claude's pid: our grandparent, which costs a /proc
+// read and is the wrapper instead whenever Claude runs us through one. The
+// name keys the session record and names the timing ring and debug log;
+// it's resolved once per render and passed down.
+//
+// A prefetch runs before the payload, and a render may get none, so both
+// only have the pid; the alias record for that pid says which session it
+// rendered last.
+
+typedef struct Session_Identity Session_Identity;
+struct Session_Identity
+{
+    U64  key;                  // of the session record
+    int  parent_pid;           // the shell Claude ran us from
+    int  grandparent_pid;      // Claude; 0 until something needed it
+    B32  from_payload;         // named by session_id
+    char name[SESSION_NAME_CAPACITY];
+};
+
+// Names end up in file names: letters, digits, '-' and '_' only
+internal B32
+session_name_valid(const char *name, U64 length)
+{
+    if(length == 0 || length >= SESSION_NAME_CAPACITY) return false;
+    for(U64 index = 0; index < length; index++)
+    {
+        char c = name[index];
+        if(!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_'))
+            return false;
+    }
+    return true;
+}
+
+internal void
+session_identity_name(Session_Identity *identity, const char *name, U64 length)
+{
+    memcpy(identity->name, name, length);
+    identity->name[length] = '\0';
+    identity->key = state_key_for_session(identity->name);
+}
+
+// Without a session_id: the session Claude's pid rendered last, else the
+// pid's own
+internal void
+session_identity_for_pid(int parent_pid, int grandparent_pid, Session_Identity *identity)
+{
+    identity->parent_pid = parent_pid;
+    identity->grandparent_pid = grandparent_pid;
+
+    State_Table_Slot slot;
+    U64 length;
+    if(state_table_read(state_key_for_session_alias(grandparent_pid), &slot) &&
+       slot.kind == STATE_SLOT_SESSION_ALIAS && slot.alias.grandparent_pid == grandparent_pid &&
+       session_name_valid(slot.alias.name, length = strnlen(slot.alias.name, SESSION_NAME_CAPACITY)))
+    {
+        identity->from_payload = true;
+        session_identity_name(identity, slot.alias.name, length);
+        return;
+    }
+
+    char name[24];
+    U64 name_length = string_number(name, sizeof(name), "pid-", grandparent_pid, "");
+    identity->from_payload = false;
+    session_identity_name(identity, name, name_length);
+}
+
+// `grandparent_pid` is Claude's pid if the caller already has it, else 0;
+// it's only looked up when the payload has no usable session_id
+internal void
+session_identity_resolve(const Json_Parsed_Fields *fields, int parent_pid, int grandparent_pid,
+                         Session_Identity *identity)
+{
+    if(fields && session_name_valid(fields->session_id.data, fields->session_id.length))
+    {
+        identity->parent_pid = parent_pid;
+        identity->grandparent_pid = grandparent_pid;
+        identity->from_payload = true;
+        session_identity_name(identity, fields->session_id.data, fields->session_id.length);
+    }
+    else
+        session_identity_for_pid(parent_pid, grandparent_pid ? grandparent_pid : get_parent_pid_of(parent_pid),
+                                 identity);
+}
+
+internal int
+session_claude_pid(Session_Identity *identity)
+{
+    if(identity->grandparent_pid == 0) identity->grandparent_pid = get_parent_pid_of(identity->parent_pid);
+    return identity->grandparent_pid;
+}
+
+// Point Claude's pid at a payload-named session for later prefetches. Only
+// when the pid is already known (a prefetch looked it up): a render never
+// reads /proc just for this. Returns whether the alias is in place.
+internal B32
+session_alias_note(const Session_Identity *identity)
+{
+    if(!identity->from_payload || identity->grandparent_pid == 0) return false;
+
+    U64 key = state_key_for_session_alias(identity->grandparent_pid);
+    State_Table_Slot slot;
+    if(state_table_read(key, &slot) && slot.kind == STATE_SLOT_SESSION_ALIAS &&
+       strncmp(slot.alias.name, identity->name, SESSION_NAME_CAPACITY) == 0)
+        return true;
+
+    State_Table_Slot *record = state_table_begin_write(key, STATE_SLOT_SESSION_ALIAS);
+    if(record == NULL) return false;
+    record->alias.grandparent_pid = identity->grandparent_pid;
+    memcpy(record->alias.name, identity->name, SESSION_NAME_CAPACITY);
+    state_table_end_write(record);
+    return true;
+}
+
+internal B32
+read_cached_state(const Session_Identity *identity, Cached_State *state)
+{
+    State_Table_Slot slot;
+    if(!state_table_read(identity->key, &slot) || slot.kind != STATE_SLOT_SESSION || !slot.session.has_state)
+        return false;
+    *state = slot.session.state;
+    return true;
+}
+
+internal void
+write_cached_state(const Session_Identity *identity, const Cached_State *state)
+{
+    State_Table_Slot *slot = state_table_begin_write(identity->key, STATE_SLOT_SESSION);
+    if(slot == NULL) return;
+    slot->session.state = *state;
+    slot->session.has_state = true;
+    state_table_end_write(slot);
+}
+
+//~ Usage Quota Cache
+
+#define USAGE_CACHE_TTL_S 60
+
+// Extract a JSON string value for a given key from raw JSON text.
+// Returns pointer into json, sets *length. Key must include quotes and colon.
+internal const char *
+json_extract_string(const char *json, const char *key, U64 *length)
+{
+    *length = 0;
+    const char *found = strstr(json, key);
+    if(!found) return NULL;
+    const char *cursor = found + strlen(key);
+    while(*cursor == ' ' || *cursor == '\t') cursor++;
+    if(*cursor != '"') return NULL;
+    cursor++;
+    const char *start = cursor;
+    while(*cursor && *cursor != '"') cursor++;
+    *length = (U64)(cursor - start);
+    return start;
+}
+
+// Extract a double value for key like "utilization": 0.39
+internal double
+json_extract_f64(const char *json, const char *key)
+{
+    const char *found = strstr(json, key);
+    if(!found) return 0.0;
+    const char *cursor = found + strlen(key);
+    while(*cursor == ' ' || *cursor == '\t' || *cursor == ':') cursor++;
+    return strtod(cursor, NULL);
+}
+
+// Find the start of a JSON object for a given key, e.g. "five_hour": {
+internal const char *
+json_find_object(const char *json, const char *key)
+{
+    const char *found = strstr(json, key);
+    if(!found) return NULL;
+    const char *cursor = found + strlen(key);
+    while(*cursor && *cursor != '{') cursor++;
+    return *cursor == '{' ? cursor : NULL;
+}
+
+// `statusline --refresh-usage <session>`: fetch the quota with curl and
+// store it in the session's record
+internal int
+usage_refresh_main(const char *session_name)
+{
+    if(session_name == NULL || !session_name_valid(session_name, strlen(session_name))) return 2;
+    Session_Identity identity;
+    memset(&identity, 0, sizeof(identity));
+    session_identity_name(&identity, session_name, strlen(session_name));
+
+    // Read ~/.claude/.credentials.json
+    const char *home = getenv("HOME");
+    if(!home) return 1;
+
+    char cred_path[512];
+    snprintf(cred_path, sizeof(cred_path),
+             "%s/.claude/.credentials.json", home);
+
+    int cred_fd = open(cred_path, O_RDONLY);
+    if(cred_fd < 0) return 1;
+
+    char cred_buf[4096];
+    ssize_t cred_len = read(cred_fd, cred_buf, sizeof(cred_buf) - 1);
+    close(cred_fd);
+    if(cred_len <= 0) return 1;
+    cred_buf[cred_len] = '\0';
+
+    // Find claudeAiOauth object, then extract accessToken
+    const char *oauth_obj = json_find_object(cred_buf,
+                                             "\"claudeAiOauth\"");
+    if(!oauth_obj) return 1;
+
+    U64 token_len;
+    const char *token = json_extract_string(oauth_obj,
+                                            "\"accessToken\":",
+                                            &token_len);
+    if(!token || token_len == 0) return 1;
+
+    // Build Authorization header
+    char auth_header[2048];
+    int auth_len = snprintf(auth_header, sizeof(auth_header),
+                            "Authorization: Bearer %.*s",
+                            (int)token_len, token);
+    if(auth_len <= 0 || auth_len >= (int)sizeof(auth_header))
+        return 1;
+
+    // Spawn curl
+    int pipe_fds[2];
+    if(pipe2(pipe_fds, O_CLOEXEC) != 0) return 1;
+
+    char *argv[] = {
+        "curl", "-s", "--max-time", "10",
+        "-H", auth_header,
+        "-H", "anthropic-beta: oauth-2025-04-20",
+        "https://api.anthropic.com/api/oauth/usage",
+        NULL
+    };
+    pid_t curl_pid = spawn_process(argv, NULL, pipe_fds[1], false);
+    close(pipe_fds[1]);
+    if(curl_pid < 0) { close(pipe_fds[0]); return 1; }
+
+    char response[8192];
+    U64 total_read = spawn_read_output(curl_pid, pipe_fds[0], response, sizeof(response) - 1);
+    response[total_read] = '\0';
+
+    // Parse: find five_hour and seven_day objects, extract utilization
+    double five_hour_pct = 0.0;
+    double seven_day_pct = 0.0;
+
+    const char *five_hour_obj = json_find_object(response,
+                                                  "\"five_hour\"");
+    if(five_hour_obj)
+        five_hour_pct = json_extract_f64(five_hour_obj,
+                                          "\"utilization\"");
+
+    const char *seven_day_obj = json_find_object(response,
+                                                  "\"seven_day\"");
+    if(seven_day_obj)
+        seven_day_pct = json_extract_f64(seven_day_obj,
+                                          "\"utilization\"");
+
+    // Write cache
+    State_Table_Slot *slot = state_table_begin_write(identity.key, STATE_SLOT_SESSION);
+    if(slot)
+    {
+        slot->session.usage.fetch_time_sec = (S64)time(NULL);
+        slot->session.usage.five_hour_pct  = five_hour_pct;
+        slot->session.usage.seven_day_pct  = seven_day_pct;
+        slot->session.has_usage = true;
+        state_table_end_write(slot);
+    }
+    return 0;
+}
+
+// Started detached, so a render never waits on the network
+internal void
+refresh_usage_cache(const Session_Identity *identity)
+{
+    spawn_detached_self("--refresh-usage", identity->name);
+}
+
+internal Usage_Cache
+read_usage_cache(const Session_Identity *identity)
+{
+    Usage_Cache cache;
+    memset(&cache, 0, sizeof(cache));
+
+    State_Table_Slot slot;
+    if(!state_table_read(identity->key, &slot) || slot.kind != STATE_SLOT_SESSION || !slot.session.has_usage)
+    {
+        // No cache — trigger background fetch, return zeros
+        refresh_usage_cache(identity);
+        return cache;
+    }
+    cache = slot.session.usage;
+
+    // Check TTL
+    if((S64)time(NULL) - cache.fetch_time_sec > USAGE_CACHE_TTL_S)
+    {
+        // Stale — return stale data, refresh in background
+        refresh_usage_cache(identity);
+    }
+
+    return cache;
+}
+
+//~ Session File Reaping
+//
+// A session leaves behind its slot in the state table (and its pid's alias
+// slot), its timing ring and its debug log. Renders note them, after their
+// output is written, in the registry at the end of the table against the
+// owning Claude process's pid and start time, and every REAP_INTERVAL_S one
+// of them hands the registry to a detached `statusline --reap`; no render
+// removes anything itself. An owner is gone once /proc has no such pid, or
+// the pid now belongs to a process that started at another time, so a
+// reused pid can't keep a dead session's files alive. (A pidfd only pins a
+// process one already holds, and nobody holds Claude's between renders.)
+// A session resumed by a new Claude process keeps its files while its
+// record is still being written.
+
+#define REAP_INTERVAL_S 300
+
+// Start time of `pid` in clock ticks since boot (field 22 of
+// /proc/<pid>/stat), or 0 if it's gone or a zombie
+internal U64
+process_start_ticks(int pid)
+{
+    char path[32];
+    string_number(path, sizeof(path), "/proc/", pid, "/stat");
+
+    int file_desc = open(path, O_RDONLY | O_CLOEXEC);
+    if(file_desc < 0) return 0;
+
+    char buffer[1024];
+    ssize_t bytes_read = read(file_desc, buffer, sizeof(buffer) - 1);
+    close(file_desc);
+    if(bytes_read <= 0) return 0;
+    buffer[bytes_read] = '\0';
+
+    // comm (field 2) may hold spaces and parens; the rest follows its last ')'
+    char *cursor = strrchr(buffer, ')');
+    if(cursor == NULL || cursor[1] != ' ' || cursor[2] == 'Z') return 0;
+    for(int field = 2; field < 22 && cursor; field++) cursor = strchr(cursor + 1, ' ');
+    return cursor ? strtoull(cursor + 1, NULL, 10) : 0;
+}
+
+internal U32
+owned_registry_home(U64 session_key)
+{
+    return (U32)((session_key * 0x9e3779b97f4a7c15ull) >> 32) & (OWNED_REGISTRY_SLOTS - 1);
+}
+
+// Record that the session has `files`. A plain load when they're already
+// noted; the first note per session reads the owner's start time (and its
+// pid, if nothing has yet). A full probe window drops the note.
+internal void
+owned_files_note(Session_Identity *identity, U32 files)
+{
+    State_Table *table = state_table_get();
+    if(table == NULL) return;
+
+    Owned_Entry *free_entry = NULL;
+    U32 home = owned_registry_home(identity->key);
+    for(U32 probe = 0; probe < OWNED_REGISTRY_PROBES; probe++)
+    {
+        Owned_Entry *entry = &table->registry.entries[(home + probe) & (OWNED_REGISTRY_SLOTS - 1)];
+        S32 entry_pid = __atomic_load_n(&entry->pid, __ATOMIC_ACQUIRE);
+        if(entry_pid > 0 && entry->session_key == identity->key)
+        {
+            if((__atomic_load_n(&entry->files, __ATOMIC_RELAXED) & files) != files)
+                __atomic_fetch_or(&entry->files, files, __ATOMIC_RELEASE);
+            return;
+        }
+        if(entry_pid == 0 && free_entry == NULL) free_entry = entry;
+    }
+    if(free_entry == NULL) return;
+
+    // Filled in while marked busy, so the reaper never sees a half-made entry
+    int owner_pid = session_claude_pid(identity);
+    U64 start_ticks = process_start_ticks(owner_pid);
+    S32 expected = 0;
+    if(owner_pid <= 0 ||
+       !__atomic_compare_exchange_n(&free_entry->pid, &expected, OWNED_PID_BUSY, false,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return;
+    free_entry->start_ticks = start_ticks;
+    free_entry->session_key = identity->key;
+    memcpy(free_entry->session_name, identity->name, SESSION_NAME_CAPACITY);
+    __atomic_store_n(&free_entry->files, files, __ATOMIC_RELAXED);
+    __atomic_store_n(&free_entry->pid, owner_pid, __ATOMIC_RELEASE);
+}
+
+// Start a reaper when the interval has passed; the first caller past the
+// deadline wins. Renders call this after writing their output.
+internal void
+reap_if_due(void)
+{
+    State_Table *table = state_table_get();
+    if(table == NULL) return;
+
+    S64 now = (S64)time(NULL);
+    S64 due = __atomic_load_n(&table->registry.next_reap_sec, __ATOMIC_RELAXED);
+    if(now < due) return;
+    if(!__atomic_compare_exchange_n(&table->registry.next_reap_sec, &due, now + REAP_INTERVAL_S, false,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        return;
+    spawn_detached_self("--reap", NULL);
+}
+
+// Whether the session record was written within the last REAP_INTERVAL_S
+internal B32
+session_recently_written(U64 session_key)
+{
+    State_Table_Slot slot;
+    return state_table_read(session_key, &slot) && slot.kind == STATE_SLOT_SESSION &&
+           time_milliseconds_realtime() - slot.written_milliseconds < REAP_INTERVAL_S * 1000;
+}
+
+// Tombstone the slot holding `key` if it is still of `kind`
+internal void
+reap_state_slot(U64 key, enum State_Slot_Kind kind)
+{
+    State_Table *table = state_table_get();
+    for(U32 probe = 0; table && probe < STATE_TABLE_PROBES; probe++)
+    {
+        State_Table_Slot *slot = &table->slots[(key + probe) & (STATE_TABLE_SLOTS - 1)];
+        U64 slot_key = __atomic_load_n(&slot->key, __ATOMIC_RELAXED);
+        if(slot_key == STATE_KEY_EMPTY) break;
+        if(slot_key != key) continue;
+        if(state_slot_lock(slot) == STATE_LOCK_FAILED) break;
+        if(slot->key == key && slot->kind == kind)
+        {
+            __atomic_store_n(&slot->key, STATE_KEY_TOMBSTONE, __ATOMIC_RELAXED);
+            slot->kind = STATE_SLOT_NONE;
+        }
+        state_slot_unlock(slot);
+        break;
+    }
+}
+
+internal void
+reap_session_files(const Owned_Entry *entry, int owner_pid, U32 files)
+{
+    char name[SESSION_NAME_CAPACITY];
+    memcpy(name, entry->session_name, sizeof(name));
+    name[sizeof(name) - 1] = '\0';
+    if(!session_name_valid(name, strlen(name))) return;
+
+    if(files & OWNED_SESSION_SLOT) reap_state_slot(entry->session_key, STATE_SLOT_SESSION);
+    if(files & OWNED_SESSION_ALIAS) reap_state_slot(state_key_for_session_alias(owner_pid), STATE_SLOT_SESSION_ALIAS);
+
+    if(files & OWNED_TIMING_RING)
+    {
+        int directory_fd = state_directory_open();
+        if(directory_fd >= 0)
+        {
+            char ring_name[SESSION_NAME_CAPACITY + 16];
+            snprintf(ring_name, sizeof(ring_name), "timing-%s.ring", name);
+            unlinkat(directory_fd, ring_name, 0);
+            close(directory_fd);
+        }
+    }
+
+    if(files & OWNED_DEBUG_LOG)
+    {
+        char log_path[SESSION_NAME_CAPACITY + 48];
+        snprintf(log_path, sizeof(log_path), "/tmp/statusline-%d/%s.log", getuid(), name);
+        unlink(log_path);
+    }
+}
+
+// The pid a pre-registry file name starts with when the rest is exactly
+// `suffix` ("timing-123.ring" style), else 0
+internal int
+legacy_name_pid(const char *name, const char *suffix)
+{
+    char *end;
+    long pid = strtol(name, &end, 10);
+    return end != name && *name >= '0' && *name <= '9' && strcmp(end, suffix) == 0 && pid < INT_MAX ?
+           (int)pid : 0;
+}
+
+// Files from before the registry, found by name and checked with kill(pid, 0):
+// the Odin build's per-session files in /dev/shm, timing rings and logs
+// named by bare pid, and the old cleanup sentinel. Runs once per table.
+internal void
+reap_legacy_files(void)
+{
+    struct dirent *entry;
+
+    char state_directory[64];
+    snprintf(state_directory, sizeof(state_directory), "/dev/shm/statusline-%d", getuid());
+    DIR *state_dir_handle = opendir(state_directory);
+    while(state_dir_handle && (entry = readdir(state_dir_handle)) != NULL)
+    {
+        int pid = 0;
+        if(strncmp(entry->d_name, "timing-", 7) == 0)
+        {
+            pid = legacy_name_pid(entry->d_name + 7, ".ring");
+            if(pid <= 0) continue;
+        }
+        else if(strcmp(entry->d_name, "cleanup") != 0)
+            continue;
+        if(pid > 0 && (kill(pid, 0) == 0 || errno != ESRCH)) continue;
+
+        char remove_path[320];
+        snprintf(remove_path, sizeof(remove_path), "%s/%s", state_directory, entry->d_name);
+        unlink(remove_path);
+    }
+    if(state_dir_handle) closedir(state_dir_handle);
+
+    DIR *shared_memory_dir = opendir("/dev/shm");
+    while(shared_memory_dir && (entry = readdir(shared_memory_dir)) != NULL)
+    {
+        // The old per-repo caches (claude-git-%08x) and the 0666 cleanup
+        // sentinel sat in /dev/shm itself: remove ours, leave anyone else's
+        B32 shared_name = strcmp(entry->d_name, "statusline-cleanup") == 0 ||
+                          (strncmp(entry->d_name, "claude-git-", 11) == 0 && strlen(entry->d_name) == 19 &&
+                           strspn(entry->d_name + 11, "0123456789abcdef") == 8);
+        if(shared_name)
+        {
+            struct stat file_stat;
+            int shared_memory_fd = dirfd(shared_memory_dir);
+            if(fstatat(shared_memory_fd, entry->d_name, &file_stat, AT_SYMLINK_NOFOLLOW) == 0 &&
+               file_stat.st_uid == getuid())
+                unlinkat(shared_memory_fd, entry->d_name, 0);
+            continue;
+        }
+
+        int pid = 0;
+        if(strncmp(entry->d_name, "statusline-cache.", 17) == 0)
+            pid = (int)strtol(entry->d_name + 17, NULL, 10);
+        else if(strncmp(entry->d_name, "statusline-usage.", 17) == 0)
+            pid = (int)strtol(entry->d_name + 17, NULL, 10);
+        else
+            continue;
+
+        if(pid <= 0) continue;
+        if(kill(pid, 0) == 0) continue;
+
+        char remove_path[300];
+        snprintf(remove_path, sizeof(remove_path), "/dev/shm/%s", entry->d_name);
+        unlink(remove_path);
+    }
+    if(shared_memory_dir) closedir(shared_memory_dir);
+
+    char log_directory[64];
+    snprintf(log_directory, sizeof(log_directory), "/tmp/statusline-%d", getuid());
+    DIR *log_dir_handle = opendir(log_directory);
+    while(log_dir_handle && (entry = readdir(log_dir_handle)) != NULL)
+    {
+        int log_pid = legacy_name_pid(entry->d_name, ".log");
+        if(log_pid <= 0) continue;
+        if(kill(log_pid, 0) == 0) continue;
+
+        char remove_path[320];
+        snprintf(remove_path, sizeof(remove_path), "%s/%s", log_directory, entry->d_name);
+        unlink(remove_path);
+    }
+    if(log_dir_handle) closedir(log_dir_handle);
+}
+
+// `statusline --reap`: one pass over the registry, then exit
+internal int
+reaper_main(void)
+{
+    State_Table *table = state_table_get();
+    if(table == NULL) return 1;
+
+    for(U32 index = 0; index < OWNED_REGISTRY_SLOTS; index++)
+    {
+        Owned_Entry *entry = &table->registry.entries[index];
+        S32 pid = __atomic_load_n(&entry->pid, __ATOMIC_ACQUIRE);
+        if(pid <= 0) continue;
+        U64 start_ticks = entry->start_ticks;
+        if(start_ticks != 0 && process_start_ticks(pid) == start_ticks) continue;
+        if(session_recently_written(entry->session_key)) continue;
+
+        if(!__atomic_compare_exchange_n(&entry->pid, &pid, OWNED_PID_BUSY, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            continue;
+        reap_session_files(entry, pid, __atomic_load_n(&entry->files, __ATOMIC_RELAXED));
+        entry->start_ticks = 0;
+        entry->session_key = 0;
+        __atomic_store_n(&entry->files, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&entry->pid, 0, __ATOMIC_RELEASE);
+    }
+
+    U32 swept = 0;
+    if(__atomic_compare_exchange_n(&table->registry.legacy_swept, &swept, 1, false,
+                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        reap_legacy_files();
+    return 0;
+}
+
+//~ Git Repo Discovery
+//
+// Resolves a directory to its repo the way git does: walk up to the nearest
+// .git, follow a `gitdir:` file (linked worktrees, submodules), then the git
+// directory's `commondir`. The answer, "not a repo" included, is memoized in
+// the state table per directory and trusted while the directory's device,
+// inode and mtime are unchanged, so a warm render pays one stat instead of a
+// walk. GIT_DISCOVERY_TTL_MS bounds how long a repo created above the
+// directory goes unnoticed.
+
+#define GIT_DISCOVERY_TTL_MS 30000
+
+// Read a one-line path file ("gitdir: <path>", or a bare path with an empty
+// prefix) and resolve it against base_directory
+internal B32
+git_read_path_file(const char *file_path, const char *prefix, const char *base_directory,
+                   char *output, U64 output_capacity)
+{
+    int file_desc = open(file_path, O_RDONLY | O_CLOEXEC);
+    if(file_desc < 0) return false;
+    char buffer[512];
+    ssize_t bytes_read = read(file_desc, buffer, sizeof(buffer) - 1);
+    close(file_desc);
+    if(bytes_read <= 0) return false;
+    buffer[bytes_read] = '\0';
+    while(bytes_read > 0 && (buffer[bytes_read-1] == '\n' || buffer[bytes_read-1] == '\r' || buffer[bytes_read-1] == ' '))
+        buffer[--bytes_read] = '\0';
+
+    U64 prefix_length = strlen(prefix);
+    if(strncmp(buffer, prefix, prefix_length) != 0 || buffer[prefix_length] == '\0') return false;
+    const char *target = buffer + prefix_length;
+
+    char joined[1024];
+    String_Builder joined_path = string_builder(joined, sizeof(joined));
+    if(target[0] != '/')
+    {
+        string_append_cstring(&joined_path, base_directory);
+        string_append_char(&joined_path, '/');
+    }
+    string_append_cstring(&joined_path, target);
+
+    char resolved[PATH_MAX];
+    if(realpath(joined, resolved) == NULL) return false;
+    U64 length = strlen(resolved);
+    if(length >= output_capacity) return false;
+    memcpy(output, resolved, length + 1);
+    return true;
+}
+
+// Fill in git_directory/common_directory for a worktree whose .git entry is
+// `dotgit` (a directory, or a file pointing elsewhere)
+internal B32
+git_repo_resolve(const char *dotgit, B32 dotgit_is_file, Git_Repo *repo)
+{
+    if(dotgit_is_file)
+    {
+        if(!git_read_path_file(dotgit, "gitdir: ", repo->worktree, repo->git_directory, sizeof(repo->git_directory)))
+            return false;
+    }
+    else
+    {
+        U64 length = strlen(dotgit);
+        if(length >= sizeof(repo->git_directory)) return false;
+        memcpy(repo->git_directory, dotgit, length + 1);
+    }
+
+    // A directory without HEAD is not a repo; git keeps looking above it
+    char path[600];
+    path_join(path, sizeof(path), repo->git_directory, "/HEAD");
+    if(access(path, F_OK) != 0) return false;
+
+    path_join(path, sizeof(path), repo->git_directory, "/commondir");
+    if(!git_read_path_file(path, "", repo->git_directory, repo->common_directory, sizeof(repo->common_directory)))
+        memcpy(repo->common_directory, repo->git_directory, sizeof(repo->common_directory));
+    return true;
+}
+
+// Uncached upward walk from an absolute directory
+internal B32
+git_repo_locate(const char *directory, Git_Repo *repo)
+{
+    U64 length = strlen(directory);
+    if(directory[0] != '/' || length >= sizeof(repo->worktree)) return false;
+
+    char path[sizeof(repo->worktree) + 8];
+    memcpy(path, directory, length + 1);
+    while(length > 1 && path[length-1] == '/') path[--length] = '\0';
+
+    for(;;)
+    {
+        // The root's .git is "/.git", not "//.git"
+        U64 base_length = length == 1 ? 0 : length;
+        memcpy(path + base_length, "/.git", 6);
+
+        struct stat dotgit_stat;
+        if(stat(path, &dotgit_stat) == 0 && (S_ISDIR(dotgit_stat.st_mode) || S_ISREG(dotgit_stat.st_mode)))
+        {
+            memcpy(repo->worktree, path, length);
+            repo->worktree[length] = '\0';
+            if(git_repo_resolve(path, S_ISREG(dotgit_stat.st_mode), repo)) return true;
+        }
+
+        if(length <= 1) return false;
+        path[base_length] = '\0';
+        const char *slash = memrchr(path, '/', length);
+        length = slash == path ? 1 : (U64)(slash - path);
+        path[length] = '\0';
+    }
+}
+
+internal B32
+git_repo_discover(const char *directory, Git_Repo *repo)
+{
+    struct stat directory_stat;
+    if(stat(directory, &directory_stat) != 0 || !S_ISDIR(directory_stat.st_mode)) return false;
+
+    U64 key = state_key_for_directory(directory);
+    State_Table_Slot slot;
+    if(state_table_read(key, &slot) && slot.kind == STATE_SLOT_DIRECTORY)
+    {
+        const Git_Discovery_Cache *cache = &slot.discovery;
+        if(strncmp(cache->directory, directory, sizeof(cache->directory)) == 0 &&
+           cache->directory_device == (U64)directory_stat.st_dev &&
+           cache->directory_inode == (U64)directory_stat.st_ino &&
+           cache->directory_mtime_sec == (S64)directory_stat.st_mtim.tv_sec &&
+           cache->directory_mtime_nsec == (S64)directory_stat.st_mtim.tv_nsec &&
+           time_milliseconds_realtime() - slot.written_milliseconds <= GIT_DISCOVERY_TTL_MS)
+        {
+            if(cache->is_repo) *repo = cache->repo;
+            return cache->is_repo;
+        }
+    }
+
+    B32 is_repo = git_repo_locate(directory, repo);
+
+    U64 directory_length = strlen(directory);
+    if(directory_length >= sizeof(slot.discovery.directory)) return is_repo;
+    State_Table_Slot *record = state_table_begin_write(key, STATE_SLOT_DIRECTORY);
+    if(record == NULL) return is_repo;
+
+    Git_Discovery_Cache *cache = &record->discovery;
+    memset(cache, 0, sizeof(*cache));
+    cache->directory_device = (U64)directory_stat.st_dev;
+    cache->directory_inode = (U64)directory_stat.st_ino;
+    cache->directory_mtime_sec = (S64)directory_stat.st_mtim.tv_sec;
+    cache->directory_mtime_nsec = (S64)directory_stat.st_mtim.tv_nsec;
+    cache->is_repo = is_repo;
+    memcpy(cache->directory, directory, directory_length + 1);
+    if(is_repo) cache->repo = *repo;
+    state_table_end_write(record);
+    return is_repo;
+}
+
+//~ Git Status Cache
+//
+// One record per repo. Background refreshes take a lease on it first, a
+// deadline in the record, so a stale repo gets one `git status` however
+// many sessions render it; the others keep showing the cached counts.
+// The refresh ends the lease once its counts are written; one that dies or
+// fails lets it run out, which also spaces out retries.
+
+#define GIT_CACHE_TTL_MS      5000
+#define GIT_REFRESH_LEASE_MS  10000
+
+internal B32
+git_index_matches(const Git_Repo *repo, const Git_Cache *cache)
+{
+    char index_path[512];
+    path_join(index_path, sizeof(index_path), repo->git_directory, "/index");
+    struct stat index_stat;
+    if(stat(index_path, &index_stat) != 0) return false;
+
+    return (S64)index_stat.st_mtim.tv_sec == cache->index_mtime_sec &&
+           (S64)index_stat.st_mtim.tv_nsec == cache->index_mtime_nsec;
+}
+
+internal enum Cache_State
+read_git_cache(const Git_Repo *repo, Git_Cache *cache)
+{
+    State_Table_Slot slot;
+    if(!state_table_read(state_key_for_repo(repo->worktree), &slot)) return CACHE_NONE;
+    *cache = slot.git;
+    if(strncmp(cache->repo_path, repo->worktree, sizeof(cache->repo_path)) != 0) return CACHE_NONE;
+
+    // The watcher republishes on every relevant inotify event, so while its
+    // lease holds neither the TTL nor the index mtime needs checking
+    S64 now_milliseconds = time_milliseconds_realtime();
+    if(cache->watched_until_sec * 1000 > now_milliseconds) return CACHE_VALID;
+
+    S64 cache_age_milliseconds = now_milliseconds - slot.written_milliseconds;
+    if(cache_age_milliseconds > GIT_CACHE_TTL_MS) return CACHE_STALE;
+
+    return git_index_matches(repo, cache) ? CACHE_VALID : CACHE_STALE;
+}
+
+internal void
+write_git_cache(const Git_Repo *repo, U32 modified, U32 staged, U32 ahead, U32 behind,
+                S64 watched_until_sec)
+{
+    char index_path[512];
+    path_join(index_path, sizeof(index_path), repo->git_directory, "/index");
+    struct stat index_stat;
+    if(stat(index_path, &index_stat) != 0) return;
+
+    State_Table_Slot *slot = state_table_begin_write(state_key_for_repo(repo->worktree), STATE_SLOT_REPO);
+    if(slot == NULL) return;
+
+    // Counts from a render mustn't end a running refresh's lease
+    Git_Cache *cache = &slot->git;
+    S64 refresh_until_milliseconds = cache->refresh_until_milliseconds;
+    memset(cache, 0, sizeof(*cache));
+    cache->refresh_until_milliseconds = refresh_until_milliseconds;
+    cache->index_mtime_sec = (S64)index_stat.st_mtim.tv_sec;
+    cache->index_mtime_nsec = (S64)index_stat.st_mtim.tv_nsec;
+    cache->modified = modified;
+    cache->staged = staged;
+    cache->ahead = ahead;
+    cache->behind = behind;
+    cache->watched_until_sec = watched_until_sec;
+    memcpy(cache->repo_path, repo->worktree, sizeof(cache->repo_path));
+    state_table_end_write(slot);
+}
+
+// Whether we now hold the repo's refresh lease
+internal B32
+git_refresh_lease_take(const Git_Repo *repo)
+{
+    State_Table_Slot *slot = state_table_begin_write(state_key_for_repo(repo->worktree), STATE_SLOT_REPO);
+    if(slot == NULL) return false;
+
+    S64 now_milliseconds = time_milliseconds_realtime();
+    B32 taken = slot->git.refresh_until_milliseconds <= now_milliseconds;
+    if(taken) slot->git.refresh_until_milliseconds = now_milliseconds + GIT_REFRESH_LEASE_MS;
+    state_table_end_write_keeping_age(slot);
+    return taken;
+}
+
+internal void
+git_refresh_lease_end(const Git_Repo *repo)
+{
+    State_Table_Slot *slot = state_table_begin_write(state_key_for_repo(repo->worktree), STATE_SLOT_REPO);
+    if(slot == NULL) return;
+    slot->git.refresh_until_milliseconds = 0;
+    state_table_end_write_keeping_age(slot);
+}
+
+//~ Git Status Subprocess
+//
+// The fallback when neither gitstatusd nor the index engine can answer:
+//
+//     git --no-optional-locks status --porcelain=v2 -z --branch --show-stash -uno
+//
+// Records are NUL-terminated and parsed as they arrive, a read at a time,
+// keeping only the head of the current record, so the counts are exact at
+// any size and git is never cut off mid-write. The records used:
+//
+//   # branch.oid <hex>|(initial)      # branch.upstream <ref>
+//   # branch.head <name>|(detached)   # branch.ab +<ahead> -<behind>
+//   # stash <count>
+//   1 <XY> ...      changed: X (index) and Y (worktree) are '.' if clean
+//   2 <XY> ...      renamed or copied; the next record is the old path
+//   u <XY> ...      unmerged: counted as both staged and modified, like
+//                   gitstatusd's conflicts
+//
+// --no-optional-locks keeps git from refreshing the index under
+// index.lock: this runs unattended from the watcher and background
+// refreshes, and must not make the user's git fail.
+
+// Longest record prefix kept: enough for any header line we use
+#define GIT_PORCELAIN_RECORD_CAPACITY 384
+
+typedef struct Git_Porcelain Git_Porcelain;
+struct Git_Porcelain
+{
+    U32  modified;
+    U32  staged;
+    U32  ahead;
+    U32  behind;
+    S64  stashes;
+    B32  has_head;            // saw "# branch.oid": the output was v2
+    B32  has_upstream;        // "# branch.ab" only comes with one
+    B32  detached;
+    char head[128];           // branch name unless detached
+
+    // Stream state
+    B32  skip_record;         // the next record is a rename's old path
+    U32  record_length;       // bytes seen of the current record (capped)
+    char record[GIT_PORCELAIN_RECORD_CAPACITY];
+};
+
+internal B32
+git_porcelain_header(const char *record, U32 length, const char *name, const char **value)
+{
+    U64 name_length = strlen(name);
+    if(length < name_length + 1 || memcmp(record, name, name_length) != 0 || record[name_length] != ' ')
+        return false;
+    *value = record + name_length + 1;
+    return true;
+}
+
+// One complete record, NUL-terminated in parser->record (truncated if long)
+internal void
+git_porcelain_record(Git_Porcelain *parser)
+{
+    const char *record = parser->record;
+    U32 length = Min(parser->record_length, GIT_PORCELAIN_RECORD_CAPACITY - 1);
+    if(parser->skip_record) { parser->skip_record = false; return; }
+    if(length < 4) return;
+
+    if(record[0] == '1' || record[0] == '2' || record[0] == 'u')
+    {
+        char index_status = record[2], worktree_status = record[3];
+        if(record[0] == 'u' || index_status != '.') parser->staged++;
+        if(record[0] == 'u' || worktree_status != '.') parser->modified++;
+        parser->skip_record = record[0] == '2';
+        return;
+    }
+    if(record[0] != '#') return;
+
+    const char *value;
+    if(git_porcelain_header(record, length, "# branch.oid", &value))
+        parser->has_head = true;
+    else if(git_porcelain_header(record, length, "# branch.head", &value))
+    {
+        parser->detached = strcmp(value, "(detached)") == 0;
+        if(!parser->detached)
+        {
+            U64 copy_length = Min(strlen(value), sizeof(parser->head) - 1);
+            memcpy(parser->head, value, copy_length);
+            parser->head[copy_length] = '\0';
+        }
+    }
+    else if(git_porcelain_header(record, length, "# branch.upstream", &value))
+        parser->has_upstream = true;
+    else if(git_porcelain_header(record, length, "# branch.ab", &value))
+    {
+        char *end = (char *)value;
+        if(*value == '+') parser->ahead = (U32)strtoul(value + 1, &end, 10);
+        while(*end == ' ') end++;
+        if(*end == '-') parser->behind = (U32)strtoul(end + 1, NULL, 10);
+    }
+    else if(git_porcelain_header(record, length, "# stash", &value))
+        parser->stashes = strtoll(value, NULL, 10);
+}
+
+internal void
+git_porcelain_feed(Git_Porcelain *parser, const char *data, U64 length)
+{
+    const char *end = data + length;
+    while(data < end)
+    {
+        const char *terminator = memchr(data, '\0', (U64)(end - data));
+        U64 chunk_length = (U64)((terminator ? terminator : end) - data);
+
+        U32 kept = Min(parser->record_length, GIT_PORCELAIN_RECORD_CAPACITY - 1);
+        U64 copy_length = Min(chunk_length, (U64)(GIT_PORCELAIN_RECORD_CAPACITY - 1 - kept));
+        memcpy(parser->record + kept, data, copy_length);
+        parser->record_length = kept + (U32)copy_length + (chunk_length > copy_length);
+        if(terminator == NULL) return;
+
+        parser->record[Min(parser->record_length, GIT_PORCELAIN_RECORD_CAPACITY - 1)] = '\0';
+        git_porcelain_record(parser);
+        parser->record_length = 0;
+        data = terminator + 1;
+    }
+}
+
+// Run git in repo_path and parse all of its output. Counts are zero unless
+// it succeeds.
+internal B32
+run_git_status(const char *repo_path, Git_Porcelain *status)
+{
+    memset(status, 0, sizeof(*status));
+
+    int pipe_fds[2];
+    if(pipe2(pipe_fds, O_CLOEXEC) != 0) return false;
+
+    char *argv[] = {"git", "--no-optional-locks", "status", "--porcelain=v2", "-z", "--branch",
+                    "--show-stash", "-uno", NULL};
+    pid_t child_pid = spawn_process(argv, repo_path, pipe_fds[1], false);
+    close(pipe_fds[1]);
+    if(child_pid < 0) { close(pipe_fds[0]); return false; }
+
+    char buffer[4096];
+    for(;;)
+    {
+        ssize_t bytes_read = read(pipe_fds[0], buffer, sizeof(buffer));
+        if(bytes_read < 0 && errno == EINTR) continue;
+        if(bytes_read <= 0) break;
+        git_porcelain_feed(status, buffer, (U64)bytes_read);
+    }
+    close(pipe_fds[0]);
+
+    // A child we couldn't wait for (ECHILD) didn't succeed
+    int wait_status = 0;
+    pid_t waited;
+    while((waited = waitpid(child_pid, &wait_status, 0)) < 0 && errno == EINTR) {}
+    if(waited != child_pid || !WIFEXITED(wait_status) || WEXITSTATUS(wait_status) != 0 || !status->has_head)
+    {
+        memset(status, 0, sizeof(*status));
+        return false;
+    }
+    return true;
+}
+
+//~ Gitstatusd Client
+//
+// Talks to the gitstatusd started by gitstatus-daemon.sh over its FIFO pair.
+// Requests are "<id>\x1f<dir>\x1f0\x1e" (0 = compute dirty counts); each
+// response is a record of \x1f-separated fields terminated by \x1e. The FIFOs
+// are shared by every statusline process, so the exchange runs under an
+// flock on gitstatusd.lock in our private state directory, and records
+// carrying another id (left behind by a client that hit its deadline) are
+// drained and skipped.
+
+#define GITSTATUSD_FIFO_PREFIX      "/tmp/gitstatus.CLAUDE_STATUSLINE."
+#define GITSTATUSD_FIELD_SEPARATOR  '\x1f'
+#define GITSTATUSD_RECORD_SEPARATOR '\x1e'
+#define GITSTATUSD_MISS_TIMEOUT_MS  250  // fallback is a synchronous git status
+#define GITSTATUSD_STALE_TIMEOUT_MS 30   // fallback is a background refresh
+
+// Response field indices (see gitstatus docs, VCS_STATUS_*)
+enum
+{
+    GITSTATUSD_FIELD_ID,
+    GITSTATUSD_FIELD_IS_REPO,
+    GITSTATUSD_FIELD_WORKDIR,
+    GITSTATUSD_FIELD_COMMIT,
+    GITSTATUSD_FIELD_LOCAL_BRANCH,
+    GITSTATUSD_FIELD_REMOTE_BRANCH,
+    GITSTATUSD_FIELD_REMOTE_NAME,
+    GITSTATUSD_FIELD_REMOTE_URL,
+    GITSTATUSD_FIELD_ACTION,
+    GITSTATUSD_FIELD_INDEX_SIZE,
+    GITSTATUSD_FIELD_NUM_STAGED,
+    GITSTATUSD_FIELD_NUM_UNSTAGED,
+    GITSTATUSD_FIELD_NUM_CONFLICTED,
+    GITSTATUSD_FIELD_NUM_UNTRACKED,
+    GITSTATUSD_FIELD_COMMITS_AHEAD,
+    GITSTATUSD_FIELD_COMMITS_BEHIND,
+    GITSTATUSD_FIELD_STASHES,
+    GITSTATUSD_FIELD_COUNT,
+};
+
+// Parse one response record. Returns true only for our id and a git repo.
+internal B32
+gitstatusd_parse_record(char *record, const char *request_id, Git_Status *status)
+{
+    char *fields[GITSTATUSD_FIELD_COUNT];
+    int field_count = 0;
+    char *cursor = record;
+    while(field_count < GITSTATUSD_FIELD_COUNT)
+    {
+        fields[field_count++] = cursor;
+        char *separator = strchr(cursor, GITSTATUSD_FIELD_SEPARATOR);
+        if(separator == NULL) break;
+        *separator = '\0';
+        cursor = separator + 1;
+    }
+
+    if(field_count < 2 || strcmp(fields[GITSTATUSD_FIELD_ID], request_id) != 0) return false;
+    if(strcmp(fields[GITSTATUSD_FIELD_IS_REPO], "1") != 0) return false;
+    if(field_count < GITSTATUSD_FIELD_COUNT) return false;
+
+    // Conflicts show as both staged and modified in porcelain output; keep
+    // the counts comparable with run_git_status.
+    U32 conflicted = (U32)strtoul(fields[GITSTATUSD_FIELD_NUM_CONFLICTED], NULL, 10);
+    status->staged   = (U32)strtoul(fields[GITSTATUSD_FIELD_NUM_STAGED], NULL, 10) + conflicted;
+    status->modified = (U32)strtoul(fields[GITSTATUSD_FIELD_NUM_UNSTAGED], NULL, 10) + conflicted;
+    status->ahead    = (U32)strtoul(fields[GITSTATUSD_FIELD_COMMITS_AHEAD], NULL, 10);
+    status->behind   = (U32)strtoul(fields[GITSTATUSD_FIELD_COMMITS_BEHIND], NULL, 10);
+    status->stashes  = (S64)strtoll(fields[GITSTATUSD_FIELD_STASHES], NULL, 10);
+    if(fields[GITSTATUSD_FIELD_LOCAL_BRANCH][0])
+    {
+        strncpy(status->branch, fields[GITSTATUSD_FIELD_LOCAL_BRANCH], sizeof(status->branch) - 1);
+        status->branch[sizeof(status->branch) - 1] = '\0';
+    }
+    return true;
+}
+
+// glibc only names the SIGEV_THREAD_ID target from 2.38 on
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+internal void
+gitstatusd_lock_interrupt(int signal_number)
+{
+}
+
+// Take the exchange lock, waiting no later than `deadline`: a blocking flock
+// that a one-shot timer, aimed at this thread, interrupts
+internal B32
+gitstatusd_lock(int lock_fd, U64 deadline)
+{
+    if(flock(lock_fd, LOCK_EX | LOCK_NB) == 0) return true;
+    U64 now = time_microseconds();
+    if(now >= deadline) return false;
+
+    struct sigaction interrupt, previous;
+    memset(&interrupt, 0, sizeof(interrupt));
+    interrupt.sa_handler = gitstatusd_lock_interrupt;  // no SA_RESTART
+    sigemptyset(&interrupt.sa_mask);
+    if(sigaction(SIGALRM, &interrupt, &previous) != 0) return false;
+
+    B32 locked = false;
+    timer_t timer;
+    struct sigevent event;
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGALRM;
+    event.sigev_notify_thread_id = gettid();
+    if(timer_create(CLOCK_MONOTONIC, &event, &timer) == 0)
+    {
+        U64 wait = deadline - now;
+        struct itimerspec expiry;
+        memset(&expiry, 0, sizeof(expiry));
+        expiry.it_value.tv_sec = (time_t)(wait / 1000000);
+        expiry.it_value.tv_nsec = (long)(wait % 1000000) * 1000;
+        if(timer_settime(timer, 0, &expiry, NULL) == 0)
+            locked = flock(lock_fd, LOCK_EX) == 0;
+        timer_delete(timer);
+    }
+    sigaction(SIGALRM, &previous, NULL);
+    return locked;
+}
+
+// Ask gitstatusd for repo_path's status. Returns false if the daemon is not
+// running, the directory is not a repo, or no answer arrives within timeout.
+internal B32
+gitstatusd_query(const char *repo_path, int timeout_milliseconds, Git_Status *status)
+{
+    U64 deadline = time_microseconds() + (U64)timeout_milliseconds * 1000;
+    uid_t uid = getuid();
+
+    // Non-blocking open fails with ENXIO when no daemon holds the read end
+    char fifo_path[96];
+    string_number(fifo_path, sizeof(fifo_path), GITSTATUSD_FIFO_PREFIX, uid, ".req");
+    int request_fd = open(fifo_path, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if(request_fd < 0) return false;
+
+    string_number(fifo_path, sizeof(fifo_path), GITSTATUSD_FIFO_PREFIX, uid, ".resp");
+    int response_fd = open(fifo_path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if(response_fd < 0) { close(request_fd); return false; }
+
+    // Not next to the FIFOs: /tmp is anyone's to plant a file or link in
+    int lock_fd = -1;
+    int directory_fd = state_directory_open();
+    if(directory_fd >= 0)
+    {
+        lock_fd = openat(directory_fd, "gitstatusd.lock", O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+        close(directory_fd);
+    }
+    B32 found = false;
+    if(lock_fd < 0 || !gitstatusd_lock(lock_fd, deadline)) goto done;
+
+    char request_id[48];
+    String_Builder id = string_builder(request_id, sizeof(request_id));
+    string_append_s64(&id, getpid());
+    string_append_char(&id, '.');
+    string_append_s64(&id, (S64)time_microseconds());
+
+    char request[640];
+    String_Builder request_builder = string_builder(request, sizeof(request));
+    string_append_cstring(&request_builder, request_id);
+    string_append_char(&request_builder, GITSTATUSD_FIELD_SEPARATOR);
+    string_append_cstring(&request_builder, repo_path);
+    string_append_char(&request_builder, GITSTATUSD_FIELD_SEPARATOR);
+    string_append_char(&request_builder, '0');
+    string_append_char(&request_builder, GITSTATUSD_RECORD_SEPARATOR);
+    int request_length = (int)request_builder.length;
+    if(request_length <= 0 || request_length >= (int)sizeof(request)) goto done;
+    if(write(request_fd, request, request_length) != request_length) goto done;
+
+    // Records longer than this (long workdir/remote paths) are truncated;
+    // the fields we need come first.
+    char record[2048];
+    U64 record_length = 0;
+    while(!found)
+    {
+        U64 now = time_microseconds();
+        if(now >= deadline) break;
+        struct pollfd poll_fd = {.fd = response_fd, .events = POLLIN};
+        if(poll(&poll_fd, 1, (int)((deadline - now + 999) / 1000)) <= 0) break;
+
+        char chunk[4096];
+        ssize_t bytes_read = read(response_fd, chunk, sizeof(chunk));
+        if(bytes_read <= 0) break;
+
+        for(ssize_t index = 0; index < bytes_read && !found; index++)
+        {
+            if(chunk[index] == GITSTATUSD_RECORD_SEPARATOR)
+            {
+                record[record_length] = '\0';
+                found = gitstatusd_parse_record(record, request_id, status);
+                record_length = 0;
+            }
+            else if(record_length < sizeof(record) - 1)
+                record[record_length++] = chunk[index];
+        }
+    }
+
+done:
+    if(lock_fd >= 0) close(lock_fd);
+    close(response_fd);
+    close(request_fd);
+    return found;
+}
+
+//~ SHA-1
+// Only used to content-check racily clean or stat-dirty index entries.
+
+typedef struct Sha1_Context Sha1_Context;
+struct Sha1_Context
+{
+    U32 state[5];
+    U64 length;
+    U8  block[64];
+    U32 block_length;
+};
+
+#define Sha1Rotate(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
+
+internal void
+sha1_transform(U32 state[5], const U8 block[64])
+{
+    U32 words[80];
+    for(int index = 0; index < 16; index++)
+        words[index] = (U32)block[index*4] << 24 | (U32)block[index*4 + 1] << 16 |
+                       (U32)block[index*4 + 2] << 8 | (U32)block[index*4 + 3];
+    for(int index = 16; index < 80; index++)
+        words[index] = Sha1Rotate(words[index-3] ^ words[index-8] ^ words[index-14] ^ words[index-16], 1);
+
+    U32 a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for(int index = 0; index < 80; index++)
+    {
+        U32 f, k;
+        if(index < 20)      { f = (b & c) | (~b & d);          k = 0x5a827999; }
+        else if(index < 40) { f = b ^ c ^ d;                   k = 0x6ed9eba1; }
+        else if(index < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8f1bbcdc; }
+        else                { f = b ^ c ^ d;                   k = 0xca62c1d6; }
+        U32 temp = Sha1Rotate(a, 5) + f + e + k + words[index];
+        e = d; d = c; c = Sha1Rotate(b, 30); b = a; a = temp;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e;
+}
+
+internal void
+sha1_init(Sha1_Context *context)
+{
+    context->state[0] = 0x67452301;
+    context->state[1] = 0xefcdab89;
+    context->state[2] = 0x98badcfe;
+    context->state[3] = 0x10325476;
+    context->state[4] = 0xc3d2e1f0;
+    context->length = 0;
+    context->block_length = 0;
+}
+
+internal void
+sha1_update(Sha1_Context *context, const void *data, U64 length)
+{
+    const U8 *bytes = (const U8 *)data;
+    context->length += length;
+    while(length > 0)
+    {
+        if(context->block_length == 0 && length >= 64)
+        {
+            sha1_transform(context->state, bytes);
+            bytes += 64; length -= 64;
+            continue;
+        }
+        U32 take = (U32)Min(length, (U64)(64 - context->block_length));
+        memcpy(context->block + context->block_length, bytes, take);
+        context->block_length += take;
+        bytes += take; length -= take;
+        if(context->block_length == 64)
+        {
+            sha1_transform(context->state, context->block);
+            context->block_length = 0;
+        }
+    }
+}
+
+internal void
+sha1_final(Sha1_Context *context, U8 digest[20])
+{
+    U64 bit_length = context->length * 8;
+    U8 padding = 0x80;
+    sha1_update(context, &padding, 1);
+    padding = 0;
+    while(context->block_length != 56) sha1_update(context, &padding, 1);
+    U8 length_bytes[8];
+    for(int index = 0; index < 8; index++) length_bytes[index] = (U8)(bit_length >> (56 - index*8));
+    sha1_update(context, length_bytes, 8);
+    for(int index = 0; index < 20; index++) digest[index] = (U8)(context->state[index/4] >> (24 - (index % 4)*8));
+}
+
+//~ Git Object Store
+//
+// Read-only access to loose and packed objects (including OFS/REF deltas):
+// enough to resolve HEAD and walk its trees. SHA-1 repositories only; any
+// surprise returns NULL and the caller falls back to git.
+
+#define GIT_OID_SIZE        20
+#define GIT_MAX_PACKS       64
+#define GIT_MAX_DELTA_DEPTH 64
+
+enum Git_Object_Type
+{
+    GIT_OBJECT_NONE      = 0,
+    GIT_OBJECT_COMMIT    = 1,
+    GIT_OBJECT_TREE      = 2,
+    GIT_OBJECT_BLOB      = 3,
+    GIT_OBJECT_TAG       = 4,
+    GIT_OBJECT_OFS_DELTA = 6,
+    GIT_OBJECT_REF_DELTA = 7,
+};
+
+typedef struct Git_Pack Git_Pack;
+struct Git_Pack
+{
+    const U8 *index;  U64 index_size;
+    const U8 *data;   U64 data_size;
+    U32       object_count;
+};
+
+typedef struct Git_Object_Store Git_Object_Store;
+struct Git_Object_Store
+{
+    char     objects_path[512];
+    Git_Pack packs[GIT_MAX_PACKS];
+    int      pack_count;
+};
+
+internal U32
+read_u32_be(const U8 *bytes)
+{
+    return (U32)bytes[0] << 24 | (U32)bytes[1] << 16 | (U32)bytes[2] << 8 | (U32)bytes[3];
+}
+
+internal U64
+read_u64_be(const U8 *bytes)
+{
+    return (U64)read_u32_be(bytes) << 32 | (U64)read_u32_be(bytes + 4);
+}
+
+internal int
+hex_digit_value(char character)
+{
+    if(character >= '0' && character <= '9') return character - '0';
+    if(character >= 'a' && character <= 'f') return character - 'a' + 10;
+    if(character >= 'A' && character <= 'F') return character - 'A' + 10;
+    return -1;
+}
+
+internal B32
+git_oid_from_hex(const char *hex, U8 oid[GIT_OID_SIZE])
+{
+    for(int index = 0; index < GIT_OID_SIZE; index++)
+    {
+        int high = hex_digit_value(hex[index*2]);
+        int low  = hex_digit_value(hex[index*2 + 1]);
+        if(high < 0 || low < 0) return false;
+        oid[index] = (U8)(high << 4 | low);
+    }
+    return true;
+}
+
+internal void
+git_oid_to_hex(const U8 oid[GIT_OID_SIZE], char *hex)
+{
+    static const char digits[] = "0123456789abcdef";
+    for(int index = 0; index < GIT_OID_SIZE; index++)
+    {
+        hex[index*2]     = digits[oid[index] >> 4];
+        hex[index*2 + 1] = digits[oid[index] & 15];
+    }
+    hex[GIT_OID_SIZE*2] = '\0';
+}
+
+internal const U8 *
+map_file(const char *path, U64 *size)
+{
+    int file_desc = open(path, O_RDONLY | O_CLOEXEC);
+    if(file_desc < 0) return NULL;
+    struct stat file_stat;
+    if(fstat(file_desc, &file_stat) != 0 || file_stat.st_size <= 0) { close(file_desc); return NULL; }
+    void *mapping = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, file_desc, 0);
+    close(file_desc);
+    if(mapping == MAP_FAILED) return NULL;
+    *size = (U64)file_stat.st_size;
+    return (const U8 *)mapping;
+}
+
+internal void
+git_store_open(Git_Object_Store *store, const char *git_directory)
+{
+    memset(store, 0, sizeof(*store));
+    path_join(store->objects_path, sizeof(store->objects_path), git_directory, "/objects");
+
+    char pack_directory_path[600];
+    path_join(pack_directory_path, sizeof(pack_directory_path), store->objects_path, "/pack");
+    DIR *pack_directory = opendir(pack_directory_path);
+    if(pack_directory == NULL) return;
+
+    struct dirent *entry;
+    while((entry = readdir(pack_directory)) != NULL && store->pack_count < GIT_MAX_PACKS)
+    {
+        U64 name_length = strlen(entry->d_name);
+        if(name_length < 5 || strcmp(entry->d_name + name_length - 4, ".idx") != 0) continue;
+
+        char path[900];
+        String_Builder pack_path = string_builder(path, sizeof(path));
+        string_append_cstring(&pack_path, pack_directory_path);
+        string_append_char(&pack_path, '/');
+        string_append_cstring(&pack_path, entry->d_name);
+        Git_Pack *pack = &store->packs[store->pack_count];
+        pack->index = map_file(path, &pack->index_size);
+        if(pack->index == NULL) continue;
+
+        memcpy(path + strlen(path) - 4, ".pack", 6);
+        pack->data = map_file(path, &pack->data_size);
+
+        // Version 2 index: magic, version, 256-entry fanout
+        if(pack->data == NULL || pack->index_size < 8 + 256*4 ||
+           memcmp(pack->index, "\377tOc", 4) != 0 || read_u32_be(pack->index + 4) != 2)
+        {
+            if(pack->data) munmap((void *)pack->data, pack->data_size);
+            munmap((void *)pack->index, pack->index_size);
+            memset(pack, 0, sizeof(*pack));
+            continue;
+        }
+        pack->object_count = read_u32_be(pack->index + 8 + 255*4);
+        store->pack_count++;
+    }
+    closedir(pack_directory);
+}
+
+internal void
+git_store_close(Git_Object_Store *store)
+{
+    for(int index = 0; index < store->pack_count; index++)
+    {
+        munmap((void *)store->packs[index].index, store->packs[index].index_size);
+        munmap((void *)store->packs[index].data, store->packs[index].data_size);
+    }
+    store->pack_count = 0;
+}
+
+// Inflate exactly output_size bytes from a zlib stream
+internal B32
+git_inflate(const U8 *input, U64 input_size, U8 *output, U64 output_size)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if(inflateInit(&stream) != Z_OK) return false;
+    stream.next_in   = (Bytef *)input;
+    stream.avail_in  = (uInt)Min(input_size, (U64)UINT32_MAX);
+    stream.next_out  = output;
+    stream.avail_out = (uInt)output_size;
+    int result = inflate(&stream, Z_FINISH);
+    B32 ok = (result == Z_STREAM_END || (result == Z_OK && stream.avail_out == 0)) &&
+             stream.total_out == output_size;
+    inflateEnd(&stream);
+    return ok;
+}
+
+internal U8 *
+git_read_loose(Git_Object_Store *store, const U8 oid[GIT_OID_SIZE], enum Git_Object_Type *type, U64 *size)
+{
+    char hex[GIT_OID_SIZE*2 + 1];
+    git_oid_to_hex(oid, hex);
+    char path[600];
+    String_Builder loose_path = string_builder(path, sizeof(path));
+    string_append_cstring(&loose_path, store->objects_path);
+    string_append_char(&loose_path, '/');
+    string_append(&loose_path, hex, 2);
+    string_append_char(&loose_path, '/');
+    string_append_cstring(&loose_path, hex + 2);
+
+    U64 file_size;
+    const U8 *file = map_file(path, &file_size);
+    if(file == NULL) return NULL;
+
+    // Inflate the "<type> <size>\0" header first to learn the object size
+    U8 *object = NULL;
+    U8 header[64];
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if(inflateInit(&stream) != Z_OK) goto done;
+    stream.next_in   = (Bytef *)file;
+    stream.avail_in  = (uInt)file_size;
+    stream.next_out  = header;
+    stream.avail_out = sizeof(header);
+    int result = inflate(&stream, Z_SYNC_FLUSH);
+    if(result != Z_OK && result != Z_STREAM_END) goto end;
+
+    U64 header_available = sizeof(header) - stream.avail_out;
+    U8 *terminator = memchr(header, '\0', header_available);
+    if(terminator == NULL) goto end;
+
+    if(memcmp(header, "commit ", 7) == 0)    *type = GIT_OBJECT_COMMIT;
+    else if(memcmp(header, "tree ", 5) == 0) *type = GIT_OBJECT_TREE;
+    else if(memcmp(header, "blob ", 5) == 0) *type = GIT_OBJECT_BLOB;
+    else if(memcmp(header, "tag ", 4) == 0)  *type = GIT_OBJECT_TAG;
+    else goto end;
+
+    *size = strtoull((const char *)memchr(header, ' ', header_available) + 1, NULL, 10);
+    object = malloc(*size + 1);
+    if(object == NULL) goto end;
+
+    U64 already = header_available - (U64)(terminator + 1 - header);
+    if(already > *size) { free(object); object = NULL; goto end; }
+    memcpy(object, terminator + 1, already);
+    if(already < *size)
+    {
+        stream.next_out  = object + already;
+        stream.avail_out = (uInt)(*size - already);
+        result = inflate(&stream, Z_FINISH);
+        if(result != Z_STREAM_END || stream.avail_out != 0) { free(object); object = NULL; goto end; }
+    }
+    object[*size] = '\0';
+
+end:
+    inflateEnd(&stream);
+done:
+    munmap((void *)file, file_size);
+    return object;
+}
+
+internal B32
+git_pack_find(Git_Pack *pack, const U8 oid[GIT_OID_SIZE], U64 *offset)
+{
+    const U8 *fanout = pack->index + 8;
+    U32 low  = oid[0] == 0 ? 0 : read_u32_be(fanout + (oid[0] - 1)*4);
+    U32 high = read_u32_be(fanout + oid[0]*4);
+    const U8 *names = fanout + 256*4;
+    if(8 + 256*4 + (U64)pack->object_count*(GIT_OID_SIZE + 4 + 4) > pack->index_size) return false;
+
+    while(low < high)
+    {
+        U32 middle = low + (high - low) / 2;
+        int compare = memcmp(names + (U64)middle*GIT_OID_SIZE, oid, GIT_OID_SIZE);
+        if(compare == 0)
+        {
+            const U8 *offsets = names + (U64)pack->object_count*(GIT_OID_SIZE + 4);
+            U32 small_offset = read_u32_be(offsets + (U64)middle*4);
+            if(small_offset & 0x80000000u)
+            {
+                const U8 *large = offsets + (U64)pack->object_count*4 + (U64)(small_offset & 0x7fffffffu)*8;
+                if(large + 8 > pack->index + pack->index_size) return false;
+                *offset = read_u64_be(large);
+            }
+            else *offset = small_offset;
+            return true;
+        }
+        if(compare < 0) low = middle + 1; else high = middle;
+    }
+    return false;
+}
+
+internal U64
+git_delta_varint(const U8 **cursor, const U8 *end)
+{
+    U64 value = 0;
+    int shift = 0;
+    while(*cursor < end)
+    {
+        U8 byte = *(*cursor)++;
+        value |= (U64)(byte & 0x7f) << shift;
+        shift += 7;
+        if(!(byte & 0x80)) break;
+    }
+    return value;
+}
+
+internal U8 *
+git_apply_delta(const U8 *base, U64 base_size, const U8 *delta, U64 delta_size, U64 *result_size)
+{
+    const U8 *cursor = delta, *end = delta + delta_size;
+    if(git_delta_varint(&cursor, end) != base_size) return NULL;
+    *result_size = git_delta_varint(&cursor, end);
+
+    U8 *result = malloc(*result_size + 1);
+    if(result == NULL) return NULL;
+    U64 position = 0;
+    while(cursor < end)
+    {
+        U8 opcode = *cursor++;
+        if(opcode & 0x80)
+        {
+            U64 copy_offset = 0, copy_size = 0;
+            for(int bit = 0; bit < 4; bit++)
+                if(opcode & (1 << bit)) { if(cursor >= end) goto fail; copy_offset |= (U64)*cursor++ << (bit*8); }
+            for(int bit = 0; bit < 3; bit++)
+                if(opcode & (0x10 << bit)) { if(cursor >= end) goto fail; copy_size |= (U64)*cursor++ << (bit*8); }
+            if(copy_size == 0) copy_size = 0x10000;
+            if(copy_offset + copy_size > base_size || position + copy_size > *result_size) goto fail;
+            memcpy(result + position, base + copy_offset, copy_size);
+            position += copy_size;
+        }
+        else if(opcode)
+        {
+            if(cursor + opcode > end || position + opcode > *result_size) goto fail;
+            memcpy(result + position, cursor, opcode);
+            cursor += opcode;
+            position += opcode;
+        }
+        else goto fail;
+    }
+    if(position != *result_size) goto fail;
+    result[*result_size] = '\0';
+    return result;
+
+fail:
+    free(result);
+    return NULL;
+}
+
+internal U8 *git_store_read_depth(Git_Object_Store *store, const U8 oid[GIT_OID_SIZE],
+                                  enum Git_Object_Type *type, U64 *size, int depth);
+
+internal U8 *
+git_pack_read(Git_Object_Store *store, Git_Pack *pack, U64 offset,
+              enum Git_Object_Type *type, U64 *size, int depth)
+{
+    if(depth > GIT_MAX_DELTA_DEPTH || offset >= pack->data_size) return NULL;
+
+    const U8 *cursor = pack->data + offset;
+    const U8 *end = pack->data + pack->data_size;
+    U8 byte = *cursor++;
+    enum Git_Object_Type entry_type = (enum Git_Object_Type)((byte >> 4) & 7);
+    U64 entry_size = byte & 15;
+    int shift = 4;
+    while((byte & 0x80) && cursor < end)
+    {
+        byte = *cursor++;
+        entry_size |= (U64)(byte & 0x7f) << shift;
+        shift += 7;
+    }
+
+    U8 *base = NULL;
+    U64 base_size = 0;
+    if(entry_type == GIT_OBJECT_OFS_DELTA)
+    {
+        if(cursor >= end) return NULL;
+        byte = *cursor++;
+        U64 base_distance = byte & 0x7f;
+        while((byte & 0x80) && cursor < end)
+        {
+            byte = *cursor++;
+            base_distance = ((base_distance + 1) << 7) | (byte & 0x7f);
+        }
+        if(base_distance == 0 || base_distance > offset) return NULL;
+        base = git_pack_read(store, pack, offset - base_distance, type, &base_size, depth + 1);
+    }
+    else if(entry_type == GIT_OBJECT_REF_DELTA)
+    {
+        if(cursor + GIT_OID_SIZE > end) return NULL;
+        base = git_store_read_depth(store, cursor, type, &base_size, depth + 1);
+        cursor += GIT_OID_SIZE;
+    }
+    else if(entry_type >= GIT_OBJECT_COMMIT && entry_type <= GIT_OBJECT_TAG)
+    {
+        U8 *object = malloc(entry_size + 1);
+        if(object == NULL) return NULL;
+        if(!git_inflate(cursor, (U64)(end - cursor), object, entry_size)) { free(object); return NULL; }
+        object[entry_size] = '\0';
+        *type = entry_type;
+        *size = entry_size;
+        return object;
+    }
+    else return NULL;
+
+    if(base == NULL) return NULL;
+    U8 *delta = malloc(entry_size + 1);
+    U8 *result = NULL;
+    if(delta && git_inflate(cursor, (U64)(end - cursor), delta, entry_size))
+        result = git_apply_delta(base, base_size, delta, entry_size, size);
+    free(delta);
+    free(base);
+    return result;
+}
+
+internal U8 *
+git_store_read_depth(Git_Object_Store *store, const U8 oid[GIT_OID_SIZE],
+                     enum Git_Object_Type *type, U64 *size, int depth)
+{
+    for(int index = 0; index < store->pack_count; index++)
+    {
+        U64 offset;
+        if(git_pack_find(&store->packs[index], oid, &offset))
+            return git_pack_read(store, &store->packs[index], offset, type, size, depth);
+    }
+    return git_read_loose(store, oid, type, size);
+}
+
+// Returns a malloc'd, NUL-terminated object body (caller frees) or NULL
+internal U8 *
+git_store_read(Git_Object_Store *store, const U8 oid[GIT_OID_SIZE], enum Git_Object_Type *type, U64 *size)
+{
+    return git_store_read_depth(store, oid, type, size, 0);
+}
+
+//~ Git Refs
+
+// Find ref_name in a packed-refs file. Files whose header carries the
+// "sorted" trait (everything git has written since 2.13) are binary
+// searched over line starts, stepping back over peeled "^" lines; others
+// get a linear scan.
+internal B32
+git_packed_refs_find(const char *packed, U64 packed_size, const char *ref_name, U8 oid[GIT_OID_SIZE])
+{
+    const char *start = packed;
+    const char *end = packed + packed_size;
+    U64 ref_length = strlen(ref_name);
+    B32 sorted = false;
+    if(packed_size > 0 && packed[0] == '#')
+    {
+        const char *header_end = memchr(packed, '\n', packed_size);
+        if(header_end == NULL) return false;
+        const char *traits = packed;
+        while((traits = memmem(traits, (U64)(header_end - traits), " sorted", 7)) != NULL)
+        {
+            if(traits + 7 == header_end || traits[7] == ' ') { sorted = true; break; }
+            traits += 7;
+        }
+        start = header_end + 1;
+    }
+
+    if(!sorted)
+    {
+        for(const char *line = start; line < end;)
+        {
+            const char *newline = memchr(line, '\n', (U64)(end - line));
+            const char *line_end = newline ? newline : end;
+            if(line_end - line == GIT_OID_SIZE*2 + 1 + (S64)ref_length && line[0] != '#' && line[0] != '^' &&
+               memcmp(line + GIT_OID_SIZE*2 + 1, ref_name, ref_length) == 0)
+                return git_oid_from_hex(line, oid);
+            line = line_end + 1;
+        }
+        return false;
+    }
+
+    const char *low = start, *high = end;
+    while(low < high)
+    {
+        const char *line = low + (high - low) / 2;
+        while(line > low && line[-1] != '\n') line--;
+        while(line > low && line[0] == '^')
+        {
+            line--;
+            while(line > low && line[-1] != '\n') line--;
+        }
+        const char *newline = memchr(line, '\n', (U64)(end - line));
+        const char *line_end = newline ? newline : end;
+        if(line[0] == '^' || line_end - line < GIT_OID_SIZE*2 + 2) return false;
+
+        const char *name = line + GIT_OID_SIZE*2 + 1;
+        U64 name_length = (U64)(line_end - name);
+        int compare = memcmp(name, ref_name, Min(name_length, ref_length));
+        if(compare == 0) compare = name_length < ref_length ? -1 : name_length > ref_length ? 1 : 0;
+        if(compare == 0) return git_oid_from_hex(line, oid);
+        if(compare > 0) { high = line; continue; }
+
+        low = line_end + 1;
+        while(low < high && low[0] == '^')
+        {
+            const char *peeled_end = memchr(low, '\n', (U64)(end - low));
+            low = peeled_end ? peeled_end + 1 : end;
+        }
+    }
+    return false;
+}
+
+// Resolve a full ref name ("refs/heads/main") via its loose file, then packed-refs.
+// Shared refs live in the common directory, even for linked worktrees.
+internal B32
+git_resolve_ref(const char *common_directory, const char *ref_name, U8 oid[GIT_OID_SIZE])
+{
+    char path[768];
+    String_Builder ref_path = string_builder(path, sizeof(path));
+    string_append_cstring(&ref_path, common_directory);
+    string_append_char(&ref_path, '/');
+    string_append_cstring(&ref_path, ref_name);
+    int file_desc = open(path, O_RDONLY | O_CLOEXEC);
+    if(file_desc >= 0)
+    {
+        char buffer[64];
+        ssize_t bytes_read = read(file_desc, buffer, sizeof(buffer));
+        close(file_desc);
+        return bytes_read >= GIT_OID_SIZE*2 && git_oid_from_hex(buffer, oid);
+    }
+
+    path_join(path, sizeof(path), common_directory, "/packed-refs");
+    U64 packed_size;
+    const U8 *packed = map_file(path, &packed_size);
+    if(packed == NULL) return false;
+    B32 found = git_packed_refs_find((const char *)packed, packed_size, ref_name, oid);
+    munmap((void *)packed, packed_size);
+    return found;
+}
+
+// HEAD -> commit oid. *unborn is set for a branch with no commits yet.
+internal B32
+git_resolve_head(const Git_Repo *repo, U8 oid[GIT_OID_SIZE], B32 *unborn)
+{
+    *unborn = false;
+    char path[600];
+    path_join(path, sizeof(path), repo->git_directory, "/HEAD");
+    int file_desc = open(path, O_RDONLY | O_CLOEXEC);
+    if(file_desc < 0) return false;
+    char buffer[512];
+    ssize_t bytes_read = read(file_desc, buffer, sizeof(buffer) - 1);
+    close(file_desc);
+    if(bytes_read <= 0) return false;
+    buffer[bytes_read] = '\0';
+    while(bytes_read > 0 && (buffer[bytes_read-1] == '\n' || buffer[bytes_read-1] == '\r' || buffer[bytes_read-1] == ' '))
+        buffer[--bytes_read] = '\0';
+
+    if(memcmp(buffer, "ref: ", 5) == 0)
+    {
+        if(git_resolve_ref(repo->common_directory, buffer + 5, oid)) return true;
+        *unborn = true;
+        return true;
+    }
+    return bytes_read >= GIT_OID_SIZE*2 && git_oid_from_hex(buffer, oid);
+}
+
+//~ Git Ahead/Behind
+//
+// Ahead/behind counts of HEAD against its upstream, as on the "##" line of
+// `git status -b`, without spawning git:
+//   - the upstream comes from branch.<name>.remote/merge in the config,
+//     mapped through the default refs/remotes/<remote>/ fetch layout
+//   - both tips resolve through loose refs, then packed-refs
+//   - the walk paints commits from each tip in generation order (the
+//     commit-graph's topological levels; commits newer than the graph are
+//     read from the object store and get 1 + their parents' maximum),
+//     counting commits reached from one side only, and stops once every
+//     queued commit is reachable from both
+// Without a commit-graph (objects/info/commit-graph or a commit-graphs
+// chain) this returns false and git answers instead.
+
+#define GIT_GRAPH_MAX_LAYERS      16
+#define GIT_GRAPH_PARENT_NONE     0x70000000u
+#define GIT_GRAPH_EXTRA_EDGES     0x80000000u
+#define GIT_GRAPH_POSITION_NONE   0xffffffffu
+#define GIT_WALK_MAX_COMMITS      (1u << 20)
+
+#define GIT_GRAPH_CHUNK_FANOUT      0x4f494446u  // "OIDF"
+#define GIT_GRAPH_CHUNK_OID_LOOKUP  0x4f49444cu  // "OIDL"
+#define GIT_GRAPH_CHUNK_COMMIT_DATA 0x43444154u  // "CDAT"
+#define GIT_GRAPH_CHUNK_EXTRA_EDGES 0x45444745u  // "EDGE"
+
+#define GIT_GRAPH_COMMIT_DATA_SIZE  (GIT_OID_SIZE + 16)
+
+typedef struct Git_Graph_Layer Git_Graph_Layer;
+struct Git_Graph_Layer
+{
+    const U8 *data;         U64 data_size;
+    const U8 *fanout;
+    const U8 *oids;
+    const U8 *commit_data;
+    const U8 *extra_edges;  U64 extra_edge_count;
+    U32       commit_count;
+    U32       first_position;  // graph positions are global across a chain
+};
+
+typedef struct Git_Commit_Graph Git_Commit_Graph;
+struct Git_Commit_Graph
+{
+    Git_Graph_Layer layers[GIT_GRAPH_MAX_LAYERS];
+    int             layer_count;
+    U32             commit_count;
+};
+
+internal B32
+git_graph_layer_open(Git_Commit_Graph *graph, const char *path)
+{
+    if(graph->layer_count >= GIT_GRAPH_MAX_LAYERS) return false;
+    Git_Graph_Layer *layer = &graph->layers[graph->layer_count];
+    memset(layer, 0, sizeof(*layer));
+    layer->data = map_file(path, &layer->data_size);
+    if(layer->data == NULL) return false;
+
+    const U8 *data = layer->data;
+    U64 size = layer->data_size;
+    U32 chunk_count = size >= 8 ? data[6] : 0;
+    if(size < 8 + (U64)(chunk_count + 1)*12 || memcmp(data, "CGPH", 4) != 0 || data[4] != 1 || data[5] != 1)
+        goto fail;
+
+    for(U32 chunk = 0; chunk < chunk_count; chunk++)
+    {
+        const U8 *entry = data + 8 + (U64)chunk*12;
+        U32 id = read_u32_be(entry);
+        U64 offset = read_u64_be(entry + 4);
+        U64 next_offset = read_u64_be(entry + 16);
+        if(offset > next_offset || next_offset > size) goto fail;
+        U64 chunk_size = next_offset - offset;
+
+        switch(id)
+        {
+        case GIT_GRAPH_CHUNK_FANOUT:
+            if(chunk_size != 256*4) goto fail;
+            layer->fanout = data + offset;
+            break;
+        case GIT_GRAPH_CHUNK_OID_LOOKUP:
+            layer->oids = data + offset;
+            break;
+        case GIT_GRAPH_CHUNK_COMMIT_DATA:
+            layer->commit_data = data + offset;
+            break;
+        case GIT_GRAPH_CHUNK_EXTRA_EDGES:
+            layer->extra_edges = data + offset;
+            layer->extra_edge_count = chunk_size / 4;
+            break;
+        }
+    }
+    if(layer->fanout == NULL || layer->oids == NULL || layer->commit_data == NULL) goto fail;
+
+    // Chunk sizes must cover what the fanout claims
+    layer->commit_count = read_u32_be(layer->fanout + 255*4);
+    U64 oids_end = (U64)(layer->oids - data) + (U64)layer->commit_count*GIT_OID_SIZE;
+    U64 commit_data_end = (U64)(layer->commit_data - data) + (U64)layer->commit_count*GIT_GRAPH_COMMIT_DATA_SIZE;
+    if(oids_end > size || commit_data_end > size) goto fail;
+    if((U64)graph->commit_count + layer->commit_count >= GIT_GRAPH_PARENT_NONE) goto fail;
+
+    layer->first_position = graph->commit_count;
+    graph->commit_count += layer->commit_count;
+    graph->layer_count++;
+    return true;
+
+fail:
+    munmap((void *)layer->data, layer->data_size);
+    memset(layer, 0, sizeof(*layer));
+    return false;
+}
+
+internal void
+git_graph_close(Git_Commit_Graph *graph)
+{
+    for(int index = 0; index < graph->layer_count; index++)
+        munmap((void *)graph->layers[index].data, graph->layers[index].data_size);
+    graph->layer_count = 0;
+    graph->commit_count = 0;
+}
+
+// The single-file graph, else a split chain (base layer first)
+internal B32
+git_graph_open(Git_Commit_Graph *graph, const char *common_directory)
+{
+    memset(graph, 0, sizeof(*graph));
+    char path[640];
+    path_join(path, sizeof(path), common_directory, "/objects/info/commit-graph");
+    if(git_graph_layer_open(graph, path)) return true;
+
+    path_join(path, sizeof(path), common_directory, "/objects/info/commit-graphs/commit-graph-chain");
+    U64 chain_size;
+    const U8 *chain = map_file(path, &chain_size);
+    if(chain == NULL) return false;
+
+    B32 ok = true;
+    const char *line = (const char *)chain;
+    const char *chain_end = line + chain_size;
+    while(ok && line + GIT_OID_SIZE*2 <= chain_end)
+    {
+        String_Builder layer_path = string_builder(path, sizeof(path));
+        string_append_cstring(&layer_path, common_directory);
+        string_append_literal(&layer_path, "/objects/info/commit-graphs/graph-");
+        string_append(&layer_path, line, strnlen(line, GIT_OID_SIZE*2));
+        string_append_literal(&layer_path, ".graph");
+        ok = git_graph_layer_open(graph, path);
+        const char *newline = memchr(line, '\n', (U64)(chain_end - line));
+        line = newline ? newline + 1 : chain_end;
+    }
+    munmap((void *)chain, chain_size);
+    if(!ok || graph->layer_count == 0) { git_graph_close(graph); return false; }
+    return true;
+}
+
+internal U32
+git_graph_find(const Git_Commit_Graph *graph, const U8 oid[GIT_OID_SIZE])
+{
+    for(int index = 0; index < graph->layer_count; index++)
+    {
+        const Git_Graph_Layer *layer = &graph->layers[index];
+        U32 low  = oid[0] == 0 ? 0 : read_u32_be(layer->fanout + (oid[0] - 1)*4);
+        U32 high = read_u32_be(layer->fanout + oid[0]*4);
+        while(low < high)
+        {
+            U32 middle = low + (high - low) / 2;
+            int compare = memcmp(layer->oids + (U64)middle*GIT_OID_SIZE, oid, GIT_OID_SIZE);
+            if(compare == 0) return layer->first_position + middle;
+            if(compare < 0) low = middle + 1;
+            else high = middle;
+        }
+    }
+    return GIT_GRAPH_POSITION_NONE;
+}
+
+internal const Git_Graph_Layer *
+git_graph_layer_for(const Git_Commit_Graph *graph, U32 position)
+{
+    for(int index = graph->layer_count - 1; index >= 0; index--)
+        if(position >= graph->layers[index].first_position)
+            return position - graph->layers[index].first_position < graph->layers[index].commit_count
+                   ? &graph->layers[index] : NULL;
+    return NULL;
+}
+
+typedef struct Git_Walk_Commit Git_Walk_Commit;
+struct Git_Walk_Commit
+{
+    U8  oid[GIT_OID_SIZE];
+    U32 graph_position;    // GIT_GRAPH_POSITION_NONE if newer than the graph
+    U32 generation;        // topological level; 0 until computed off the graph
+    S64 commit_time;
+    U32 parent_offset;     // into Git_Walk.parent_oids, for commits off the graph
+    U32 parent_count;
+    U8  flags;
+};
+
+enum
+{
+    GIT_WALK_FROM_HEAD     = 1,
+    GIT_WALK_FROM_UPSTREAM = 2,
+    GIT_WALK_STALE         = GIT_WALK_FROM_HEAD | GIT_WALK_FROM_UPSTREAM,
+};
+
+typedef struct Git_Walk Git_Walk;
+struct Git_Walk
+{
+    Git_Commit_Graph *graph;
+    Git_Object_Store  store;
+    B32               store_open;
+    const char       *common_directory;
+
+    Git_Walk_Commit  *commits;       U32 commit_count, commit_capacity;
+    U32              *table;         U32 table_capacity;   // oid hash -> commit index + 1
+    U32              *heap;          U32 heap_count, heap_capacity;
+    U32              *stack;         U32 stack_count, stack_capacity;
+    U8               *parent_oids;   U32 parent_oid_count, parent_oid_capacity;
+    U32               nonstale;      // queued commits not yet reached from both tips
+};
+
+internal B32
+git_walk_grow(void **array, U32 *capacity, U32 needed, U64 element_size)
+{
+    if(needed <= *capacity) return true;
+    U32 new_capacity = Max(*capacity * 2, Max(needed, 64u));
+    void *grown = realloc(*array, (U64)new_capacity * element_size);
+    if(grown == NULL) return false;
+    *array = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+internal U32
+git_walk_hash(const U8 oid[GIT_OID_SIZE])
+{
+    U32 hash;
+    memcpy(&hash, oid, sizeof(hash));
+    return hash;
+}
+
+internal B32
+git_walk_rehash(Git_Walk *walk)
+{
+    U32 capacity = walk->table_capacity ? walk->table_capacity * 2 : 1024;
+    U32 *table = calloc(capacity, sizeof(U32));
+    if(table == NULL) return false;
+    for(U32 index = 0; index < walk->commit_count; index++)
+    {
+        U32 slot = git_walk_hash(walk->commits[index].oid) & (capacity - 1);
+        while(table[slot]) slot = (slot + 1) & (capacity - 1);
+        table[slot] = index + 1;
+    }
+    free(walk->table);
+    walk->table = table;
+    walk->table_capacity = capacity;
+    return true;
+}
+
+// Commit off the graph: ordering key and parents come from the object
+internal B32
+git_walk_load_object(Git_Walk *walk, Git_Walk_Commit *commit)
+{
+    if(!walk->store_open)
+    {
+        git_store_open(&walk->store, walk->common_directory);
+        walk->store_open = true;
+    }
+
+    enum Git_Object_Type type;
+    U64 size;
+    U8 *body = git_store_read(&walk->store, commit->oid, &type, &size);
+    if(body == NULL) return false;
+    B32 ok = type == GIT_OBJECT_COMMIT;
+
+    commit->parent_offset = walk->parent_oid_count;
+    const char *line = (const char *)body;
+    const char *body_end = line + size;
+    while(ok && line < body_end && *line != '\n')
+    {
+        const char *newline = memchr(line, '\n', (U64)(body_end - line));
+        const char *line_end = newline ? newline : body_end;
+        if(line_end - line >= 7 + GIT_OID_SIZE*2 && memcmp(line, "parent ", 7) == 0)
+        {
+            ok = git_walk_grow((void **)&walk->parent_oids, &walk->parent_oid_capacity,
+                               (walk->parent_oid_count + 1) * GIT_OID_SIZE, 1) &&
+                 git_oid_from_hex(line + 7, walk->parent_oids + (U64)walk->parent_oid_count*GIT_OID_SIZE);
+            walk->parent_oid_count++;
+            commit->parent_count++;
+        }
+        else if(line_end - line > 10 && memcmp(line, "committer ", 10) == 0)
+        {
+            const char *email_end = memrchr(line, '>', (U64)(line_end - line));
+            if(email_end) commit->commit_time = strtoll(email_end + 1, NULL, 10);
+        }
+        line = line_end + 1;
+    }
+    free(body);
+    return ok;
+}
+
+// Index of the walk's record for oid (position, if already known from the
+// graph), adding it on first sight. Returns GIT_GRAPH_POSITION_NONE on failure.
+internal U32
+git_walk_get(Git_Walk *walk, const U8 oid[GIT_OID_SIZE], U32 graph_position)
+{
+    if(walk->commit_count * 2 >= walk->table_capacity && !git_walk_rehash(walk)) return GIT_GRAPH_POSITION_NONE;
+
+    U32 slot = git_walk_hash(oid) & (walk->table_capacity - 1);
+    while(walk->table[slot])
+    {
+        U32 index = walk->table[slot] - 1;
+        if(memcmp(walk->commits[index].oid, oid, GIT_OID_SIZE) == 0) return index;
+        slot = (slot + 1) & (walk->table_capacity - 1);
+    }
+
+    if(walk->commit_count >= GIT_WALK_MAX_COMMITS ||
+       !git_walk_grow((void **)&walk->commits, &walk->commit_capacity, walk->commit_count + 1, sizeof(Git_Walk_Commit)))
+        return GIT_GRAPH_POSITION_NONE;
+
+    Git_Walk_Commit *commit = &walk->commits[walk->commit_count];
+    memset(commit, 0, sizeof(*commit));
+    memcpy(commit->oid, oid, GIT_OID_SIZE);
+    commit->graph_position = graph_position != GIT_GRAPH_POSITION_NONE ? graph_position : git_graph_find(walk->graph, oid);
+
+    const Git_Graph_Layer *layer = commit->graph_position != GIT_GRAPH_POSITION_NONE
+                                   ? git_graph_layer_for(walk->graph, commit->graph_position) : NULL;
+    if(layer)
+    {
+        const U8 *data = layer->commit_data + (U64)(commit->graph_position - layer->first_position)*GIT_GRAPH_COMMIT_DATA_SIZE;
+        U32 level_and_time = read_u32_be(data + GIT_OID_SIZE + 8);
+        commit->generation = level_and_time >> 2;
+        commit->commit_time = (S64)((U64)(level_and_time & 3) << 32 | read_u32_be(data + GIT_OID_SIZE + 12));
+        if(commit->generation == 0) return GIT_GRAPH_POSITION_NONE;  // written before generation numbers
+    }
+    else
+    {
+        commit->graph_position = GIT_GRAPH_POSITION_NONE;
+        if(!git_walk_load_object(walk, commit)) return GIT_GRAPH_POSITION_NONE;
+    }
+
+    walk->table[slot] = walk->commit_count + 1;
+    return walk->commit_count++;
+}
+
+// Generation of a commit off the graph: 1 + the maximum over its parents,
+// which bottoms out in the graph (or at root commits). Iterative, since
+// the chain of unindexed commits can be long.
+internal B32
+git_walk_generation(Git_Walk *walk, U32 index)
+{
+    if(walk->commits[index].generation) return true;
+    walk->stack_count = 0;
+    if(!git_walk_grow((void **)&walk->stack, &walk->stack_capacity, 1, sizeof(U32))) return false;
+    walk->stack[walk->stack_count++] = index;
+
+    while(walk->stack_count)
+    {
+        U32 top = walk->stack[walk->stack_count - 1];
+        if(walk->commits[top].generation) { walk->stack_count--; continue; }
+
+        U32 generation = 1;
+        B32 ready = true;
+        for(U32 parent = 0; parent < walk->commits[top].parent_count; parent++)
+        {
+            U8 parent_oid[GIT_OID_SIZE];
+            memcpy(parent_oid, walk->parent_oids + (U64)(walk->commits[top].parent_offset + parent)*GIT_OID_SIZE,
+                   GIT_OID_SIZE);
+            U32 parent_index = git_walk_get(walk, parent_oid, GIT_GRAPH_POSITION_NONE);
+            if(parent_index == GIT_GRAPH_POSITION_NONE) return false;
+            U32 parent_generation = walk->commits[parent_index].generation;
+            if(parent_generation == 0)
+            {
+                if(!git_walk_grow((void **)&walk->stack, &walk->stack_capacity, walk->stack_count + 1, sizeof(U32)))
+                    return false;
+                walk->stack[walk->stack_count++] = parent_index;
+                ready = false;
+            }
+            else generation = Max(generation, parent_generation + 1);
+        }
+        if(ready)
+        {
+            walk->commits[top].generation = generation;
+            walk->stack_count--;
+        }
+    }
+    return true;
+}
+
+// Max-heap on (generation, commit time): children before parents
+internal B32
+git_walk_before(const Git_Walk *walk, U32 left, U32 right)
+{
+    const Git_Walk_Commit *a = &walk->commits[left], *b = &walk->commits[right];
+    if(a->generation != b->generation) return a->generation > b->generation;
+    return a->commit_time > b->commit_time;
+}
+
+internal B32
+git_walk_push(Git_Walk *walk, U32 index)
+{
+    if(!git_walk_grow((void **)&walk->heap, &walk->heap_capacity, walk->heap_count + 1, sizeof(U32))) return false;
+    U32 position = walk->heap_count++;
+    while(position > 0)
+    {
+        U32 parent = (position - 1) / 2;
+        if(!git_walk_before(walk, index, walk->heap[parent])) break;
+        walk->heap[position] = walk->heap[parent];
+        position = parent;
+    }
+    walk->heap[position] = index;
+    return true;
+}
+
+internal U32
+git_walk_pop(Git_Walk *walk)
+{
+    U32 top = walk->heap[0];
+    U32 last = walk->heap[--walk->heap_count];
+    U32 position = 0;
+    for(;;)
+    {
+        U32 child = position*2 + 1;
+        if(child >= walk->heap_count) break;
+        if(child + 1 < walk->heap_count && git_walk_before(walk, walk->heap[child + 1], walk->heap[child])) child++;
+        if(!git_walk_before(walk, walk->heap[child], last)) break;
+        walk->heap[position] = walk->heap[child];
+        position = child;
+    }
+    if(walk->heap_count) walk->heap[position] = last;
+    return top;
+}
+
+// Give a commit (more of) a tip's paint, queueing it when first reached
+internal B32
+git_walk_paint(Git_Walk *walk, U32 index, U8 flags)
+{
+    if(index == GIT_GRAPH_POSITION_NONE || !git_walk_generation(walk, index)) return false;
+    Git_Walk_Commit *commit = &walk->commits[index];
+    U8 old_flags = commit->flags;
+    commit->flags |= flags;
+    if(old_flags == 0)
+    {
+        if(commit->flags != GIT_WALK_STALE) walk->nonstale++;
+        return git_walk_push(walk, index);
+    }
+    if(old_flags != GIT_WALK_STALE && commit->flags == GIT_WALK_STALE) walk->nonstale--;
+    return true;
+}
+
+internal B32
+git_walk_count(Git_Walk *walk, const U8 head[GIT_OID_SIZE], const U8 upstream[GIT_OID_SIZE],
+               U32 *ahead, U32 *behind)
+{
+    *ahead = *behind = 0;
+    if(!git_walk_paint(walk, git_walk_get(walk, head, GIT_GRAPH_POSITION_NONE), GIT_WALK_FROM_HEAD) ||
+       !git_walk_paint(walk, git_walk_get(walk, upstream, GIT_GRAPH_POSITION_NONE), GIT_WALK_FROM_UPSTREAM))
+        return false;
+
+    while(walk->nonstale > 0 && walk->heap_count > 0)
+    {
+        U32 index = git_walk_pop(walk);
+        U8 flags = walk->commits[index].flags;
+        if(flags != GIT_WALK_STALE)
+        {
+            walk->nonstale--;
+            if(flags == GIT_WALK_FROM_HEAD) *ahead += 1;
+            else *behind += 1;
+        }
+
+        // Copy what we need: painting may grow (move) the commit array
+        U32 graph_position = walk->commits[index].graph_position;
+        U32 parent_offset = walk->commits[index].parent_offset;
+        U32 parent_count = walk->commits[index].parent_count;
+
+        if(graph_position == GIT_GRAPH_POSITION_NONE)
+        {
+            for(U32 parent = 0; parent < parent_count; parent++)
+            {
+                U8 parent_oid[GIT_OID_SIZE];
+                memcpy(parent_oid, walk->parent_oids + (U64)(parent_offset + parent)*GIT_OID_SIZE, GIT_OID_SIZE);
+                if(!git_walk_paint(walk, git_walk_get(walk, parent_oid, GIT_GRAPH_POSITION_NONE), flags)) return false;
+            }
+            continue;
+        }
+
+        const Git_Graph_Layer *layer = git_graph_layer_for(walk->graph, graph_position);
+        U32 local = graph_position - layer->first_position;
+        const U8 *data = layer->commit_data + (U64)local*GIT_GRAPH_COMMIT_DATA_SIZE;
+        U32 parents[2] = {read_u32_be(data + GIT_OID_SIZE), read_u32_be(data + GIT_OID_SIZE + 4)};
+        for(int slot = 0; slot < 2; slot++)
+        {
+            U32 value = parents[slot];
+            if(value == GIT_GRAPH_PARENT_NONE) continue;
+
+            U64 edge = 0;
+            B32 more = false;
+            if(slot == 1 && (value & GIT_GRAPH_EXTRA_EDGES))
+            {
+                // Octopus merge: second and later parents in the EDGE chunk
+                edge = value & ~GIT_GRAPH_EXTRA_EDGES;
+                if(edge >= layer->extra_edge_count) return false;
+                value = read_u32_be(layer->extra_edges + edge*4);
+                more = true;
+            }
+            for(;;)
+            {
+                U32 parent_position = value & ~GIT_GRAPH_EXTRA_EDGES;
+                const Git_Graph_Layer *parent_layer = git_graph_layer_for(walk->graph, parent_position);
+                if(parent_layer == NULL) return false;
+                const U8 *parent_oid = parent_layer->oids + (U64)(parent_position - parent_layer->first_position)*GIT_OID_SIZE;
+                if(!git_walk_paint(walk, git_walk_get(walk, parent_oid, parent_position), flags)) return false;
+
+                if(!more || (value & GIT_GRAPH_EXTRA_EDGES)) break;
+                if(++edge >= layer->extra_edge_count) return false;
+                value = read_u32_be(layer->extra_edges + edge*4);
+            }
+        }
+    }
+    return true;
+}
+
+// branch.<branch_name>.remote/.merge -> the upstream's full ref name
+internal B32
+git_config_upstream(const char *common_directory, const char *branch_name, char *upstream, U64 upstream_capacity)
+{
+    char path[600];
+    path_join(path, sizeof(path), common_directory, "/config");
+    U64 config_size;
+    const U8 *config = map_file(path, &config_size);
+    if(config == NULL) return false;
+
+    char remote[128] = "", merge[256] = "";
+    B32 in_branch = false;
+    U64 branch_length = strlen(branch_name);
+    const char *line = (const char *)config;
+    const char *config_end = line + config_size;
+    while(line < config_end)
+    {
+        const char *newline = memchr(line, '\n', (U64)(config_end - line));
+        const char *line_end = newline ? newline : config_end;
+        while(line < line_end && (*line == ' ' || *line == '\t')) line++;
+
+        if(line < line_end && *line == '[')
+        {
+            // [branch "name"]: section names are case-insensitive, subsections not
+            in_branch = line_end - line >= 11 + (S64)branch_length && strncasecmp(line + 1, "branch \"", 8) == 0 &&
+                        memcmp(line + 9, branch_name, branch_length) == 0 &&
+                        memcmp(line + 9 + branch_length, "\"]", 2) == 0;
+        }
+        else if(in_branch && line < line_end && *line != '#' && *line != ';')
+        {
+            const char *equals = memchr(line, '=', (U64)(line_end - line));
+            if(equals)
+            {
+                const char *key_end = equals;
+                while(key_end > line && (key_end[-1] == ' ' || key_end[-1] == '\t')) key_end--;
+                const char *value = equals + 1;
+                const char *value_end = line_end;
+                while(value < value_end && (*value == ' ' || *value == '\t' || *value == '"')) value++;
+                while(value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t' ||
+                                            value_end[-1] == '\r' || value_end[-1] == '"')) value_end--;
+                U64 key_length = (U64)(key_end - line);
+                U64 value_length = (U64)(value_end - value);
+
+                char *target = NULL;
+                U64 target_capacity = 0;
+                if(key_length == 6 && strncasecmp(line, "remote", 6) == 0) { target = remote; target_capacity = sizeof(remote); }
+                if(key_length == 5 && strncasecmp(line, "merge", 5) == 0)  { target = merge;  target_capacity = sizeof(merge); }
+                if(target && value_length < target_capacity)
+                {
+                    memcpy(target, value, value_length);
+                    target[value_length] = '\0';
+                }
+            }
+        }
+        line = line_end + 1;
+    }
+    munmap((void *)config, config_size);
+
+    if(remote[0] == '\0' || merge[0] == '\0') return false;
+    String_Builder upstream_name = string_builder(upstream, upstream_capacity);
+    if(strcmp(remote, ".") == 0) string_append_cstring(&upstream_name, merge);
+    else if(strncmp(merge, "refs/heads/", 11) == 0)
+    {
+        string_append_literal(&upstream_name, "refs/remotes/");
+        string_append_cstring(&upstream_name, remote);
+        string_append_char(&upstream_name, '/');
+        string_append_cstring(&upstream_name, merge + 11);
+    }
+    else return false;
+    return upstream_name.length > 0 && upstream_name.length < upstream_capacity;
+}
+
+// Fill ahead/behind for repo's HEAD. No upstream (or a detached HEAD, or an
+// upstream that is gone) counts as 0/0, like git. Returns false to defer to git.
+internal B32
+git_ahead_behind(const Git_Repo *repo, U32 *out_ahead, U32 *out_behind)
+{
+    char path[600];
+    path_join(path, sizeof(path), repo->git_directory, "/HEAD");
+    int file_desc = open(path, O_RDONLY | O_CLOEXEC);
+    if(file_desc < 0) return false;
+    char head[512];
+    ssize_t bytes_read = read(file_desc, head, sizeof(head) - 1);
+    close(file_desc);
+    if(bytes_read <= 0) return false;
+    head[bytes_read] = '\0';
+    while(bytes_read > 0 && (head[bytes_read-1] == '\n' || head[bytes_read-1] == '\r' || head[bytes_read-1] == ' '))
+        head[--bytes_read] = '\0';
+
+    char upstream_ref[512];
+    U8 head_oid[GIT_OID_SIZE], upstream_oid[GIT_OID_SIZE];
+    if(strncmp(head, "ref: refs/heads/", 16) != 0 ||
+       !git_config_upstream(repo->common_directory, head + 16, upstream_ref, sizeof(upstream_ref)) ||
+       !git_resolve_ref(repo->common_directory, head + 5, head_oid) ||
+       !git_resolve_ref(repo->common_directory, upstream_ref, upstream_oid) ||
+       memcmp(head_oid, upstream_oid, GIT_OID_SIZE) == 0)
+    {
+        *out_ahead = *out_behind = 0;
+        return true;
+    }
+
+    Git_Commit_Graph graph;
+    if(!git_graph_open(&graph, repo->common_directory)) return false;
+
+    Git_Walk walk;
+    memset(&walk, 0, sizeof(walk));
+    walk.graph = &graph;
+    walk.common_directory = repo->common_directory;
+    U32 ahead, behind;
+    B32 ok = git_walk_count(&walk, head_oid, upstream_oid, &ahead, &behind);
+
+    if(walk.store_open) git_store_close(&walk.store);
+    free(walk.commits);
+    free(walk.table);
+    free(walk.heap);
+    free(walk.stack);
+    free(walk.parent_oids);
+    git_graph_close(&graph);
+    if(ok) { *out_ahead = ahead; *out_behind = behind; }
+    return ok;
+}
+
+//~ Git Index Engine
+//
+// Computes the `staged` and `modified` counts of `git status --porcelain -uno`
+// without spawning git:
+//   - mmaps .git/index (DIRC v2-v4, v4 prefix-compressed paths, split index
+//     via the `link` extension and sharedindex.<oid>)
+//   - staged: merge-walks the index against HEAD's tree, skipping any
+//     subtree whose cache-tree (TREE extension) oid matches; exact renames
+//     count once, like git's rename detection for identical content
+//   - modified: lstat of every entry, spread over a small thread pool,
+//     with git's racy-git rule (entries not older than the index itself get
+//     a content hash) and content hashing whenever stat data is ambiguous
+// Sparse indexes, SHA-256 repos, content filters on ambiguous entries and
+// unreadable objects all make the engine give up so git can answer instead.
+
+#define GIT_ENGINE_THREADS        4
+#define GIT_ENGINE_PARALLEL_MIN   2048
+#define GIT_ENGINE_CHUNK          256
+#define GIT_ENGINE_STALE_MAX      20000  // synchronous refresh limit on a stale cache
+
+#define GIT_INDEX_FLAG_ASSUME_VALID  0x8000
+#define GIT_INDEX_FLAG_EXTENDED      0x4000
+#define GIT_INDEX_FLAG_STAGE_MASK    0x3000
+#define GIT_INDEX_FLAG_NAME_MASK     0x0fff
+#define GIT_INDEX_EXT_SKIP_WORKTREE  0x4000
+#define GIT_INDEX_EXT_INTENT_TO_ADD  0x2000
+
+#define GIT_MODE_TYPE_MASK  0170000
+#define GIT_MODE_FILE       0100000
+#define GIT_MODE_SYMLINK    0120000
+#define GIT_MODE_GITLINK    0160000
+#define GIT_MODE_TREE       0040000
+
+typedef struct Git_Index_Entry Git_Index_Entry;
+struct Git_Index_Entry
+{
+    const char *path;
+    U32 path_length;
+    U32 ctime_sec, ctime_nsec;
+    U32 mtime_sec, mtime_nsec;
+    U32 ino, mode, uid, gid, size;
+    U16 flags, extended_flags;
+    U8  oid[GIT_OID_SIZE];
+};
+
+typedef struct Git_Cache_Tree Git_Cache_Tree;
+struct Git_Cache_Tree
+{
+    const char     *name;
+    U32             name_length;
+    S32             entry_count;   // -1: invalidated
+    U32             child_count;
+    const U8       *oid;
+    Git_Cache_Tree *children;
+};
+
+typedef struct Git_Arena_Block Git_Arena_Block;
+struct Git_Arena_Block
+{
+    Git_Arena_Block *next;
+    U64              used, capacity;
+    U8               data[];
+};
+
+typedef struct Git_Index Git_Index;
+struct Git_Index
+{
+    Git_Index_Entry *entries;
+    U32              entry_count;
+    Git_Cache_Tree  *cache_tree;
+    S64              mtime_sec, mtime_nsec;
+    Git_Arena_Block *arena;
+    const U8        *mappings[2];
+    U64              mapping_sizes[2];
+};
+
+internal void *
+git_arena_push(Git_Arena_Block **arena, U64 size)
+{
+    size = (size + 7) & ~(U64)7;
+    if(*arena == NULL || (*arena)->used + size > (*arena)->capacity)
+    {
+        U64 capacity = Max(size, (U64)65536);
+        Git_Arena_Block *block = malloc(sizeof(Git_Arena_Block) + capacity);
+        if(block == NULL) return NULL;
+        block->next = *arena;
+        block->used = 0;
+        block->capacity = capacity;
+        *arena = block;
+    }
+    void *result = (*arena)->data + (*arena)->used;
+    (*arena)->used += size;
+    return result;
+}
+
+internal void
+git_index_free(Git_Index *index)
+{
+    free(index->entries);
+    while(index->arena) { Git_Arena_Block *next = index->arena->next; free(index->arena); index->arena = next; }
+    for(int mapping = 0; mapping < 2; mapping++)
+        if(index->mappings[mapping]) munmap((void *)index->mappings[mapping], index->mapping_sizes[mapping]);
+    memset(index, 0, sizeof(*index));
+}
+
+internal Git_Cache_Tree *
+git_parse_cache_tree(const U8 **cursor, const U8 *end, Git_Arena_Block **arena, int depth)
+{
+    if(depth > 256) return NULL;
+    const U8 *name_end = memchr(*cursor, '\0', (U64)(end - *cursor));
+    if(name_end == NULL) return NULL;
+
+    Git_Cache_Tree *node = git_arena_push(arena, sizeof(Git_Cache_Tree));
+    if(node == NULL) return NULL;
+    node->name = (const char *)*cursor;
+    node->name_length = (U32)(name_end - *cursor);
+
+    char *number_end;
+    node->entry_count = (S32)strtol((const char *)name_end + 1, &number_end, 10);
+    if(*number_end != ' ') return NULL;
+    node->child_count = (U32)strtoul(number_end + 1, &number_end, 10);
+    if(*number_end != '\n') return NULL;
+    *cursor = (const U8 *)number_end + 1;
+
+    node->oid = NULL;
+    if(node->entry_count >= 0)
+    {
+        if(*cursor + GIT_OID_SIZE > end) return NULL;
+        node->oid = *cursor;
+        *cursor += GIT_OID_SIZE;
+    }
+
+    node->children = node->child_count ? git_arena_push(arena, sizeof(Git_Cache_Tree) * node->child_count) : NULL;
+    for(U32 child = 0; child < node->child_count; child++)
+    {
+        Git_Cache_Tree *parsed = git_parse_cache_tree(cursor, end, arena, depth + 1);
+        if(parsed == NULL || node->children == NULL) return NULL;
+        node->children[child] = *parsed;
+    }
+    return node;
+}
+
+// Decode an EWAH bitmap (split index delete/replace sets) into one byte per bit
+internal B32
+git_ewah_decode(const U8 **cursor, const U8 *end, U8 **bits, U32 *bit_count)
+{
+    if(*cursor + 8 > end) return false;
+    *bit_count = read_u32_be(*cursor);
+    U32 word_count = read_u32_be(*cursor + 4);
+    const U8 *words = *cursor + 8;
+    if(words + (U64)word_count*8 + 4 > end) return false;
+
+    *bits = calloc((U64)*bit_count + 64, 1);
+    if(*bits == NULL) return false;
+
+    U64 position = 0;
+    for(U32 word = 0; word < word_count;)
+    {
+        U64 marker = read_u64_be(words + (U64)word*8);
+        U64 running_length = (marker >> 1) & 0xffffffffu;
+        U32 literal_count = (U32)(marker >> 33);
+        if(marker & 1)
+            for(U64 bit = 0; bit < running_length*64 && position + bit < *bit_count; bit++)
+                (*bits)[position + bit] = 1;
+        position += running_length*64;
+        word++;
+        for(U32 literal = 0; literal < literal_count && word < word_count; literal++, word++)
+        {
+            U64 value = read_u64_be(words + (U64)word*8);
+            for(int bit = 0; bit < 64; bit++)
+                if((value >> bit) & 1 && position + bit < *bit_count) (*bits)[position + bit] = 1;
+            position += 64;
+        }
+    }
+    *cursor = words + (U64)word_count*8 + 4;
+    return true;
+}
+
+typedef struct Git_Index_File Git_Index_File;
+struct Git_Index_File
+{
+    Git_Index_Entry *entries;
+    U32              entry_count;
+    Git_Cache_Tree  *cache_tree;
+    B32              has_link;
+    U8               shared_oid[GIT_OID_SIZE];
+    U8              *delete_bits;  U32 delete_count;
+    U8              *replace_bits; U32 replace_count;
+};
+
+internal B32
+git_parse_index_file(const U8 *data, U64 size, Git_Arena_Block **arena, Git_Index_File *file)
+{
+    memset(file, 0, sizeof(*file));
+    if(size < 12 + GIT_OID_SIZE || memcmp(data, "DIRC", 4) != 0) return false;
+    U32 version = read_u32_be(data + 4);
+    if(version < 2 || version > 4) return false;
+    file->entry_count = read_u32_be(data + 8);
+
+    const U8 *end = data + size - GIT_OID_SIZE;
+    const U8 *cursor = data + 12;
+    file->entries = malloc(sizeof(Git_Index_Entry) * Max(file->entry_count, 1u));
+    if(file->entries == NULL) return false;
+
+    char previous_path[4096];
+    U64 previous_length = 0;
+    for(U32 index = 0; index < file->entry_count; index++)
+    {
+        const U8 *entry_start = cursor;
+        if(cursor + 62 > end) return false;
+        Git_Index_Entry *entry = &file->entries[index];
+        entry->ctime_sec  = read_u32_be(cursor);
+        entry->ctime_nsec = read_u32_be(cursor + 4);
+        entry->mtime_sec  = read_u32_be(cursor + 8);
+        entry->mtime_nsec = read_u32_be(cursor + 12);
+        entry->ino        = read_u32_be(cursor + 20);
+        entry->mode       = read_u32_be(cursor + 24);
+        entry->uid        = read_u32_be(cursor + 28);
+        entry->gid        = read_u32_be(cursor + 32);
+        entry->size       = read_u32_be(cursor + 36);
+        memcpy(entry->oid, cursor + 40, GIT_OID_SIZE);
+        entry->flags = (U16)(cursor[60] << 8 | cursor[61]);
+        cursor += 62;
+        entry->extended_flags = 0;
+        if((entry->flags & GIT_INDEX_FLAG_EXTENDED) && version >= 3)
+        {
+            if(cursor + 2 > end) return false;
+            entry->extended_flags = (U16)(cursor[0] << 8 | cursor[1]);
+            cursor += 2;
+        }
+
+        if(version == 4)
+        {
+            // Path = previous path minus N trailing bytes, plus a NUL-terminated suffix
+            U64 strip = git_delta_varint(&cursor, end);
+            const U8 *suffix_end = memchr(cursor, '\0', (U64)(end - cursor));
+            if(suffix_end == NULL || strip > previous_length) return false;
+            U64 suffix_length = (U64)(suffix_end - cursor);
+            U64 keep = previous_length - strip;
+            if(keep + suffix_length >= sizeof(previous_path)) return false;
+            memcpy(previous_path + keep, cursor, suffix_length);
+            previous_length = keep + suffix_length;
+            cursor = suffix_end + 1;
+
+            char *path = git_arena_push(arena, previous_length + 1);
+            if(path == NULL) return false;
+            memcpy(path, previous_path, previous_length);
+            path[previous_length] = '\0';
+            entry->path = path;
+            entry->path_length = (U32)previous_length;
+        }
+        else
+        {
+            const U8 *path_end = memchr(cursor, '\0', (U64)(end - cursor));
+            if(path_end == NULL) return false;
+            entry->path = (const char *)cursor;
+            entry->path_length = (U32)(path_end - cursor);
+            // Entries are NUL-padded to a multiple of 8 bytes
+            U64 entry_length = (U64)(path_end - entry_start) + 1;
+            cursor = entry_start + ((entry_length + 7) & ~(U64)7);
+            if(cursor > end) return false;
+        }
+    }
+
+    // Extensions: 4-byte signature, 4-byte length. Lowercase = required.
+    while(cursor + 8 <= end)
+    {
+        const U8 *signature = cursor;
+        U32 extension_size = read_u32_be(cursor + 4);
+        const U8 *body = cursor + 8;
+        if(body + extension_size > end) return false;
+        const U8 *body_end = body + extension_size;
+
+        if(memcmp(signature, "TREE", 4) == 0)
+        {
+            const U8 *tree_cursor = body;
+            if(extension_size > 0) file->cache_tree = git_parse_cache_tree(&tree_cursor, body_end, arena, 0);
+        }
+        else if(memcmp(signature, "link", 4) == 0)
+        {
+            if(extension_size < GIT_OID_SIZE) return false;
+            file->has_link = true;
+            memcpy(file->shared_oid, body, GIT_OID_SIZE);
+            const U8 *bitmap_cursor = body + GIT_OID_SIZE;
+            if(bitmap_cursor < body_end)
+            {
+                if(!git_ewah_decode(&bitmap_cursor, body_end, &file->delete_bits, &file->delete_count)) return false;
+                if(!git_ewah_decode(&bitmap_cursor, body_end, &file->replace_bits, &file->replace_count)) return false;
+            }
+        }
+        else if(signature[0] >= 'a' && signature[0] <= 'z')
+            return false;  // sdir (sparse index) or something newer than us
+
+        cursor = body_end;
+    }
+    return true;
+}
+
+internal int
+git_index_entry_compare(const void *left, const void *right)
+{
+    const Git_Index_Entry *a = left, *b = right;
+    U32 common = Min(a->path_length, b->path_length);
+    int compare = memcmp(a->path, b->path, common);
+    if(compare) return compare;
+    if(a->path_length != b->path_length) return a->path_length < b->path_length ? -1 : 1;
+    return (int)(a->flags & GIT_INDEX_FLAG_STAGE_MASK) - (int)(b->flags & GIT_INDEX_FLAG_STAGE_MASK);
+}
+
+internal B32
+git_index_load(const char *git_directory, Git_Index *index)
+{
+    memset(index, 0, sizeof(*index));
+    char path[600];
+    path_join(path, sizeof(path), git_directory, "/index");
+
+    int file_desc = open(path, O_RDONLY | O_CLOEXEC);
+    if(file_desc < 0) return false;
+    struct stat index_stat;
+    if(fstat(file_desc, &index_stat) != 0 || index_stat.st_size <= 0) { close(file_desc); return false; }
+    void *mapping = mmap(NULL, (size_t)index_stat.st_size, PROT_READ, MAP_PRIVATE, file_desc, 0);
+    close(file_desc);
+    if(mapping == MAP_FAILED) return false;
+    index->mappings[0] = mapping;
+    index->mapping_sizes[0] = (U64)index_stat.st_size;
+    index->mtime_sec  = (S64)index_stat.st_mtim.tv_sec;
+    index->mtime_nsec = (S64)index_stat.st_mtim.tv_nsec;
+
+    Git_Index_File top;
+    if(!git_parse_index_file(mapping, (U64)index_stat.st_size, &index->arena, &top)) goto fail_top;
+    index->cache_tree = top.cache_tree;
+
+    if(!top.has_link)
+    {
+        index->entries = top.entries;
+        index->entry_count = top.entry_count;
+        return true;
+    }
+
+    // Split index: start from the shared base, drop deleted entries,
+    // overwrite replaced ones (in order) and append the rest
+    char hex[GIT_OID_SIZE*2 + 1];
+    git_oid_to_hex(top.shared_oid, hex);
+    String_Builder shared_path = string_builder(path, sizeof(path));
+    string_append_cstring(&shared_path, git_directory);
+    string_append_literal(&shared_path, "/sharedindex.");
+    string_append_cstring(&shared_path, hex);
+    index->mappings[1] = map_file(path, &index->mapping_sizes[1]);
+    Git_Index_File base;
+    if(index->mappings[1] == NULL ||
+       !git_parse_index_file(index->mappings[1], index->mapping_sizes[1], &index->arena, &base))
+        goto fail_top;
+    if(base.has_link) goto fail_base;
+
+    index->entries = malloc(sizeof(Git_Index_Entry) * ((U64)base.entry_count + top.entry_count + 1));
+    if(index->entries == NULL) goto fail_base;
+
+    U32 replacement = 0;
+    for(U32 base_index = 0; base_index < base.entry_count; base_index++)
+    {
+        if(top.delete_bits && base_index < top.delete_count && top.delete_bits[base_index]) continue;
+
+        Git_Index_Entry entry = base.entries[base_index];
+        if(top.replace_bits && base_index < top.replace_count && top.replace_bits[base_index])
+        {
+            if(replacement >= top.entry_count) goto fail_base;
+            const char *kept_path = entry.path;
+            U32 kept_length = entry.path_length;
+            U16 kept_name_flags = entry.flags & GIT_INDEX_FLAG_NAME_MASK;
+            entry = top.entries[replacement++];
+            entry.path = kept_path;
+            entry.path_length = kept_length;
+            entry.flags = (U16)((entry.flags & ~GIT_INDEX_FLAG_NAME_MASK) | kept_name_flags);
+        }
+        index->entries[index->entry_count++] = entry;
+    }
+    for(U32 added = replacement; added < top.entry_count; added++)
+        index->entries[index->entry_count++] = top.entries[added];
+
+    qsort(index->entries, index->entry_count, sizeof(Git_Index_Entry), git_index_entry_compare);
+
+    // An added entry supersedes a base entry at the same path and stage
+    U32 unique = 0;
+    for(U32 entry = 0; entry < index->entry_count; entry++)
+    {
+        if(unique > 0 && git_index_entry_compare(&index->entries[unique - 1], &index->entries[entry]) == 0)
+            index->entries[unique - 1] = index->entries[entry];
+        else
+            index->entries[unique++] = index->entries[entry];
+    }
+    index->entry_count = unique;
+
+    free(base.entries); free(base.delete_bits); free(base.replace_bits);
+    free(top.entries);  free(top.delete_bits);  free(top.replace_bits);
+    return true;
+
+fail_base:
+    free(base.entries); free(base.delete_bits); free(base.replace_bits);
+fail_top:
+    free(top.entries); free(top.delete_bits); free(top.replace_bits);
+    index->entries = NULL;
+    git_index_free(index);
+    return false;
+}
+
+//~ Git Index Engine: HEAD Tree Diff
+
+typedef struct Git_Tree_Diff Git_Tree_Diff;
+struct Git_Tree_Diff
+{
+    Git_Object_Store *store;
+    Git_Index        *index;
+    U32               position;      // next index entry to consume
+    U32               staged;
+    U8               *added_oids;    U32 added_count;
+    U8               *deleted_oids;  U32 deleted_count;
+    B32               failed;
+};
+
+internal U32
+git_tree_mode_normalize(U32 mode)
+{
+    // Index modes are canonical; tree modes may be legacy (e.g. 100664)
+    switch(mode & GIT_MODE_TYPE_MASK)
+    {
+    case GIT_MODE_FILE:    return (mode & 0111) ? 0100755 : 0100644;
+    case GIT_MODE_SYMLINK: return GIT_MODE_SYMLINK;
+    case GIT_MODE_GITLINK: return GIT_MODE_GITLINK;
+    default:               return mode;
+    }
+}
+
+internal void
+git_diff_record(U8 **oids, U32 *count, const U8 *oid)
+{
+    if((*count & (*count - 1)) == 0 || *count == 0)
+    {
+        U8 *grown = realloc(*oids, (U64)Max(*count * 2, 16u) * GIT_OID_SIZE);
+        if(grown == NULL) return;
+        *oids = grown;
+    }
+    memcpy(*oids + (U64)*count * GIT_OID_SIZE, oid, GIT_OID_SIZE);
+    *count += 1;
+}
+
+// Compare index path against prefix+name (+ '/' for directories) in git order
+internal int
+git_path_compare(const Git_Index_Entry *entry, const char *prefix, U32 prefix_length,
+                 const char *name, U32 name_length, B32 directory)
+{
+    U32 total = prefix_length + name_length + (directory ? 1 : 0);
+    U32 compare_length = Min(entry->path_length, total);
+    for(U32 offset = 0; offset < compare_length; offset++)
+    {
+        U8 expected = offset < prefix_length ? (U8)prefix[offset]
+                    : offset < prefix_length + name_length ? (U8)name[offset - prefix_length] : (U8)'/';
+        U8 actual = (U8)entry->path[offset];
+        if(actual != expected) return actual < expected ? -1 : 1;
+    }
+    if(entry->path_length == total) return 0;
+    return entry->path_length < total ? -1 : 1;
+}
+
+internal B32
+git_entry_has_prefix(const Git_Index_Entry *entry, const char *prefix, U32 prefix_length)
+{
+    return entry->path_length >= prefix_length && memcmp(entry->path, prefix, prefix_length) == 0;
+}
+
+// Consume one index path (all its stages) as "added". Unmerged paths are
+// counted by the worktree pass, so only stage-0 entries count here.
+internal void
+git_diff_consume_added(Git_Tree_Diff *diff)
+{
+    Git_Index_Entry *entry = &diff->index->entries[diff->position];
+    U32 next = diff->position + 1;
+    while(next < diff->index->entry_count &&
+          diff->index->entries[next].path_length == entry->path_length &&
+          memcmp(diff->index->entries[next].path, entry->path, entry->path_length) == 0)
+        next++;
+
+    B32 unmerged = (entry->flags & GIT_INDEX_FLAG_STAGE_MASK) != 0 || next - diff->position > 1;
+    if(!unmerged && !(entry->extended_flags & GIT_INDEX_EXT_INTENT_TO_ADD))
+    {
+        diff->staged++;
+        git_diff_record(&diff->added_oids, &diff->added_count, entry->oid);
+    }
+    diff->position = next;
+}
+
+internal const Git_Cache_Tree *
+git_cache_tree_child(const Git_Cache_Tree *node, const char *name, U32 name_length)
+{
+    if(node == NULL) return NULL;
+    for(U32 child = 0; child < node->child_count; child++)
+        if(node->children[child].name_length == name_length &&
+           memcmp(node->children[child].name, name, name_length) == 0)
+            return &node->children[child];
+    return NULL;
+}
+
+internal void
+git_diff_tree(Git_Tree_Diff *diff, const U8 tree_oid[GIT_OID_SIZE], char *prefix, U32 prefix_length,
+              const Git_Cache_Tree *cache_node, int depth)
+{
+    if(diff->failed) return;
+    if(depth > 256) { diff->failed = true; return; }
+
+    enum Git_Object_Type type;
+    U64 tree_size;
+    U8 *tree = git_store_read(diff->store, tree_oid, &type, &tree_size);
+    if(tree == NULL || type != GIT_OBJECT_TREE) { free(tree); diff->failed = true; return; }
+
+    Git_Index *index = diff->index;
+    const U8 *cursor = tree, *end = tree + tree_size;
+    while(cursor < end && !diff->failed)
+    {
+        // Tree entry: "<octal mode> <name>\0<20-byte oid>"
+        U32 mode = 0;
+        while(cursor < end && *cursor >= '0' && *cursor <= '7') mode = mode*8 + (U32)(*cursor++ - '0');
+        if(cursor >= end || *cursor++ != ' ') { diff->failed = true; break; }
+        const char *name = (const char *)cursor;
+        const U8 *name_end = memchr(cursor, '\0', (U64)(end - cursor));
+        if(name_end == NULL || name_end + 1 + GIT_OID_SIZE > end) { diff->failed = true; break; }
+        U32 name_length = (U32)(name_end - cursor);
+        if(prefix_length + name_length + 2 > 4096) { diff->failed = true; break; }
+        const U8 *entry_oid = name_end + 1;
+        cursor = entry_oid + GIT_OID_SIZE;
+        B32 directory = (mode & GIT_MODE_TYPE_MASK) == GIT_MODE_TREE;
+
+        // Index paths sorting before this entry exist only in the index
+        while(diff->position < index->entry_count &&
+              git_path_compare(&index->entries[diff->position], prefix, prefix_length, name, name_length, directory) < 0)
+            git_diff_consume_added(diff);
+
+        if(directory)
+        {
+            const Git_Cache_Tree *child = git_cache_tree_child(cache_node, name, name_length);
+            if(child && child->entry_count >= 0 && memcmp(child->oid, entry_oid, GIT_OID_SIZE) == 0 &&
+               diff->position + (U32)child->entry_count <= index->entry_count)
+            {
+                // Cache-tree says the index subtree hashes to HEAD's subtree
+                diff->position += (U32)child->entry_count;
+                continue;
+            }
+
+            memcpy(prefix + prefix_length, name, name_length);
+            prefix[prefix_length + name_length] = '/';
+            git_diff_tree(diff, entry_oid, prefix, prefix_length + name_length + 1, child, depth + 1);
+
+            // Anything left under this directory is index-only
+            while(diff->position < index->entry_count &&
+                  git_entry_has_prefix(&index->entries[diff->position], prefix, prefix_length + name_length + 1))
+                git_diff_consume_added(diff);
+            continue;
+        }
+
+        if(diff->position < index->entry_count &&
+           git_path_compare(&index->entries[diff->position], prefix, prefix_length, name, name_length, false) == 0)
+        {
+            Git_Index_Entry *entry = &index->entries[diff->position];
+            U32 next = diff->position + 1;
+            while(next < index->entry_count && index->entries[next].path_length == entry->path_length &&
+                  memcmp(index->entries[next].path, entry->path, entry->path_length) == 0)
+                next++;
+            B32 unmerged = (entry->flags & GIT_INDEX_FLAG_STAGE_MASK) != 0 || next - diff->position > 1;
+            if(!unmerged && (memcmp(entry->oid, entry_oid, GIT_OID_SIZE) != 0 ||
+                             entry->mode != git_tree_mode_normalize(mode)))
+                diff->staged++;
+            diff->position = next;
+        }
+        else
+        {
+            diff->staged++;
+            git_diff_record(&diff->deleted_oids, &diff->deleted_count, entry_oid);
+        }
+    }
+    free(tree);
+}
+
+internal int
+git_oid_compare(const void *left, const void *right)
+{
+    return memcmp(left, right, GIT_OID_SIZE);
+}
+
+// Count index entries that differ from HEAD's tree
+internal B32
+git_engine_staged(const Git_Repo *repo, Git_Index *index, U32 *staged)
+{
+    B32 unborn;
+    U8 commit_oid[GIT_OID_SIZE];
+    if(!git_resolve_head(repo, commit_oid, &unborn)) return false;
+
+    Git_Tree_Diff diff;
+    memset(&diff, 0, sizeof(diff));
+    diff.index = index;
+
+    if(unborn)
+    {
+        while(diff.position < index->entry_count) git_diff_consume_added(&diff);
+        *staged = diff.staged;
+        free(diff.added_oids);
+        return true;
+    }
+
+    Git_Object_Store store;
+    git_store_open(&store, repo->common_directory);
+    diff.store = &store;
+
+    enum Git_Object_Type type;
+    U64 commit_size;
+    U8 *commit = git_store_read(&store, commit_oid, &type, &commit_size);
+    U8 tree_oid[GIT_OID_SIZE];
+    B32 ok = commit && type == GIT_OBJECT_COMMIT && commit_size > 45 &&
+             memcmp(commit, "tree ", 5) == 0 && git_oid_from_hex((const char *)commit + 5, tree_oid);
+    free(commit);
+
+    if(ok)
+    {
+        // Clean index: the root cache-tree already hashes to HEAD's tree
+        if(index->cache_tree && index->cache_tree->entry_count == (S32)index->entry_count &&
+           memcmp(index->cache_tree->oid, tree_oid, GIT_OID_SIZE) == 0)
+            diff.position = index->entry_count;
+        else
+        {
+            char prefix[4096];
+            git_diff_tree(&diff, tree_oid, prefix, 0, index->cache_tree, 0);
+            while(!diff.failed && diff.position < index->entry_count) git_diff_consume_added(&diff);
+        }
+        ok = !diff.failed;
+    }
+
+    if(ok)
+    {
+        // Exact renames: a deleted and an added path with the same blob
+        qsort(diff.added_oids, diff.added_count, GIT_OID_SIZE, git_oid_compare);
+        qsort(diff.deleted_oids, diff.deleted_count, GIT_OID_SIZE, git_oid_compare);
+        U32 added = 0, deleted = 0;
+        while(added < diff.added_count && deleted < diff.deleted_count)
+        {
+            int compare = memcmp(diff.added_oids + (U64)added*GIT_OID_SIZE,
+                                 diff.deleted_oids + (U64)deleted*GIT_OID_SIZE, GIT_OID_SIZE);
+            if(compare == 0) { diff.staged--; added++; deleted++; }
+            else if(compare < 0) added++;
+            else deleted++;
+        }
+        *staged = diff.staged;
+    }
+
+    free(diff.added_oids);
+    free(diff.deleted_oids);
+    git_store_close(&store);
+    return ok;
+}
+
+//~ Git Index Engine: Worktree Pass
+
+// GIT_ENTRY_SUBMODULE: checked out at the recorded commit, so dirty only if
+// its own status is; resolved after the pass.
+enum Git_Entry_Result { GIT_ENTRY_CLEAN, GIT_ENTRY_MODIFIED, GIT_ENTRY_UNKNOWN, GIT_ENTRY_SKIPPED, GIT_ENTRY_SUBMODULE };
+
+typedef struct Git_Worktree_Pass Git_Worktree_Pass;
+struct Git_Worktree_Pass
+{
+    const Git_Repo *repo;
+    Git_Index *index;
+    int        worktree_fd;
+    B32        has_filters;         // .gitattributes/autocrlf: hashing can't be trusted
+    B32        ignores_submodules;  // ignore= settings: leave gitlinks to git
+    U8        *results;
+    U32        next_chunk;      // atomic work counter
+};
+
+// Hash worktree content as a blob and compare with the index oid
+internal enum Git_Entry_Result
+git_entry_compare_content(Git_Worktree_Pass *pass, const Git_Index_Entry *entry, const struct stat *file_stat)
+{
+    if(pass->has_filters) return GIT_ENTRY_UNKNOWN;
+
+    Sha1_Context context;
+    sha1_init(&context);
+    char header[32];
+    U64 header_length = string_number(header, sizeof(header), "blob ", (S64)file_stat->st_size, "");
+    sha1_update(&context, header, (U64)header_length + 1);
+
+    if(S_ISLNK(file_stat->st_mode))
+    {
+        char target[4096];
+        ssize_t target_length = readlinkat(pass->worktree_fd, entry->path, target, sizeof(target));
+        if(target_length < 0 || target_length != file_stat->st_size) return GIT_ENTRY_UNKNOWN;
+        sha1_update(&context, target, (U64)target_length);
+    }
+    else
+    {
+        int file_desc = openat(pass->worktree_fd, entry->path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if(file_desc < 0) return GIT_ENTRY_UNKNOWN;
+        U64 total = 0;
+        char buffer[16384];
+        for(;;)
+        {
+            ssize_t bytes_read = read(file_desc, buffer, sizeof(buffer));
+            if(bytes_read < 0) { close(file_desc); return GIT_ENTRY_UNKNOWN; }
+            if(bytes_read == 0) break;
+            sha1_update(&context, buffer, (U64)bytes_read);
+            total += (U64)bytes_read;
+        }
+        close(file_desc);
+        if(total != (U64)file_stat->st_size) return GIT_ENTRY_UNKNOWN;  // changed under us
+    }
+
+    U8 digest[GIT_OID_SIZE];
+    sha1_final(&context, digest);
+    return memcmp(digest, entry->oid, GIT_OID_SIZE) == 0 ? GIT_ENTRY_CLEAN : GIT_ENTRY_MODIFIED;
+}
+
+// Resolve the submodule checked out at a gitlink. GIT_ENTRY_CLEAN when it
+// isn't checked out (git reports that clean), GIT_ENTRY_SUBMODULE when
+// `submodule` was filled in.
+internal enum Git_Entry_Result
+git_gitlink_repo(const Git_Repo *repo, const Git_Index_Entry *entry, Git_Repo *submodule)
+{
+    memset(submodule, 0, sizeof(*submodule));
+    String_Builder worktree = string_builder(submodule->worktree, sizeof(submodule->worktree));
+    string_append_cstring(&worktree, repo->worktree);
+    string_append_char(&worktree, '/');
+    string_append(&worktree, entry->path, entry->path_length);
+    if(worktree.length >= sizeof(submodule->worktree)) return GIT_ENTRY_UNKNOWN;
+
+    char dotgit[sizeof(submodule->worktree) + 8];
+    path_join(dotgit, sizeof(dotgit), submodule->worktree, "/.git");
+    struct stat dotgit_stat;
+    if(stat(dotgit, &dotgit_stat) != 0) return errno == ENOENT ? GIT_ENTRY_CLEAN : GIT_ENTRY_UNKNOWN;
+    return git_repo_resolve(dotgit, S_ISREG(dotgit_stat.st_mode), submodule) ? GIT_ENTRY_SUBMODULE : GIT_ENTRY_UNKNOWN;
+}
+
+// A submodule is modified when it is gone, its HEAD moved off the recorded
+// commit, or its own index/worktree is dirty (-uno ignores its untracked files)
+internal enum Git_Entry_Result
+git_entry_check_gitlink(Git_Worktree_Pass *pass, const Git_Index_Entry *entry)
+{
+    if(pass->ignores_submodules) return GIT_ENTRY_UNKNOWN;
+
+    struct stat file_stat;
+    if(fstatat(pass->worktree_fd, entry->path, &file_stat, AT_SYMLINK_NOFOLLOW) != 0)
+        return (errno == ENOENT || errno == ENOTDIR) ? GIT_ENTRY_MODIFIED : GIT_ENTRY_UNKNOWN;
+    if(!S_ISDIR(file_stat.st_mode)) return GIT_ENTRY_MODIFIED;
+
+    Git_Repo submodule;
+    enum Git_Entry_Result located = git_gitlink_repo(pass->repo, entry, &submodule);
+    if(located != GIT_ENTRY_SUBMODULE) return located;
+    B32 unborn;
+    U8 head_oid[GIT_OID_SIZE];
+    if(!git_resolve_head(&submodule, head_oid, &unborn) || unborn) return GIT_ENTRY_UNKNOWN;
+    return memcmp(head_oid, entry->oid, GIT_OID_SIZE) == 0 ? GIT_ENTRY_SUBMODULE : GIT_ENTRY_MODIFIED;
+}
+
+internal enum Git_Entry_Result
+git_entry_check(Git_Worktree_Pass *pass, const Git_Index_Entry *entry)
+{
+    if(entry->flags & GIT_INDEX_FLAG_ASSUME_VALID) return GIT_ENTRY_CLEAN;
+    if(entry->extended_flags & GIT_INDEX_EXT_SKIP_WORKTREE) return GIT_ENTRY_CLEAN;
+    if(entry->extended_flags & GIT_INDEX_EXT_INTENT_TO_ADD) return GIT_ENTRY_MODIFIED;
+    if((entry->mode & GIT_MODE_TYPE_MASK) == GIT_MODE_GITLINK) return git_entry_check_gitlink(pass, entry);
+
+    struct stat file_stat;
+    if(fstatat(pass->worktree_fd, entry->path, &file_stat, AT_SYMLINK_NOFOLLOW) != 0)
+        return (errno == ENOENT || errno == ENOTDIR) ? GIT_ENTRY_MODIFIED : GIT_ENTRY_UNKNOWN;
+
+    U32 entry_type = entry->mode & GIT_MODE_TYPE_MASK;
+    if(entry_type == GIT_MODE_SYMLINK ? !S_ISLNK(file_stat.st_mode) : !S_ISREG(file_stat.st_mode))
+        return GIT_ENTRY_MODIFIED;
+    if(entry_type == GIT_MODE_FILE && ((entry->mode & 0100) != 0) != ((file_stat.st_mode & S_IXUSR) != 0))
+        return GIT_ENTRY_MODIFIED;
+
+    B32 stat_matches =
+        entry->mtime_sec  == (U32)file_stat.st_mtim.tv_sec  &&
+        entry->mtime_nsec == (U32)file_stat.st_mtim.tv_nsec &&
+        entry->ctime_sec  == (U32)file_stat.st_ctim.tv_sec  &&
+        entry->ctime_nsec == (U32)file_stat.st_ctim.tv_nsec &&
+        entry->ino  == (U32)file_stat.st_ino &&
+        entry->uid  == (U32)file_stat.st_uid &&
+        entry->gid  == (U32)file_stat.st_gid &&
+        entry->size == (U32)file_stat.st_size;
+
+    if(stat_matches)
+    {
+        // Racy git: a file modified in the same timestamp tick as the index
+        // write can't be trusted on stat data alone
+        S64 index_sec = pass->index->mtime_sec, index_nsec = pass->index->mtime_nsec;
+        B32 racy = (S64)entry->mtime_sec > index_sec ||
+                   ((S64)entry->mtime_sec == index_sec && (S64)entry->mtime_nsec >= index_nsec);
+        return racy ? git_entry_compare_content(pass, entry, &file_stat) : GIT_ENTRY_CLEAN;
+    }
+
+    // Size 0 in the index may be a racily-clean smudge: compare content
+    if(entry->size != (U32)file_stat.st_size && entry->size != 0) return GIT_ENTRY_MODIFIED;
+    return git_entry_compare_content(pass, entry, &file_stat);
+}
+
+internal void *
+git_worktree_worker(void *argument)
+{
+    Git_Worktree_Pass *pass = argument;
+    U32 chunk_count = (pass->index->entry_count + GIT_ENGINE_CHUNK - 1) / GIT_ENGINE_CHUNK;
+    for(;;)
+    {
+        U32 chunk = __atomic_fetch_add(&pass->next_chunk, 1, __ATOMIC_RELAXED);
+        if(chunk >= chunk_count) break;
+        U32 first = chunk * GIT_ENGINE_CHUNK;
+        U32 last = Min(first + GIT_ENGINE_CHUNK, pass->index->entry_count);
+        for(U32 entry = first; entry < last; entry++)
+        {
+            if(pass->results[entry] == GIT_ENTRY_SKIPPED) continue;
+            pass->results[entry] = (U8)git_entry_check(pass, &pass->index->entries[entry]);
+        }
+    }
+    return NULL;
+}
+
+// Settings that make worktree bytes differ from what the engine hashes, or
+// submodule state differ from what it compares. Later files override
+// earlier ones, as in git.
+typedef struct Git_Engine_Config Git_Engine_Config;
+struct Git_Engine_Config
+{
+    B32  autocrlf, eol_crlf, safecrlf, object_format;
+    B32  ignores_submodules;   // diff.ignoreSubmodules, submodule.<name>.ignore
+    char attributes_file[PATH_MAX];
+};
+
+// A bare key is true; an empty value is false
+internal B32
+git_config_boolean(const char *value, U64 length)
+{
+    if(value == NULL) return true;
+    return !(length == 0 ||
+             (length == 1 && value[0] == '0') ||
+             (length == 2 && strncasecmp(value, "no", 2) == 0) ||
+             (length == 3 && strncasecmp(value, "off", 3) == 0) ||
+             (length == 5 && strncasecmp(value, "false", 5) == 0));
+}
+
+// Expand "~/..." and paths relative to the including file
+internal B32
+git_config_path(const char *value, U64 length, const char *config_path, char *output, U64 output_capacity)
+{
+    String_Builder path = string_builder(output, output_capacity);
+    if(length >= 2 && value[0] == '~' && value[1] == '/')
+    {
+        const char *home = getenv("HOME");
+        if(home == NULL) return false;
+        string_append_cstring(&path, home);
+        value++;
+        length--;
+    }
+    else if(length > 0 && value[0] != '/')
+    {
+        const char *slash = strrchr(config_path, '/');
+        if(slash) string_append(&path, config_path, (U64)(slash - config_path + 1));
+    }
+    string_append(&path, value, length);
+    return length > 0 && path.length + 1 < output_capacity;
+}
+
+#define GIT_CONFIG_INCLUDE_DEPTH 4
+
+internal B32
+git_config_name_char(char character)
+{
+    return (character >= 'a' && character <= 'z') || (character >= 'A' && character <= 'Z') ||
+           (character >= '0' && character <= '9') || character == '-';
+}
+
+internal B32
+git_attributes_space(char character)
+{
+    return character == ' ' || character == '\t' || character == '\r';
+}
+
+internal void
+git_config_scan(const char *path, Git_Engine_Config *config, int depth)
+{
+    U64 size;
+    const U8 *mapped = map_file(path, &size);
+    if(mapped == NULL) return;
+
+    enum { SECTION_OTHER, SECTION_CORE, SECTION_EXTENSIONS, SECTION_DIFF, SECTION_SUBMODULE, SECTION_INCLUDE } section = SECTION_OTHER;
+    const char *line = (const char *)mapped;
+    const char *config_end = line + size;
+    while(line < config_end)
+    {
+        const char *newline = memchr(line, '\n', (U64)(config_end - line));
+        const char *line_end = newline ? newline : config_end;
+        while(line < line_end && (*line == ' ' || *line == '\t')) line++;
+
+        if(line < line_end && *line == '[')
+        {
+            // [section], [section "subsection"]; section names are case-insensitive
+            const char *name = line + 1;
+            const char *name_end = name;
+            while(name_end < line_end && git_config_name_char(*name_end)) name_end++;
+            U64 name_length = (U64)(name_end - name);
+            B32 plain = name_end < line_end && *name_end == ']';
+            section = SECTION_OTHER;
+            if(plain && name_length == 4 && strncasecmp(name, "core", 4) == 0) section = SECTION_CORE;
+            if(plain && name_length == 10 && strncasecmp(name, "extensions", 10) == 0) section = SECTION_EXTENSIONS;
+            if(plain && name_length == 4 && strncasecmp(name, "diff", 4) == 0) section = SECTION_DIFF;
+            if(name_length == 9 && strncasecmp(name, "submodule", 9) == 0) section = SECTION_SUBMODULE;
+            if((plain && name_length == 7 && strncasecmp(name, "include", 7) == 0) ||
+               (name_length == 9 && strncasecmp(name, "includeIf", 9) == 0))
+                section = SECTION_INCLUDE;  // conditions aren't evaluated: follow every include
+        }
+        else if(section != SECTION_OTHER && line < line_end && *line != '#' && *line != ';')
+        {
+            const char *key_end = line;
+            while(key_end < line_end && git_config_name_char(*key_end)) key_end++;
+            U64 key_length = (U64)(key_end - line);
+            const char *value = key_end;
+            while(value < line_end && (*value == ' ' || *value == '\t')) value++;
+            U64 value_length = 0;
+            if(value < line_end && *value == '=')
+            {
+                value++;
+                while(value < line_end && (*value == ' ' || *value == '\t' || *value == '"')) value++;
+                const char *value_end = value;
+                while(value_end < line_end && *value_end != ';' && *value_end != '#') value_end++;
+                while(value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t' ||
+                                            value_end[-1] == '\r' || value_end[-1] == '"')) value_end--;
+                value_length = (U64)(value_end - value);
+            }
+            else value = NULL;
+
+#define GIT_KEY_IS(literal) (key_length == sizeof(literal) - 1 && strncasecmp(line, literal, key_length) == 0)
+            if(section == SECTION_CORE)
+            {
+                if(GIT_KEY_IS("autocrlf")) config->autocrlf = git_config_boolean(value, value_length);
+                if(GIT_KEY_IS("eol")) config->eol_crlf = value_length == 4 && strncasecmp(value, "crlf", 4) == 0;
+                if(GIT_KEY_IS("safecrlf")) config->safecrlf = git_config_boolean(value, value_length);
+                if(GIT_KEY_IS("attributesFile") && value &&
+                   !git_config_path(value, value_length, path, config->attributes_file, sizeof(config->attributes_file)))
+                    config->attributes_file[0] = '\0';
+            }
+            if(section == SECTION_EXTENSIONS && GIT_KEY_IS("objectFormat"))
+                config->object_format = !(value_length == 4 && strncasecmp(value, "sha1", 4) == 0);
+            if((section == SECTION_DIFF && GIT_KEY_IS("ignoreSubmodules")) ||
+               (section == SECTION_SUBMODULE && GIT_KEY_IS("ignore")))
+                config->ignores_submodules = true;
+            if(section == SECTION_INCLUDE && GIT_KEY_IS("path") && value && depth < GIT_CONFIG_INCLUDE_DEPTH)
+            {
+                char include_path[PATH_MAX];
+                if(git_config_path(value, value_length, path, include_path, sizeof(include_path)))
+                    git_config_scan(include_path, config, depth + 1);
+            }
+#undef GIT_KEY_IS
+        }
+        line = line_end + 1;
+    }
+    munmap((void *)mapped, size);
+}
+
+// Whether an attributes file sets anything that converts worktree bytes:
+// text (or text=auto), eol, crlf, ident, filter, working-tree-encoding.
+// Unset (-text) and unspecified (!text) forms don't.
+internal B32
+git_attributes_convert(const char *path)
+{
+    U64 size;
+    const U8 *mapped = map_file(path, &size);
+    if(mapped == NULL) return false;
+
+    B32 converts = false;
+    const char *line = (const char *)mapped;
+    const char *attributes_end = line + size;
+    while(line < attributes_end && !converts)
+    {
+        const char *newline = memchr(line, '\n', (U64)(attributes_end - line));
+        const char *line_end = newline ? newline : attributes_end;
+        const char *cursor = line;
+        while(cursor < line_end && git_attributes_space(*cursor)) cursor++;
+        if(cursor == line_end || *cursor == '#') { line = line_end + 1; continue; }
+
+        // Pattern: a quoted C-style string or everything up to whitespace
+        if(*cursor == '"')
+        {
+            for(cursor++; cursor < line_end && *cursor != '"'; cursor++)
+                if(*cursor == '\\' && cursor + 1 < line_end) cursor++;
+            if(cursor < line_end) cursor++;
+        }
+        else while(cursor < line_end && !git_attributes_space(*cursor)) cursor++;
+
+        while(cursor < line_end && !converts)
+        {
+            while(cursor < line_end && git_attributes_space(*cursor)) cursor++;
+            const char *token = cursor;
+            while(cursor < line_end && !git_attributes_space(*cursor)) cursor++;
+            if(token == cursor || *token == '-' || *token == '!') continue;
+            const char *equals = memchr(token, '=', (U64)(cursor - token));
+            U64 name_length = (U64)((equals ? equals : cursor) - token);
+#define GIT_ATTRIBUTE_IS(literal) (name_length == sizeof(literal) - 1 && memcmp(token, literal, name_length) == 0)
+            converts = GIT_ATTRIBUTE_IS("text") || GIT_ATTRIBUTE_IS("eol") || GIT_ATTRIBUTE_IS("crlf") ||
+                       GIT_ATTRIBUTE_IS("ident") || GIT_ATTRIBUTE_IS("filter") ||
+                       GIT_ATTRIBUTE_IS("working-tree-encoding");
+#undef GIT_ATTRIBUTE_IS
+        }
+        line = line_end + 1;
+    }
+    munmap((void *)mapped, size);
+    return converts;
+}
+
+// Read the config git would (system, global, repo, worktree) and every
+// attributes file it would consult for tracked paths. Returns whether
+// content hashing can be trusted; submodule settings land in config.
+internal B32
+git_repo_has_filters(const Git_Repo *repo, const Git_Index *index, Git_Engine_Config *config)
+{
+    memset(config, 0, sizeof(*config));
+    const char *home = getenv("HOME");
+    const char *xdg_config = getenv("XDG_CONFIG_HOME");
+    char xdg_directory[PATH_MAX] = "";
+    if(xdg_config && xdg_config[0]) path_join(xdg_directory, sizeof(xdg_directory), xdg_config, "/git");
+    else if(home) path_join(xdg_directory, sizeof(xdg_directory), home, "/.config/git");
+
+    char path[PATH_MAX];
+    git_config_scan("/etc/gitconfig", config, 0);
+    if(xdg_directory[0]) { path_join(path, sizeof(path), xdg_directory, "/config"); git_config_scan(path, config, 0); }
+    if(home) { path_join(path, sizeof(path), home, "/.gitconfig"); git_config_scan(path, config, 0); }
+    path_join(path, sizeof(path), repo->common_directory, "/config");
+    git_config_scan(path, config, 0);
+    path_join(path, sizeof(path), repo->git_directory, "/config.worktree");
+    git_config_scan(path, config, 0);
+    path_join(path, sizeof(path), repo->worktree, "/.gitmodules");
+    git_config_scan(path, config, 0);
+    if(config->autocrlf || config->eol_crlf || config->safecrlf || config->object_format) return true;
+
+    if(!config->attributes_file[0] && xdg_directory[0])
+        path_join(config->attributes_file, sizeof(config->attributes_file), xdg_directory, "/attributes");
+    path_join(path, sizeof(path), repo->common_directory, "/info/attributes");
+    if(git_attributes_convert("/etc/gitattributes") || git_attributes_convert(config->attributes_file) ||
+       git_attributes_convert(path))
+        return true;
+    path_join(path, sizeof(path), repo->worktree, "/.gitattributes");
+    if(git_attributes_convert(path)) return true;
+
+    // Nested .gitattributes only apply below their directory, but any of
+    // them can cover a tracked path
+    for(U32 entry = 0; entry < index->entry_count; entry++)
+    {
+        const Git_Index_Entry *index_entry = &index->entries[entry];
+        if(index_entry->path_length < 16 ||
+           memcmp(index_entry->path + index_entry->path_length - 15, "/.gitattributes", 15) != 0)
+            continue;
+        String_Builder nested = string_builder(path, sizeof(path));
+        string_append_cstring(&nested, repo->worktree);
+        string_append_char(&nested, '/');
+        string_append(&nested, index_entry->path, index_entry->path_length);
+        if(nested.length + 1 < sizeof(path) && git_attributes_convert(path)) return true;
+    }
+    return false;
+}
+
+// Fill staged/modified for repo. max_entries bounds the work for callers on
+// the render path (0 = no limit). Returns false to defer to git.
+internal B32
+git_engine_status(const Git_Repo *repo, U32 max_entries, U32 *out_modified, U32 *out_staged)
+{
+    Git_Index index;
+    if(!git_index_load(repo->git_directory, &index)) return false;
+    if(max_entries && index.entry_count > max_entries) { git_index_free(&index); return false; }
+
+    B32 ok = false;
+    U32 staged = 0, modified = 0;
+    Git_Worktree_Pass pass;
+    memset(&pass, 0, sizeof(pass));
+    pass.repo = repo;
+    pass.index = &index;
+    pass.worktree_fd = open(repo->worktree, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    pass.results = calloc((U64)index.entry_count + 1, 1);
+    if(pass.worktree_fd < 0 || pass.results == NULL) goto done;
+    Git_Engine_Config config;
+    pass.has_filters = git_repo_has_filters(repo, &index, &config);
+    pass.ignores_submodules = config.ignores_submodules;
+
+    if(!git_engine_staged(repo, &index, &staged)) goto done;
+
+    // Unmerged paths ("UU" etc.) count once as staged and once as modified;
+    // their stages are skipped by the worktree pass.
+    for(U32 entry = 0; entry < index.entry_count;)
+    {
+        U32 next = entry + 1;
+        while(next < index.entry_count && index.entries[next].path_length == index.entries[entry].path_length &&
+              memcmp(index.entries[next].path, index.entries[entry].path, index.entries[entry].path_length) == 0)
+            next++;
+        if(next - entry > 1 || (index.entries[entry].flags & GIT_INDEX_FLAG_STAGE_MASK))
+        {
+            staged++;
+            modified++;
+            memset(pass.results + entry, GIT_ENTRY_SKIPPED, next - entry);
+        }
+        entry = next;
+    }
+
+    int thread_count = index.entry_count >= GIT_ENGINE_PARALLEL_MIN ? GIT_ENGINE_THREADS : 1;
+    pthread_t threads[GIT_ENGINE_THREADS];
+    int started = 0;
+    for(int thread = 1; thread < thread_count; thread++)
+        if(pthread_create(&threads[started], NULL, git_worktree_worker, &pass) == 0) started++;
+    git_worktree_worker(&pass);
+    for(int thread = 0; thread < started; thread++) pthread_join(threads[thread], NULL);
+
+    ok = true;
+    for(U32 entry = 0; entry < index.entry_count; entry++)
+    {
+        if(pass.results[entry] == GIT_ENTRY_UNKNOWN) { ok = false; break; }
+        if(pass.results[entry] == GIT_ENTRY_MODIFIED) modified++;
+        if(pass.results[entry] == GIT_ENTRY_SUBMODULE)
+        {
+            Git_Repo submodule;
+            U32 submodule_modified, submodule_staged;
+            if(git_gitlink_repo(repo, &index.entries[entry], &submodule) != GIT_ENTRY_SUBMODULE ||
+               !git_engine_status(&submodule, max_entries, &submodule_modified, &submodule_staged))
+            {
+                ok = false;
+                break;
+            }
+            if(submodule_modified || submodule_staged) modified++;
+        }
+    }
+
+done:
+    if(pass.worktree_fd >= 0) close(pass.worktree_fd);
+    free(pass.results);
+    git_index_free(&index);
+    if(ok) { *out_modified = modified; *out_staged = staged; }
+    return ok;
+}
+
+//~ Git Watcher
+//
+// `statusline --watch` is a per-user process that keeps the git records in
+// the state table current for the repos renders are looking at. It holds
+// inotify watches on the git directory (index, HEAD), the common directory
+// (packed-refs, config) and every directory under its refs, and every
+// worktree directory that contains a tracked file; on an event it
+// recomputes (index engine for counts, the commit walk for ahead/behind,
+// git itself for whatever those can't answer) and republishes with a
+// lease. While the lease holds, read_git_cache trusts the record without
+// TTL or index checks, so renders stay on CACHE_VALID.
+//
+// Renders register a repo with a datagram on a cache miss/stale read or when
+// the lease is in its second half; the first datagram starts the watcher.
+// Repos nobody asks about for WATCH_REPO_IDLE_S are dropped, and the watcher
+// exits when it has had nothing to watch for WATCH_IDLE_TIMEOUT_S. On exit
+// (idle, SIGTERM, replaced executable) it revokes its leases.
+//
+// Set STATUSLINE_NO_WATCH to disable registration.
+
+#define WATCH_LEASE_S          120  // also bounds staleness if the watcher is killed
+#define WATCH_RENEW_S          60   // renders re-register once less than this remains
+#define WATCH_REPO_IDLE_S      600  // beyond an expired lease
+#define WATCH_IDLE_TIMEOUT_S   1800
+#define WATCH_DEBOUNCE_MS      50
+#define WATCH_RETRY_MS         1000  // after git itself failed
+#define WATCH_EXE_CHECK_S      5
+#define WATCH_MAX_REPOS        16
+#define WATCH_MAX_DIRECTORIES  4096  // per repo; bigger worktrees are left to the TTL
+
+#define WATCH_MASK_GIT_DIRECTORY (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_ONLYDIR)
+#define WATCH_MASK_REFS          (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ONLYDIR)
+#define WATCH_MASK_WORKTREE      (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | \
+                                  IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+enum Watch_Kind
+{
+    WATCH_KIND_NONE,
+    WATCH_KIND_GIT_DIRECTORY,
+    WATCH_KIND_REFS,
+    WATCH_KIND_WORKTREE,
+};
+
+typedef struct Watch_Repo Watch_Repo;
+struct Watch_Repo
+{
+    B32       used;
+    B32       published;
+    B32       publish_failed;  // lease revoked until a recompute succeeds
+    B32       dirty_worktree;
+    B32       dirty_index;
+    B32       dirty_refs;
+    U64       dirty_since_us;
+    S64       lease_until_sec;
+    Git_Cache cache;       // last published values
+    Git_Repo  paths;
+};
+
+// A linked worktree shares its common directory and refs/ with the main
+// worktree, and inotify hands both the same descriptor for the same inode,
+// so a descriptor can belong to several repos at once
+typedef struct Watch_Owner Watch_Owner;
+struct Watch_Owner
+{
+    U16 repos;                    // bit per watcher->repos index
+    U8  kinds[WATCH_MAX_REPOS];   // enum Watch_Kind, per owning repo
+};
+_Static_assert(WATCH_MAX_REPOS <= 16, "Watch_Owner.repos is a U16 bitmask");
+
+typedef struct Git_Watcher Git_Watcher;
+struct Git_Watcher
+{
+    int          inotify_fd;
+    Watch_Repo   repos[WATCH_MAX_REPOS];
+    Watch_Owner *owners;            // indexed by watch descriptor
+    U32          owner_capacity;
+};
+
+internal B32
+watcher_socket_path(char *output, U64 output_capacity)
+{
+    return runtime_socket_path("statusline-watch.sock", "watch.sock", output, output_capacity);
+}
+
+// Fire-and-forget registration; starts the watcher (already registered for
+// this repo) if nobody is listening
+internal B32
+git_watcher_register(const char *repo_path)
+{
+    if(getenv("STATUSLINE_NO_WATCH") != NULL) return false;
+
+    char socket_path[108];
+    if(!watcher_socket_path(socket_path, sizeof(socket_path))) return false;
+
+    int socket_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if(socket_fd < 0) return false;
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, socket_path, strlen(socket_path));
+
+    B32 delivered = sendto(socket_fd, repo_path, strlen(repo_path), 0,
+                           (struct sockaddr *)&address, sizeof(address)) >= 0;
+    if(!delivered && (errno == ENOENT || errno == ECONNREFUSED))
+    {
+        spawn_detached_self("--watch", repo_path);
+        delivered = true;
+    }
+    close(socket_fd);
+    return delivered;
+}
+
+// IN_MASK_ADD: another repo may already watch this inode with its own mask
+internal B32
+watcher_add(Git_Watcher *watcher, int repo_index, enum Watch_Kind kind, const char *path, U32 mask)
+{
+    int watch_desc = inotify_add_watch(watcher->inotify_fd, path, mask | IN_MASK_ADD);
+    if(watch_desc < 0) return false;
+
+    if((U32)watch_desc >= watcher->owner_capacity)
+    {
+        U32 new_capacity = Max(watcher->owner_capacity * 2, (U32)watch_desc + 64);
+        Watch_Owner *owners = realloc(watcher->owners, new_capacity * sizeof(Watch_Owner));
+        if(owners == NULL) { inotify_rm_watch(watcher->inotify_fd, watch_desc); return false; }
+        memset(owners + watcher->owner_capacity, 0, (new_capacity - watcher->owner_capacity) * sizeof(Watch_Owner));
+        watcher->owners = owners;
+        watcher->owner_capacity = new_capacity;
+    }
+
+    watcher->owners[watch_desc].repos |= (U16)(1u << repo_index);
+    watcher->owners[watch_desc].kinds[repo_index] = (U8)kind;
+    return true;
+}
+
+internal void
+watcher_add_refs(Git_Watcher *watcher, int repo_index, char *path, U64 path_length, int depth)
+{
+    if(depth > 16 || !watcher_add(watcher, repo_index, WATCH_KIND_REFS, path, WATCH_MASK_REFS)) return;
+
+    DIR *directory = opendir(path);
+    if(directory == NULL) return;
+    struct dirent *entry;
+    while((entry = readdir(directory)) != NULL)
+    {
+        if(entry->d_type != DT_DIR || entry->d_name[0] == '.') continue;
+        U64 name_length = strlen(entry->d_name);
+        if(path_length + 1 + name_length >= 1024) continue;
+        path[path_length] = '/';
+        memcpy(path + path_length + 1, entry->d_name, name_length + 1);
+        watcher_add_refs(watcher, repo_index, path, path_length + 1 + name_length, depth + 1);
+        path[path_length] = '\0';
+    }
+    closedir(directory);
+}
+
+// Watch the worktree root and each directory holding a tracked file. Called
+// again whenever the index changes so newly tracked directories are picked up.
+internal B32
+watcher_add_worktree(Git_Watcher *watcher, int repo_index)
+{
+    Watch_Repo *repo = &watcher->repos[repo_index];
+    Git_Index index;
+    if(!git_index_load(repo->paths.git_directory, &index)) return false;
+
+    // Entries are path-sorted, so counting directory changes bounds the set
+    U32 directory_count = 1;
+    const char *previous = NULL;
+    U32 previous_length = 0;
+    for(U32 entry = 0; entry < index.entry_count; entry++)
+    {
+        const Git_Index_Entry *current = &index.entries[entry];
+        const char *slash = memrchr(current->path, '/', current->path_length);
+        U32 length = slash ? (U32)(slash - current->path) : 0;
+        if(length == 0 || (length == previous_length && memcmp(current->path, previous, length) == 0)) continue;
+        previous = current->path;
+        previous_length = length;
+        directory_count++;
+    }
+
+    B32 ok = directory_count <= WATCH_MAX_DIRECTORIES &&
+             watcher_add(watcher, repo_index, WATCH_KIND_WORKTREE, repo->paths.worktree, WATCH_MASK_WORKTREE);
+
+    char path[4096];
+    U64 root_length = strlen(repo->paths.worktree);
+    memcpy(path, repo->paths.worktree, root_length);
+    path[root_length] = '/';
+    previous = NULL;
+    previous_length = 0;
+    for(U32 entry = 0; ok && entry < index.entry_count; entry++)
+    {
+        const Git_Index_Entry *current = &index.entries[entry];
+        const char *slash = memrchr(current->path, '/', current->path_length);
+        U32 length = slash ? (U32)(slash - current->path) : 0;
+        if(length == 0 || (length == previous_length && memcmp(current->path, previous, length) == 0)) continue;
+        previous = current->path;
+        previous_length = length;
+        if(root_length + 1 + length >= sizeof(path)) continue;
+
+        memcpy(path + root_length + 1, current->path, length);
+        path[root_length + 1 + length] = '\0';
+        // A tracked directory may be missing (deleted files); that's fine
+        if(!watcher_add(watcher, repo_index, WATCH_KIND_WORKTREE, path, WATCH_MASK_WORKTREE) && errno == ENOSPC)
+            ok = false;
+    }
+
+    git_index_free(&index);
+    return ok;
+}
+
+// Watches another repo still owns stay in place
+internal void
+watcher_drop(Git_Watcher *watcher, int repo_index)
+{
+    U16 bit = (U16)(1u << repo_index);
+    for(U32 watch_desc = 0; watch_desc < watcher->owner_capacity; watch_desc++)
+    {
+        Watch_Owner *owner = &watcher->owners[watch_desc];
+        if(!(owner->repos & bit)) continue;
+        owner->repos &= (U16)~bit;
+        owner->kinds[repo_index] = WATCH_KIND_NONE;
+        if(owner->repos == 0) inotify_rm_watch(watcher->inotify_fd, (int)watch_desc);
+    }
+    memset(&watcher->repos[repo_index], 0, sizeof(Watch_Repo));
+}
+
+internal void
+watcher_publish(Git_Watcher *watcher, int repo_index)
+{
+    Watch_Repo *repo = &watcher->repos[repo_index];
+    if(repo->dirty_index) watcher_add_worktree(watcher, repo_index);
+
+    // Counts come from the engine; ahead/behind only change when refs,
+    // HEAD or config do. git covers whatever the native paths can't.
+    U32 modified, staged;
+    U32 ahead = repo->cache.ahead, behind = repo->cache.behind;
+    B32 compared = (repo->published && !repo->dirty_refs) || git_ahead_behind(&repo->paths, &ahead, &behind);
+    B32 counted = compared && git_engine_status(&repo->paths, 0, &modified, &staged);
+    if(!counted)
+    {
+        Git_Porcelain porcelain;
+        if(!run_git_status(repo->paths.worktree, &porcelain))
+        {
+            // Nothing to lease: revoke the lease on the last published
+            // values once, stay dirty and retry after WATCH_RETRY_MS
+            if(repo->published && !repo->publish_failed)
+                write_git_cache(&repo->paths, repo->cache.modified, repo->cache.staged,
+                                repo->cache.ahead, repo->cache.behind, 0);
+            repo->publish_failed = true;
+            repo->dirty_since_us = time_microseconds() + (WATCH_RETRY_MS - WATCH_DEBOUNCE_MS) * 1000;
+            return;
+        }
+        modified = porcelain.modified;
+        staged = porcelain.staged;
+        ahead = porcelain.ahead;
+        behind = porcelain.behind;
+    }
+
+    write_git_cache(&repo->paths, modified, staged, ahead, behind, repo->lease_until_sec);
+    repo->cache.modified = modified;
+    repo->cache.staged = staged;
+    repo->cache.ahead = ahead;
+    repo->cache.behind = behind;
+    repo->published = true;
+    repo->publish_failed = false;
+    repo->dirty_worktree = repo->dirty_index = repo->dirty_refs = false;
+}
+
+internal void
+watcher_register(Git_Watcher *watcher, const char *repo_path)
+{
+    if(repo_path[0] != '/') return;
+    S64 now = (S64)time(NULL);
+
+    int free_index = -1;
+    int oldest_index = 0;
+    for(int repo_index = 0; repo_index < WATCH_MAX_REPOS; repo_index++)
+    {
+        Watch_Repo *repo = &watcher->repos[repo_index];
+        if(!repo->used) { if(free_index < 0) free_index = repo_index; continue; }
+        if(strcmp(repo->paths.worktree, repo_path) == 0)
+        {
+            // Renewal: republish the same values under a fresh lease
+            repo->lease_until_sec = now + WATCH_LEASE_S;
+            if(repo->publish_failed) return;
+            write_git_cache(&repo->paths, repo->cache.modified, repo->cache.staged,
+                            repo->cache.ahead, repo->cache.behind, repo->lease_until_sec);
+            return;
+        }
+        if(repo->lease_until_sec < watcher->repos[oldest_index].lease_until_sec) oldest_index = repo_index;
+    }
+
+    // Renders send the worktree root; anything else is not ours to watch
+    Git_Repo paths;
+    if(!git_repo_discover(repo_path, &paths) || strcmp(paths.worktree, repo_path) != 0) return;
+
+    if(free_index < 0)
+    {
+        watcher_drop(watcher, oldest_index);
+        free_index = oldest_index;
+    }
+
+    Watch_Repo *repo = &watcher->repos[free_index];
+    repo->used = true;
+    repo->paths = paths;
+
+    // HEAD and index are per worktree; refs, packed-refs and config are
+    // shared through the common directory
+    B32 ok = watcher_add(watcher, free_index, WATCH_KIND_GIT_DIRECTORY, paths.git_directory, WATCH_MASK_GIT_DIRECTORY) &&
+             (strcmp(paths.common_directory, paths.git_directory) == 0 ||
+              watcher_add(watcher, free_index, WATCH_KIND_GIT_DIRECTORY, paths.common_directory, WATCH_MASK_GIT_DIRECTORY)) &&
+             watcher_add_worktree(watcher, free_index);
+    if(ok)
+    {
+        char path[1024];
+        path_join(path, sizeof(path), paths.common_directory, "/refs");
+        watcher_add_refs(watcher, free_index, path, strlen(path), 0);
+    }
+    if(!ok)
+    {
+        // Too large, or out of watches: renders keep the TTL path
+        watcher_drop(watcher, free_index);
+        return;
+    }
+
+    repo->lease_until_sec = now + WATCH_LEASE_S;
+    watcher_publish(watcher, free_index);
+}
+
+internal void
+watcher_mark_dirty(Watch_Repo *repo, B32 worktree, B32 index, B32 refs)
+{
+    if(!repo->dirty_worktree && !repo->dirty_index && !repo->dirty_refs)
+        repo->dirty_since_us = time_microseconds();
+    repo->dirty_worktree |= worktree;
+    repo->dirty_index    |= index;
+    repo->dirty_refs     |= refs;
+}
+
+internal void
+watcher_handle_owner_event(Git_Watcher *watcher, int repo_index, enum Watch_Kind kind,
+                           const struct inotify_event *event)
+{
+    Watch_Repo *repo = &watcher->repos[repo_index];
+    const char *name = event->len ? event->name : "";
+    U64 name_length = strlen(name);
+    B32 lock_file = name_length >= 5 && memcmp(name + name_length - 5, ".lock", 5) == 0;
+
+    switch(kind)
+    {
+    case WATCH_KIND_GIT_DIRECTORY:
+        if(strcmp(name, "index") == 0) watcher_mark_dirty(repo, false, true, false);
+        else if(strcmp(name, "HEAD") == 0 || strcmp(name, "packed-refs") == 0 || strcmp(name, "config") == 0)
+            watcher_mark_dirty(repo, false, false, true);
+        break;
+
+    case WATCH_KIND_REFS:
+        if(lock_file) break;
+        if((event->mask & (IN_CREATE | IN_MOVED_TO)) && (event->mask & IN_ISDIR))
+        {
+            // New ref namespace (remote, slashed branch): watch it too
+            char path[1024];
+            path_join(path, sizeof(path), repo->paths.common_directory, "/refs");
+            watcher_add_refs(watcher, repo_index, path, strlen(path), 0);
+        }
+        watcher_mark_dirty(repo, false, false, true);
+        break;
+
+    case WATCH_KIND_WORKTREE:
+        watcher_mark_dirty(repo, true, false, false);
+        break;
+
+    case WATCH_KIND_NONE:
+        break;
+    }
+}
+
+internal void
+watcher_handle_event(Git_Watcher *watcher, const struct inotify_event *event)
+{
+    if(event->mask & IN_Q_OVERFLOW)
+    {
+        for(int repo_index = 0; repo_index < WATCH_MAX_REPOS; repo_index++)
+            if(watcher->repos[repo_index].used) watcher_mark_dirty(&watcher->repos[repo_index], true, true, true);
+        return;
+    }
+    if(event->wd < 0 || (U32)event->wd >= watcher->owner_capacity) return;
+
+    if(event->mask & IN_IGNORED)
+    {
+        memset(&watcher->owners[event->wd], 0, sizeof(Watch_Owner));
+        return;
+    }
+
+    // Every owning repo sees the event. Copied first: watcher_add_refs can
+    // grow (move) the owners array.
+    Watch_Owner owner = watcher->owners[event->wd];
+    for(int repo_index = 0; repo_index < WATCH_MAX_REPOS; repo_index++)
+        if(owner.repos & (1u << repo_index))
+            watcher_handle_owner_event(watcher, repo_index, (enum Watch_Kind)owner.kinds[repo_index], event);
+}
+
+internal volatile sig_atomic_t watcher_stop_requested;
+
+internal void
+watcher_handle_signal(int signal_number)
+{
+    watcher_stop_requested = 1;
+}
+
+internal int
+watcher_main(const char *initial_repo_path)
+{
+    char socket_path[108];
+    if(!watcher_socket_path(socket_path, sizeof(socket_path))) return 1;
+
+    // One watcher per user: the flock is held for the watcher's lifetime
+    char lock_path[128];
+    path_join(lock_path, sizeof(lock_path), socket_path, ".lock");
+    int lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if(lock_fd < 0) return 1;
+    if(flock(lock_fd, LOCK_EX | LOCK_NB) != 0) return 0;
+
+    char exe_path[512];
+    ssize_t exe_length = readlink("/proc/self/exe", exe_path, sizeof(exe_path) - 1);
+    if(exe_length <= 0) return 1;
+    exe_path[exe_length] = '\0';
+    struct stat exe_stat;
+    if(stat(exe_path, &exe_stat) != 0) return 1;
+
+    state_table_resident = true;
+    signal(SIGPIPE, SIG_IGN);
+
+    int socket_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if(socket_fd < 0) return 1;
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, socket_path, strlen(socket_path));
+
+    unlink(socket_path);
+    mode_t previous_umask = umask(0077);
+    int bound = bind(socket_fd, (struct sockaddr *)&address, sizeof(address));
+    umask(previous_umask);
+    if(bound != 0) return 1;
+
+    signal(SIGTERM, watcher_handle_signal);
+    signal(SIGINT, watcher_handle_signal);
+
+    static Git_Watcher watcher;
+    watcher.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(watcher.inotify_fd < 0) { unlink(socket_path); return 1; }
+
+    if(initial_repo_path) watcher_register(&watcher, initial_repo_path);
+
+    S64 last_exe_check_sec = (S64)time(NULL);
+    S64 idle_since_sec = last_exe_check_sec;
+    while(!watcher_stop_requested)
+    {
+        // Sleep until the earliest debounce deadline, or a minute for housekeeping
+        U64 now_us = time_microseconds();
+        int timeout_ms = 60 * 1000;
+        for(int repo_index = 0; repo_index < WATCH_MAX_REPOS; repo_index++)
+        {
+            Watch_Repo *repo = &watcher.repos[repo_index];
+            if(!repo->used || !(repo->dirty_worktree || repo->dirty_index || repo->dirty_refs)) continue;
+            U64 due_us = repo->dirty_since_us + WATCH_DEBOUNCE_MS * 1000;
+            int wait_ms = due_us > now_us ? (int)((due_us - now_us + 999) / 1000) : 0;
+            if(wait_ms < timeout_ms) timeout_ms = wait_ms;
+        }
+
+        struct pollfd poll_fds[2] = {
+            {.fd = socket_fd,          .events = POLLIN},
+            {.fd = watcher.inotify_fd, .events = POLLIN},
+        };
+        int ready = poll(poll_fds, 2, timeout_ms);
+        if(ready < 0 && errno != EINTR) break;
+
+        if(ready > 0 && (poll_fds[1].revents & POLLIN))
+        {
+            char events[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+            ssize_t length;
+            while((length = read(watcher.inotify_fd, events, sizeof(events))) > 0)
+            {
+                for(char *cursor = events; cursor < events + length;)
+                {
+                    const struct inotify_event *event = (const struct inotify_event *)cursor;
+                    watcher_handle_event(&watcher, event);
+                    cursor += sizeof(struct inotify_event) + event->len;
+                }
+            }
+        }
+
+        if(ready > 0 && (poll_fds[0].revents & POLLIN))
+        {
+            char repo_path[512];
+            ssize_t length;
+            while((length = recv(socket_fd, repo_path, sizeof(repo_path) - 1, MSG_DONTWAIT)) > 0)
+            {
+                repo_path[length] = '\0';
+                watcher_register(&watcher, repo_path);
+            }
+        }
+
+        now_us = time_microseconds();
+        S64 now = (S64)time(NULL);
+        B32 any_repo = false;
+        for(int repo_index = 0; repo_index < WATCH_MAX_REPOS; repo_index++)
+        {
+            Watch_Repo *repo = &watcher.repos[repo_index];
+            if(!repo->used) continue;
+            if(now > repo->lease_until_sec + WATCH_REPO_IDLE_S) { watcher_drop(&watcher, repo_index); continue; }
+            any_repo = true;
+            if((repo->dirty_worktree || repo->dirty_index || repo->dirty_refs) &&
+               now_us >= repo->dirty_since_us + WATCH_DEBOUNCE_MS * 1000)
+                watcher_publish(&watcher, repo_index);
+        }
+
+        if(any_repo) idle_since_sec = now;
+        else if(now - idle_since_sec >= WATCH_IDLE_TIMEOUT_S) break;
+
+        if(now - last_exe_check_sec >= WATCH_EXE_CHECK_S)
+        {
+            last_exe_check_sec = now;
+            if(executable_changed(exe_path, &exe_stat)) break;
+        }
+    }
+
+    unlink(socket_path);
+    for(int repo_index = 0; repo_index < WATCH_MAX_REPOS; repo_index++)
+    {
+        Watch_Repo *repo = &watcher.repos[repo_index];
+        if(repo->used && repo->published)
+            write_git_cache(&repo->paths, repo->cache.modified, repo->cache.staged,
+                            repo->cache.ahead, repo->cache.behind, 0);
+    }
+    return 0;
+}
+
+//~ Git Status Resolution
+
+// Full refresh (counts and ahead/behind) in a detached `--refresh-git`,
+// unless one is already running for the repo
+internal void
+git_refresh_in_background(const Git_Repo *repo)
+{
+    if(git_refresh_lease_take(repo)) spawn_detached_self("--refresh-git", repo->worktree);
+}
+
+// `statusline --refresh-git <worktree>`
+internal int
+git_refresh_main(const char *worktree)
+{
+    Git_Repo repo;
+    if(worktree == NULL || !git_repo_discover(worktree, &repo)) return 2;
+    Git_Porcelain porcelain;
+    if(!run_git_status(repo.worktree, &porcelain)) return 1;
+    write_git_cache(&repo, porcelain.modified, porcelain.staged, porcelain.ahead, porcelain.behind, 0);
+    git_refresh_lease_end(&repo);
+    return 0;
+}
+
+// The watcher, once registered, publishes a full refresh itself; otherwise a
+// detached git run fills in ahead/behind. Called after this render's own
+// cache write so that write can't clobber the watcher's lease.
+internal void
+git_refresh_after_render(const Git_Repo *repo, B32 needs_full_refresh)
+{
+    if(!git_watcher_register(repo->worktree) && needs_full_refresh)
+        git_refresh_in_background(repo);
+}
+
+// Counts from a valid cache entry (renewing the watcher's lease when it
+// runs low); `cache` is left for the stale and missing cases
+internal enum Cache_State
+git_status_from_cache(const Git_Repo *repo, Git_Status *git_status, Git_Cache *cache)
+{
+    enum Cache_State cache_state = read_git_cache(repo, cache);
+    if(cache_state == CACHE_VALID)
+    {
+        git_status->modified = cache->modified;
+        git_status->staged   = cache->staged;
+        git_status->ahead    = cache->ahead;
+        git_status->behind   = cache->behind;
+        if(cache->watched_until_sec != 0 && cache->watched_until_sec - (S64)time(NULL) < WATCH_RENEW_S)
+            git_watcher_register(repo->worktree);
+    }
+    return cache_state;
+}
+
+internal void
+get_git_status_cached(const Git_Repo *repo, Git_Status *git_status)
+{
+    Git_Cache cache;
+    git_status->cache_state = git_status_from_cache(repo, git_status, &cache);
+
+    switch(git_status->cache_state)
+    {
+    case CACHE_VALID:
+        return;
+
+    case CACHE_STALE:
+        // A warm gitstatusd answers in a few ms: prefer fresh counts now
+        if(gitstatusd_query(repo->worktree, GITSTATUSD_STALE_TIMEOUT_MS, git_status))
+        {
+            write_git_cache(repo, git_status->modified, git_status->staged,
+                            git_status->ahead, git_status->behind, 0);
+            git_refresh_after_render(repo, false);
+            return;
+        }
+
+        // Fresh counts and ahead/behind in-process; whichever can't be
+        // computed stays stale until the background refresh lands
+        {
+            B32 compared = git_ahead_behind(repo, &git_status->ahead, &git_status->behind);
+            if(!compared)
+            {
+                git_status->ahead  = cache.ahead;
+                git_status->behind = cache.behind;
+            }
+            B32 counted = git_engine_status(repo, GIT_ENGINE_STALE_MAX, &git_status->modified, &git_status->staged);
+            if(counted)
+                write_git_cache(repo, git_status->modified, git_status->staged,
+                                git_status->ahead, git_status->behind, 0);
+            else
+            {
+                git_status->modified = cache.modified;
+                git_status->staged   = cache.staged;
+            }
+            git_refresh_after_render(repo, !(counted && compared));
+        }
+        return;
+
+    case CACHE_NONE:
+        if(gitstatusd_query(repo->worktree, GITSTATUSD_MISS_TIMEOUT_MS, git_status))
+        {
+            write_git_cache(repo, git_status->modified, git_status->staged,
+                            git_status->ahead, git_status->behind, 0);
+            git_refresh_after_render(repo, false);
+            return;
+        }
+
+        if(git_engine_status(repo, 0, &git_status->modified, &git_status->staged))
+        {
+            B32 compared = git_ahead_behind(repo, &git_status->ahead, &git_status->behind);
+            if(!compared) git_status->ahead = git_status->behind = 0;
+            write_git_cache(repo, git_status->modified, git_status->staged,
+                            git_status->ahead, git_status->behind, 0);
+            git_refresh_after_render(repo, !compared);
+            return;
+        }
+
+        // Everything from one git run; the stash count from the reflog
+        // read stands if git fails
+        Git_Porcelain porcelain;
+        if(run_git_status(repo->worktree, &porcelain))
+        {
+            git_status->stashes = porcelain.stashes;
+            if(!porcelain.detached && porcelain.head[0])
+                memcpy(git_status->branch, porcelain.head, sizeof(git_status->branch));
+        }
+        git_status->modified = porcelain.modified;
+        git_status->staged   = porcelain.staged;
+        git_status->ahead    = porcelain.ahead;
+        git_status->behind   = porcelain.behind;
+        write_git_cache(repo, git_status->modified, git_status->staged,
+                        git_status->ahead, git_status->behind, 0);
+        git_refresh_after_render(repo, false);
+        return;
+    }
+}
+
+//~ Model Abbreviation
+// "Claude 3.5 Sonnet" -> "So3.5", "Opus 4.6" -> "Op4.6", "Haiku 4.5" -> "Ha4.5"
+
+internal U64
+abbreviate_model(const char *model, char *output, U64 output_capacity)
+{
+    // Known model family prefixes (match last word before version)
+    static const struct { const char *name; const char *abbrev; } families[] = {
+        {"Opus",   "Op"},
+        {"Sonnet", "So"},
+        {"Haiku",  "Ha"},
+    };
+
+    // Find version number (first digit followed by dot and digit)
+    const char *version = NULL;
+    for(const char *p = model; *p; p++)
+    {
+        if(*p >= '0' && *p <= '9' && p[1] == '.' && p[2] >= '0' && p[2] <= '9')
+        { version = p; break; }
+    }
+
+    // Find family name
+    const char *abbrev = NULL;
+    for(int i = 0; i < 3; i++)
+    {
+        if(strstr(model, families[i].name))
+        { abbrev = families[i].abbrev; break; }
+    }
+
+    if(abbrev && version)
+    {
+        char *cursor = output;
+        U64 abbrev_len = strlen(abbrev);
+        memcpy(cursor, abbrev, abbrev_len); cursor += abbrev_len;
+        // Copy version: digits, dots, digits
+        while(*version && ((*version >= '0' && *version <= '9') || *version == '.'))
+            *cursor++ = *version++;
+        *cursor = '\0';
+        return (U64)(cursor - output);
+    }
+
+    // Fallback: copy as-is
+    U64 len = strlen(model);
+    if(len >= output_capacity) len = output_capacity - 1;
+    memcpy(output, model, len);
+    output[len] = '\0';
+    return len;
+}
+
+//~ Branch Truncation
+
+internal const char *
+truncate_branch(const char *branch, int max_length, U64 *output_length)
+{
+    static char truncation_buffer[64];
+    int length = (int)strlen(branch);
+    if(length <= max_length) { *output_length = length; return branch; }
+
+    int copy_length = max_length - 3;
+    memcpy(truncation_buffer, branch, copy_length);
+    truncation_buffer[copy_length] = '.';
+    truncation_buffer[copy_length + 1] = '.';
+    truncation_buffer[copy_length + 2] = '.';
+    truncation_buffer[copy_length + 3] = '\0';
+    *output_length = max_length;
+    return truncation_buffer;
+}
+
+//~ Git Segment Builder (snprintf-free)
+
+internal void
+build_git_segment(Output_Buffer *buffer, Git_Status *git_status)
+{
+    if(!git_status->valid) return;
+
+    // Branch text: ICON_BRANCH " " + branch name
+    char text[256];
+    char *cursor = text;
+    memcpy(cursor, ICON_BRANCH " ", sizeof(ICON_BRANCH " ") - 1);
+    cursor += sizeof(ICON_BRANCH " ") - 1;
+
+    U64 branch_length;
+    const char *branch_name = truncate_branch(git_status->branch, 20, &branch_length);
+    memcpy(cursor, branch_name, branch_length);
+    cursor += branch_length;
+    U64 text_length = (U64)(cursor - text);
+
+    const char *background; U64 background_length;
+    if(git_status->modified > 0 || git_status->staged > 0)
+    { background = ANSI_BG_ORANGE; background_length = sizeof(ANSI_BG_ORANGE)-1; }
+    else
+    { background = ANSI_BG_GREEN; background_length = sizeof(ANSI_BG_GREEN)-1; }
+
+    segment(buffer, background, background_length, ANSI_FG_BLACK, sizeof(ANSI_FG_BLACK)-1, text, text_length, false);
+
+    // Status counts
+    if(git_status->staged > 0 || git_status->modified > 0 || git_status->stashes > 0 ||
+       git_status->ahead > 0 || git_status->behind > 0)
+    {
+        char status_text[256];
+        cursor = status_text;
+
+        if(git_status->ahead > 0)
+        {
+            memcpy(cursor, ANSI_FG_GREEN, sizeof(ANSI_FG_GREEN)-1); cursor += sizeof(ANSI_FG_GREEN)-1;
+            memcpy(cursor, UTF8_UP, 3); cursor += 3;
+            cursor += format_u32(cursor, git_status->ahead);
+            *cursor++ = ' ';
+        }
+        if(git_status->behind > 0)
+        {
+            memcpy(cursor, ANSI_FG_RED, sizeof(ANSI_FG_RED)-1); cursor += sizeof(ANSI_FG_RED)-1;
+            memcpy(cursor, UTF8_DOWN, 3); cursor += 3;
+            cursor += format_u32(cursor, git_status->behind);
+            *cursor++ = ' ';
+        }
+        if(git_status->staged > 0)
+        {
+            memcpy(cursor, ANSI_FG_GREEN, sizeof(ANSI_FG_GREEN)-1); cursor += sizeof(ANSI_FG_GREEN)-1;
+            memcpy(cursor, ICON_STAGED, sizeof(ICON_STAGED)-1); cursor += sizeof(ICON_STAGED)-1;
+            cursor += format_u32(cursor, git_status->staged);
+            *cursor++ = ' ';
+        }
+        if(git_status->modified > 0)
+        {
+            memcpy(cursor, ANSI_FG_ORANGE, sizeof(ANSI_FG_ORANGE)-1); cursor += sizeof(ANSI_FG_ORANGE)-1;
+            memcpy(cursor, ICON_MODIFIED, sizeof(ICON_MODIFIED)-1); cursor += sizeof(ICON_MODIFIED)-1;
+            cursor += format_u32(cursor, git_status->modified);
+            *cursor++ = ' ';
+        }
+        if(git_status->stashes > 0)
+        {
+            memcpy(cursor, ANSI_FG_PURPLE, sizeof(ANSI_FG_PURPLE)-1); cursor += sizeof(ANSI_FG_PURPLE)-1;
+            memcpy(cursor, ICON_STASH, sizeof(ICON_STASH)-1); cursor += sizeof(ICON_STASH)-1;
+            cursor += format_s64(cursor, git_status->stashes);
+        }
+
+        // Trim trailing space
+        U64 status_length = (U64)(cursor - status_text);
+        if(status_length > 0 && status_text[status_length - 1] == ' ') status_length--;
+
+        segment(buffer, ANSI_BG_DARK, sizeof(ANSI_BG_DARK)-1, "", 0, status_text, status_length, false);
+    }
+}
+
+//~ Display State
+
+// Every STATE_FIELDS field as it is shown
+#define DISPLAY_STATE_MEMBER(target, member, scope, name, kind, capacity, persist, merge) \
+    STATE_MEMBER_##kind(member, capacity)
+
+typedef struct Display_State Display_State;
+struct Display_State
+{
+    STATE_FIELDS(DISPLAY_STATE_MEMBER)
+    S64 last_update_sec;
+};
+
+//~ Stdin Reader
+//
+// Payloads with rate_limits and current_usage pass PIPE_BUF, so they can
+// arrive in several writes. Read until EOF, the root object closing, or
+// the deadline, feeding each chunk to the extractor as it lands so parsing
+// overlaps the transfer. The arena starts inline and moves to the heap
+// (doubling) when a payload outgrows it; a payload cut off before the root
+// closes is STDIN_TRUNCATED, not silently complete. The first time stdin
+// has nothing to read, `idle` (if any) runs before we block, so work that
+// doesn't need the payload overlaps the wait.
+
+#define STDIN_TIMEOUT_MS       50
+#define STDIN_INLINE_CAPACITY  8192
+#define STDIN_READ_MIN         4096
+
+enum Stdin_Result
+{
+    STDIN_NONE,                // nothing before the deadline
+    STDIN_COMPLETE,
+    STDIN_TRUNCATED,           // EOF or deadline inside the root object
+};
+
+typedef struct Stdin_Arena Stdin_Arena;
+struct Stdin_Arena
+{
+    char *data;                // inline_data, or the heap once outgrown
+    U64   length;              // data[length] is always '\0'
+    U64   capacity;
+    char  inline_data[STDIN_INLINE_CAPACITY];
+};
+
+internal void
+stdin_arena_init(Stdin_Arena *arena)
+{
+    arena->data = arena->inline_data;
+    arena->length = 0;
+    arena->capacity = sizeof(arena->inline_data);
+    arena->data[0] = '\0';
+}
+
+internal void
+stdin_arena_release(Stdin_Arena *arena)
+{
+    if(arena->data != arena->inline_data) free(arena->data);
+    stdin_arena_init(arena);
+}
+
+#define JSON_REBASE_STRING(member)                                                        \
+    if(fields->member.data) fields->member.data = data + (fields->member.data - arena->data);
+#define JSON_REBASE_S64(member)
+#define JSON_REBASE_F64(member)
+#define JSON_REBASE_B32(member)
+#define JSON_REBASE(target, member, scope, name, kind, capacity, persist, merge) JSON_REBASE_##kind(member)
+
+// Room for `extra` more bytes and the terminator. Moving the bytes moves
+// the string slices already parsed out of them, so `fields` (if any) is
+// rebased onto the new copy.
+internal B32
+stdin_arena_reserve(Stdin_Arena *arena, U64 extra, Json_Parsed_Fields *fields)
+{
+    if(arena->length + extra < arena->capacity) return true;
+    U64 capacity = arena->capacity;
+    while(arena->length + extra >= capacity) capacity *= 2;
+    char *data = malloc(capacity);
+    if(!data) return false;
+    memcpy(data, arena->data, arena->length + 1);
+    if(fields) { STATE_FIELDS(JSON_REBASE) }
+    if(arena->data != arena->inline_data) free(arena->data);
+    arena->data = data;
+    arena->capacity = capacity;
+    return true;
+}
 
-    if((S64)index_stat.st_mtim.tv_sec == cache->index_mtime_sec &&
-       (S64)index_stat.st_mtim.tv_nsec == cache->index_mtime_nsec)
+internal enum Stdin_Result
+read_stdin(Stdin_Arena *arena, Json_Parsed_Fields *fields, void (*idle)(void *context), void *idle_context)
+{
+    Json_Parser parser;
+    json_parser_begin(&parser, fields);
+    U64 deadline = time_microseconds() + STDIN_TIMEOUT_MS * 1000;
+    while(!parser.complete)
     {
-        return CACHE_VALID;
+        // Past the deadline, still take what is already in the pipe: the
+        // idle hook can outlast STDIN_TIMEOUT_MS while the payload waits
+        U64 now = time_microseconds();
+        B32 expired = now >= deadline;
+        struct pollfd poll_fd = {.fd = STDIN_FILENO, .events = POLLIN};
+        int ready = poll(&poll_fd, 1, idle || expired ? 0 : (int)((deadline - now + 999) / 1000));
+        if(ready == 0 && idle)
+        {
+            idle(idle_context);
+            idle = NULL;
+            continue;
+        }
+        if(ready <= 0) break;
+        if(!stdin_arena_reserve(arena, STDIN_READ_MIN, fields)) break;
+
+        ssize_t bytes_read = read(STDIN_FILENO, arena->data + arena->length, arena->capacity - arena->length - 1);
+        if(bytes_read < 0 && errno == EINTR) continue;
+        if(bytes_read <= 0) break;
+        arena->length += (U64)bytes_read;
+        arena->data[arena->length] = '\0';
+        json_parser_feed(&parser, arena->data, arena->length, false, fields);
     }
 
-    return CACHE_STALE;
+    if(arena->length == 0) return STDIN_NONE;
+    json_parser_feed(&parser, arena->data, arena->length, true, fields);
+    return parser.complete ? STDIN_COMPLETE : STDIN_TRUNCATED;
 }
 
+//~ State Resolution (uses single-pass JSON parser)
+//
+// Each field meets its cached value by the merge rule in STATE_FIELDS;
+// strings are decoded straight into the state. Transient fields take the
+// frame's value and are zero without stdin. A truncated payload may have
+// been cut before a LATEST field, so those fall back like FALLBACK then.
+
+#define STATE_RESOLVE_PERSIST_STRING(member, merge)                                      \
+    if((STATE_MERGE_##merge == STATE_MERGE_LATEST && complete) || fields->member.length > 0) \
+        json_string_copy(fields->member, state->member, sizeof(state->member));         \
+    else                                                                                 \
+        memcpy(state->member, cached.member, sizeof(state->member));                    \
+    memcpy(new_cache.member, state->member, sizeof(new_cache.member));
+#define STATE_RESOLVE_PERSIST_SCALAR(member, merge)                                      \
+    state->member = (STATE_MERGE_##merge == STATE_MERGE_LATEST && complete) || fields->member > 0 ? \
+                    fields->member : cached.member;                                      \
+    new_cache.member = STATE_MERGE_##merge == STATE_MERGE_MAX ?                          \
+                       Max(fields->member, cached.member) : state->member;
+#define STATE_RESOLVE_PERSIST_S64 STATE_RESOLVE_PERSIST_SCALAR
+#define STATE_RESOLVE_PERSIST_F64 STATE_RESOLVE_PERSIST_SCALAR
+#define STATE_RESOLVE_PERSIST_B32 STATE_RESOLVE_PERSIST_SCALAR
+#define STATE_RESOLVE_TRANSIENT_STRING(member, merge) \
+    json_string_copy(fields->member, state->member, sizeof(state->member));
+#define STATE_RESOLVE_TRANSIENT_SCALAR(member, merge) state->member = fields->member;
+#define STATE_RESOLVE_TRANSIENT_S64 STATE_RESOLVE_TRANSIENT_SCALAR
+#define STATE_RESOLVE_TRANSIENT_F64 STATE_RESOLVE_TRANSIENT_SCALAR
+#define STATE_RESOLVE_TRANSIENT_B32 STATE_RESOLVE_TRANSIENT_SCALAR
+#define STATE_RESOLVE(target, member, scope, name, kind, capacity, persist, merge) \
+    STATE_RESOLVE_##persist##_##kind(member, merge)
+
+#define STATE_RESTORE(target, member, scope, name, kind, capacity, persist, merge) \
+    STATE_IF_##persist(memcpy(&state->member, &cached.member, sizeof(state->member));)
+
 internal void
-write_git_cache(const char *repo_path, U32 modified, U32 staged, U32 ahead, U32 behind)
+resolve_state(const Json_Parsed_Fields *fields, enum Stdin_Result stdin_result,
+              const Session_Identity *identity, Display_State *state)
 {
-    char index_path[512];
-    snprintf(index_path, sizeof(index_path), "%s/.git/index", repo_path);
-    struct stat index_stat;
-    if(stat(index_path, &index_stat) != 0) return;
+    Cached_State cached;
+    memset(&cached, 0, sizeof(cached));
+    read_cached_state(identity, &cached);
 
-    Git_Cache cache;
-    memset(&cache, 0, sizeof(cache));
-    cache.index_mtime_sec = (S64)index_stat.st_mtim.tv_sec;
-    cache.index_mtime_nsec = (S64)index_stat.st_mtim.tv_nsec;
-    cache.modified = modified;
-    cache.staged = staged;
-    cache.ahead = ahead;
-    cache.behind = behind;
-    strncpy(cache.repo_path, repo_path, sizeof(cache.repo_path) - 1);
-
-    char cache_path[64];
-    get_git_cache_path(repo_path, cache_path, sizeof(cache_path));
-
-    int file_desc = open(cache_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if(file_desc < 0) return;
-    write(file_desc, &cache, sizeof(cache));
-    close(file_desc);
+    memset(state, 0, sizeof(*state));
+
+    if(stdin_result != STDIN_NONE)
+    {
+        B32 complete = stdin_result == STDIN_COMPLETE;
+        Cached_State new_cache;
+        memset(&new_cache, 0, sizeof(new_cache));
+        STATE_FIELDS(STATE_RESOLVE)
+        state->last_update_sec = (S64)time(NULL);
+        new_cache.last_update_sec = state->last_update_sec;
+
+        if(memcmp(&new_cache, &cached, sizeof(Cached_State)) != 0)
+            write_cached_state(identity, &new_cache);
+    }
+    else
+    {
+        STATE_FIELDS(STATE_RESTORE)
+        state->last_update_sec = cached.last_update_sec;
+    }
 }
 
+//~ Statusline Builder (snprintf-free)
+
 internal void
-run_git_status(const char *repo_path, U32 *out_modified, U32 *out_staged,
-               U32 *out_ahead, U32 *out_behind)
+build_statusline(Output_Buffer *buffer, Display_State *state, Git_Status *git_status)
 {
-    *out_modified = 0;
-    *out_staged   = 0;
-    *out_ahead    = 0;
-    *out_behind   = 0;
+    B32 first = true;
 
-    int pipe_fds[2];
-    if(pipe(pipe_fds) != 0) return;
+    // Vim mode (icon only, color indicates mode)
+    if(state->vim_mode[0])
+    {
+        const char *vim_background, *vim_foreground, *vim_icon;
+        U64 vim_background_length, vim_foreground_length, vim_icon_length;
+        B32 is_insert = (strcmp(state->vim_mode, "INSERT") == 0);
+        if(is_insert)
+        {
+            vim_background = ANSI_BG_GREEN; vim_background_length = sizeof(ANSI_BG_GREEN)-1;
+            vim_foreground = ANSI_FG_BLACK; vim_foreground_length = sizeof(ANSI_FG_BLACK)-1;
+            vim_icon = ICON_INSERT; vim_icon_length = sizeof(ICON_INSERT)-1;
+        }
+        else
+        {
+            vim_background = ANSI_BG_DARK;  vim_background_length = sizeof(ANSI_BG_DARK)-1;
+            vim_foreground = ANSI_FG_WHITE; vim_foreground_length = sizeof(ANSI_FG_WHITE)-1;
+            vim_icon = ICON_NORMAL; vim_icon_length = sizeof(ICON_NORMAL)-1;
+        }
+
+        char vim_text[64];
+        char *cursor = vim_text;
+        if(is_insert)
+        {
+            memcpy(cursor, ANSI_BOLD, sizeof(ANSI_BOLD)-1); cursor += sizeof(ANSI_BOLD)-1;
+        }
+        memcpy(cursor, vim_icon, vim_icon_length); cursor += vim_icon_length;
+
+        segment(buffer, vim_background, vim_background_length, vim_foreground, vim_foreground_length, vim_text, (U64)(cursor - vim_text), first);
+        first = false;
+    }
 
-    pid_t child_pid = fork();
-    if(child_pid < 0)
+    // Model (abbreviated, bold), with a brain when extended thinking is on
     {
-        close(pipe_fds[0]);
-        close(pipe_fds[1]);
-        return;
+        char abbrev[32];
+        U64 abbrev_length = abbreviate_model(state->model, abbrev, sizeof(abbrev));
+
+        char model_text[128];
+        memcpy(model_text, ANSI_BOLD, sizeof(ANSI_BOLD)-1);
+        memcpy(model_text + sizeof(ANSI_BOLD)-1, abbrev, abbrev_length);
+        U64 text_length = sizeof(ANSI_BOLD)-1 + abbrev_length;
+        if(state->thinking_enabled)
+        {
+            memcpy(model_text + text_length, " " ICON_BRAIN, sizeof(" " ICON_BRAIN)-1);
+            text_length += sizeof(" " ICON_BRAIN)-1;
+        }
+
+        segment_literal(buffer, ANSI_BG_PURPLE, ANSI_FG_BLACK, model_text, text_length, first);
+        first = false;
     }
 
-    if(child_pid == 0)
+    // Path
     {
-        close(pipe_fds[0]);
-        chdir(repo_path);
-        dup2(pipe_fds[1], STDOUT_FILENO);
-        int dev_null = open("/dev/null", O_WRONLY);
-        if(dev_null >= 0) { dup2(dev_null, STDERR_FILENO); close(dev_null); }
-        close(pipe_fds[1]);
+        char path_text[300];
+        memcpy(path_text, ICON_FOLDER " ", sizeof(ICON_FOLDER " ")-1);
+        U64 prefix_length = sizeof(ICON_FOLDER " ")-1;
+        U64 abbreviated_length = abbreviate_path(state->working_directory, path_text + prefix_length, sizeof(path_text) - prefix_length);
 
-        char *argv[] = {"git", "status", "--porcelain", "-b", "-uno", NULL};
-        execvp("git", argv);
-        _exit(127);
+        segment_literal(buffer, ANSI_BG_DARK, ANSI_FG_WHITE, path_text, prefix_length + abbreviated_length, false);
     }
 
-    close(pipe_fds[1]);
+    // Git
+    if(git_status->valid)
+        build_git_segment(buffer, git_status);
 
-    char buffer[4096];
-    int total_bytes_read = 0;
-    for(;;)
+    // Cost
     {
-        int remaining = (int)sizeof(buffer) - total_bytes_read;
-        if(remaining <= 0) break;
-        ssize_t bytes_read = read(pipe_fds[0], buffer + total_bytes_read, remaining);
-        if(bytes_read <= 0) break;
-        total_bytes_read += (int)bytes_read;
+        const char *cost_background; U64 cost_background_length;
+        if(state->cost_usd >= 10.0)      { cost_background = ANSI_BG_RED;    cost_background_length = sizeof(ANSI_BG_RED)-1;    }
+        else if(state->cost_usd >= 5.0)  { cost_background = ANSI_BG_ORANGE; cost_background_length = sizeof(ANSI_BG_ORANGE)-1; }
+        else if(state->cost_usd >= 1.0)  { cost_background = ANSI_BG_CYAN;   cost_background_length = sizeof(ANSI_BG_CYAN)-1;   }
+        else                             { cost_background = ANSI_BG_MINT;   cost_background_length = sizeof(ANSI_BG_MINT)-1;   }
+
+        char cost_text[64];
+        char *cursor = cost_text;
+        memcpy(cursor, ICON_DOLLAR " ", sizeof(ICON_DOLLAR " ")-1); cursor += sizeof(ICON_DOLLAR " ")-1;
+        cursor += format_f64(cursor, state->cost_usd, 2);
+
+        segment(buffer, cost_background, cost_background_length, ANSI_FG_BLACK, sizeof(ANSI_FG_BLACK)-1,
+                cost_text, (U64)(cursor - cost_text), false);
     }
-    close(pipe_fds[0]);
-    waitpid(child_pid, NULL, 0);
 
-    char *line = buffer;
-    char *buffer_end = buffer + total_bytes_read;
-    while(line < buffer_end)
+    // Usage quota
+    if(state->five_hour_pct >= 50 || state->seven_day_pct >= 50)
+    {
+        char usage_text[256];
+        char *cursor = usage_text;
+
+        // 5h: white label, bold colored percentage
+        const char *color_5h;
+        U64 color_5h_len;
+        if(state->five_hour_pct >= 90)       { color_5h = ANSI_FG_RED;    color_5h_len = sizeof(ANSI_FG_RED)-1;    }
+        else if(state->five_hour_pct >= 80)  { color_5h = ANSI_FG_ORANGE; color_5h_len = sizeof(ANSI_FG_ORANGE)-1; }
+        else if(state->five_hour_pct >= 50)  { color_5h = ANSI_FG_YELLOW; color_5h_len = sizeof(ANSI_FG_YELLOW)-1; }
+        else                                 { color_5h = ANSI_FG_GREEN;  color_5h_len = sizeof(ANSI_FG_GREEN)-1;  }
+
+        memcpy(cursor, ANSI_FG_WHITE, sizeof(ANSI_FG_WHITE)-1); cursor += sizeof(ANSI_FG_WHITE)-1;
+        memcpy(cursor, "5h ", 3); cursor += 3;
+        memcpy(cursor, ANSI_BOLD, sizeof(ANSI_BOLD)-1); cursor += sizeof(ANSI_BOLD)-1;
+        memcpy(cursor, color_5h, color_5h_len); cursor += color_5h_len;
+        cursor += format_u64(cursor, (U64)(state->five_hour_pct + 0.5));
+        *cursor++ = '%';
+
+        // Faint separator
+        memcpy(cursor, " " ANSI_FG_WHITE, sizeof(" " ANSI_FG_WHITE)-1);
+        cursor += sizeof(" " ANSI_FG_WHITE)-1;
+
+        // 7d: white label, bold colored percentage
+        const char *color_7d;
+        U64 color_7d_len;
+        if(state->seven_day_pct >= 90)       { color_7d = ANSI_FG_RED;    color_7d_len = sizeof(ANSI_FG_RED)-1;    }
+        else if(state->seven_day_pct >= 80)  { color_7d = ANSI_FG_ORANGE; color_7d_len = sizeof(ANSI_FG_ORANGE)-1; }
+        else if(state->seven_day_pct >= 50)  { color_7d = ANSI_FG_YELLOW; color_7d_len = sizeof(ANSI_FG_YELLOW)-1; }
+        else                                 { color_7d = ANSI_FG_GREEN;  color_7d_len = sizeof(ANSI_FG_GREEN)-1;  }
+
+        memcpy(cursor, "7d ", 3); cursor += 3;
+        memcpy(cursor, ANSI_BOLD, sizeof(ANSI_BOLD)-1); cursor += sizeof(ANSI_BOLD)-1;
+        memcpy(cursor, color_7d, color_7d_len); cursor += color_7d_len;
+        cursor += format_u64(cursor, (U64)(state->seven_day_pct + 0.5));
+        *cursor++ = '%';
+
+        segment_no_foreground(buffer, ANSI_BG_COMMENT, usage_text, (U64)(cursor - usage_text), false);
+    }
+
+    // Session duration + last update time
+    if(state->total_duration_ms > 0)
     {
-        char *newline = memchr(line, '\n', buffer_end - line);
-        int line_length = newline ? (int)(newline - line) : (int)(buffer_end - line);
-        if(line_length < 2) { line = newline ? newline + 1 : buffer_end; continue; }
+        char duration_text[256];
+        char *cursor = duration_text;
+        memcpy(cursor, ANSI_FG_WHITE ICON_CLOCK " ", sizeof(ANSI_FG_WHITE ICON_CLOCK " ")-1); cursor += sizeof(ANSI_FG_WHITE ICON_CLOCK " ")-1;
+        cursor += format_duration(state->total_duration_ms, cursor);
 
-        if(line[0] == '#' && line[1] == '#')
+        if(state->last_update_sec > 0)
         {
-            char *bracket = memchr(line, '[', line_length);
-            if(bracket)
-            {
-                char *ahead_match = strstr(bracket, "ahead ");
-                if(ahead_match) *out_ahead = (U32)strtol(ahead_match + 6, NULL, 10);
-                char *behind_match = strstr(bracket, "behind ");
-                if(behind_match) *out_behind = (U32)strtol(behind_match + 7, NULL, 10);
-            }
+            // Faint separator
+            memcpy(cursor, " " ANSI_FG_COMMENT "| " ANSI_FG_WHITE, sizeof(" " ANSI_FG_COMMENT "| " ANSI_FG_WHITE)-1);
+            cursor += sizeof(" " ANSI_FG_COMMENT "| " ANSI_FG_WHITE)-1;
+
+            time_t update_time = (time_t)state->last_update_sec;
+            struct tm local_time;
+            localtime_r(&update_time, &local_time);
+
+            int hour12 = local_time.tm_hour % 12;
+            if(hour12 == 0) hour12 = 12;
+            const char *ampm = local_time.tm_hour < 12 ? " AM" : " PM";
+
+            cursor += format_u64(cursor, (U64)hour12);
+            *cursor++ = ':';
+            if(local_time.tm_min < 10) *cursor++ = '0';
+            cursor += format_u64(cursor, (U64)local_time.tm_min);
+            *cursor++ = ':';
+            if(local_time.tm_sec < 10) *cursor++ = '0';
+            cursor += format_u64(cursor, (U64)local_time.tm_sec);
+            memcpy(cursor, ampm, 3); cursor += 3;
+        }
+
+        // Inline context bar after duration
+        memcpy(cursor, " " ANSI_FG_COMMENT "| ", sizeof(" " ANSI_FG_COMMENT "| ")-1);
+        cursor += sizeof(" " ANSI_FG_COMMENT "| ")-1;
+        cursor += make_context_bar(state->used_percent, state->context_size, cursor, sizeof(duration_text) - (U64)(cursor - duration_text));
+
+        segment_no_foreground(buffer, ANSI_BG_DARK, duration_text, (U64)(cursor - duration_text), false);
+    }
+
+    // Context warnings
+    if(state->used_percent >= 80)
+    {
+        char warning_text[128];
+        char *cursor = warning_text;
+        const char *warning_background; U64 warning_background_length;
+
+        if(state->used_percent >= 95)
+        {
+            memcpy(cursor, ANSI_BOLD, sizeof(ANSI_BOLD)-1); cursor += sizeof(ANSI_BOLD)-1;
+            memcpy(cursor, ICON_WARN " CRITICAL COMPACT", sizeof(ICON_WARN " CRITICAL COMPACT")-1);
+            cursor += sizeof(ICON_WARN " CRITICAL COMPACT")-1;
+            warning_background = ANSI_BG_RED; warning_background_length = sizeof(ANSI_BG_RED)-1;
+        }
+        else if(state->used_percent >= 90)
+        {
+            memcpy(cursor, ANSI_BOLD, sizeof(ANSI_BOLD)-1); cursor += sizeof(ANSI_BOLD)-1;
+            memcpy(cursor, ICON_WARN " LOW CTX COMPACT", sizeof(ICON_WARN " LOW CTX COMPACT")-1);
+            cursor += sizeof(ICON_WARN " LOW CTX COMPACT")-1;
+            warning_background = ANSI_BG_RED; warning_background_length = sizeof(ANSI_BG_RED)-1;
         }
         else
         {
-            if(line[0] != ' ' && line[0] != '?') *out_staged += 1;
-            if(line[1] != ' ' && line[1] != '?') *out_modified += 1;
+            memcpy(cursor, ICON_WARN " CTX 80%+", sizeof(ICON_WARN " CTX 80%+")-1);
+            cursor += sizeof(ICON_WARN " CTX 80%+")-1;
+            warning_background = ANSI_BG_YELLOW; warning_background_length = sizeof(ANSI_BG_YELLOW)-1;
+        }
+
+        segment(buffer, warning_background, warning_background_length, ANSI_FG_BLACK, sizeof(ANSI_FG_BLACK)-1,
+                warning_text, (U64)(cursor - warning_text), false);
+    }
+
+    segment_end(buffer);
+}
+
+//~ Performance Counters
+// Only opened under STATUSLINE_DEBUG: one perf_event group on this thread,
+// read at every phase boundary so the debug log shows whether a slow phase
+// was instructions, cache misses, page faults or a context switch. Counters
+// the kernel refuses (no PMU under a VM, perf_event_paranoid) are left out
+// of the group; if none open the log says perf=off.
+
+enum Perf_Counter
+{
+    PERF_INSTRUCTIONS,
+    PERF_CYCLES,
+    PERF_CACHE_MISSES,
+    PERF_PAGE_FAULTS,
+    PERF_CONTEXT_SWITCHES,
+    PERF_COUNTER_COUNT,
+};
+
+// In the order phases run, which is the order they're logged in
+enum Render_Phase
+{
+    PHASE_READ,
+    PHASE_PARSE,
+    PHASE_GIT,
+    PHASE_BUILD,
+    PHASE_COUNT,
+};
+
+typedef struct Perf_Group Perf_Group;
+struct Perf_Group
+{
+    int leader_fd;                                    // -1 if nothing opened
+    int open_errno;                                   // last refusal, for the log
+    int fds[PERF_COUNTER_COUNT];                      // -1 per missing counter
+    U64 ids[PERF_COUNTER_COUNT];
+    U64 previous[PERF_COUNTER_COUNT];
+    U64 phase_counts[PHASE_COUNT][PERF_COUNTER_COUNT];
+    B32 phase_sampled[PHASE_COUNT];
+};
+
+internal void
+perf_group_open(Perf_Group *group)
+{
+    static const struct { U32 type; U64 config; } events[PERF_COUNTER_COUNT] = {
+        [PERF_INSTRUCTIONS]     = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        [PERF_CYCLES]           = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        [PERF_CACHE_MISSES]     = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        [PERF_PAGE_FAULTS]      = {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+        [PERF_CONTEXT_SWITCHES] = {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    };
+
+    memset(group, 0, sizeof(*group));
+    group->leader_fd = -1;
+    B32 user_only = false;
+    for(int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+    {
+        group->fds[counter] = -1;
+
+        struct perf_event_attr attributes;
+        memset(&attributes, 0, sizeof(attributes));
+        attributes.size        = sizeof(attributes);
+        attributes.type        = events[counter].type;
+        attributes.config      = events[counter].config;
+        attributes.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID;
+        attributes.disabled    = (group->leader_fd < 0);
+
+        int fd = -1;
+        for(int attempt = 0; attempt < 2 && fd < 0; attempt++)
+        {
+            attributes.exclude_kernel = user_only;
+            attributes.exclude_hv     = user_only;
+            fd = (int)syscall(SYS_perf_event_open, &attributes, 0, -1, group->leader_fd, PERF_FLAG_FD_CLOEXEC);
+            // perf_event_paranoid >= 2 still allows counting user space
+            if(fd < 0 && errno == EACCES && !user_only) user_only = true;
+            else break;
         }
+        if(fd < 0) { group->open_errno = errno; continue; }
+        if(ioctl(fd, PERF_EVENT_IOC_ID, &group->ids[counter]) != 0) { close(fd); continue; }
+
+        group->fds[counter] = fd;
+        if(group->leader_fd < 0) group->leader_fd = fd;
+    }
+
+    if(group->leader_fd >= 0)
+    {
+        ioctl(group->leader_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(group->leader_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
 
-        line = newline ? newline + 1 : buffer_end;
+// Attribute everything counted since the previous sample to `phase`
+internal void
+perf_group_sample(Perf_Group *group, enum Render_Phase phase)
+{
+    if(!group || group->leader_fd < 0) return;
+
+    struct { U64 count; struct { U64 value, id; } values[PERF_COUNTER_COUNT]; } data;
+    if(read(group->leader_fd, &data, sizeof(data)) <= 0) return;
+
+    for(int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+    {
+        if(group->fds[counter] < 0) continue;
+        for(U64 index = 0; index < data.count && index < PERF_COUNTER_COUNT; index++)
+        {
+            if(data.values[index].id != group->ids[counter]) continue;
+            group->phase_counts[phase][counter] = data.values[index].value - group->previous[counter];
+            group->previous[counter] = data.values[index].value;
+            break;
+        }
     }
+    group->phase_sampled[phase] = true;
 }
 
 internal void
-get_git_status_cached(const char *repo_path, U32 *modified, U32 *staged,
-                      U32 *ahead, U32 *behind, enum Cache_State *state)
+perf_group_close(Perf_Group *group)
 {
-    Git_Cache cache;
-    *state = read_git_cache(repo_path, &cache);
+    for(int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+        if(group->fds[counter] >= 0) close(group->fds[counter]);
+    group->leader_fd = -1;
+}
 
-    switch(*state)
-    {
-    case CACHE_VALID:
-        *modified = cache.modified;
-        *staged   = cache.staged;
-        *ahead    = cache.ahead;
-        *behind   = cache.behind;
-        return;
+//~ Render
 
-    case CACHE_STALE:
-        *modified = cache.modified;
-        *staged   = cache.staged;
-        *ahead    = cache.ahead;
-        *behind   = cache.behind;
+typedef struct Render_Timings Render_Timings;
+struct Render_Timings
+{
+    U64 start;
+    U64 read_us;
+    U64 parse_us;
+    U64 git_us;
+    U64 build_us;
+    B32 git_speculated; // git came from a Git_Speculation
+    B32 git_deferred;   // GIT_RESOLVE_BACKGROUND found no counts; nothing built
+    Perf_Group *perf;   // NULL unless STATUSLINE_DEBUG
+};
+
+// How far resolve_git_status goes for counts the cache can't answer
+enum Git_Resolve
+{
+    GIT_RESOLVE_FULL,        // compute them (gitstatusd, the engine, git)
+    GIT_RESOLVE_CACHED,      // only a valid cache entry; nothing is computed
+    GIT_RESOLVE_BACKGROUND,  // a stale entry too, refreshed in the background
+};
+
+// Discovery, HEAD, the stash count and the cached counts for one directory.
+// Short of GIT_RESOLVE_FULL, cache_state says whether counts were found.
+internal void
+resolve_git_status(const char *working_directory, Git_Status *git_status, enum Git_Resolve resolve)
+{
+    memset(git_status, 0, sizeof(*git_status));
+    Git_Repo repo;
+    if(working_directory[0] && git_repo_discover(working_directory, &repo) &&
+       git_read_branch_fast(repo.git_directory, git_status->branch, sizeof(git_status->branch)))
+    {
+        git_status->valid = true;
+        git_status->stashes = git_read_stash_count(repo.common_directory);
+        if(resolve == GIT_RESOLVE_FULL)
         {
-            pid_t background_pid = fork();
-            if(background_pid == 0)
-            {
-                if(fork() == 0)
-                {
-                    U32 new_modified, new_staged, new_ahead, new_behind;
-                    run_git_status(repo_path, &new_modified, &new_staged, &new_ahead, &new_behind);
-                    write_git_cache(repo_path, new_modified, new_staged, new_ahead, new_behind);
-                }
-                _exit(0);
-            }
-            if(background_pid > 0) waitpid(background_pid, NULL, 0);
+            get_git_status_cached(&repo, git_status);
+            return;
         }
-        return;
 
-    case CACHE_NONE:
-        run_git_status(repo_path, modified, staged, ahead, behind);
-        write_git_cache(repo_path, *modified, *staged, *ahead, *behind);
-        return;
+        Git_Cache cache;
+        git_status->cache_state = git_status_from_cache(&repo, git_status, &cache);
+        if(git_status->cache_state == CACHE_STALE && resolve == GIT_RESOLVE_BACKGROUND)
+        {
+            git_status->modified = cache.modified;
+            git_status->staged   = cache.staged;
+            git_status->ahead    = cache.ahead;
+            git_status->behind   = cache.behind;
+            git_refresh_after_render(&repo, true);
+        }
     }
 }
 
-//~ Model Abbreviation
-// "Claude 3.5 Sonnet" -> "So3.5", "Opus 4.6" -> "Op4.6", "Haiku 4.5" -> "Ha4.5"
+// Git work done while stdin is still on its way, for the directory the
+// session last reported (nearly always the one the payload names). Only
+// the bounded reads: discovery, HEAD, stashes and a valid cache entry.
+// Counts that would need gitstatusd, the engine or a git run are left to
+// the render, which keeps the speculation when the payload confirms the
+// directory and redoes it otherwise.
+#define GIT_SPECULATION_MAX_AGE_MS 250
 
-internal U64
-abbreviate_model(const char *model, char *output, U64 output_capacity)
+typedef struct Git_Speculation Git_Speculation;
+struct Git_Speculation
 {
-    // Known model family prefixes (match last word before version)
-    static const struct { const char *name; const char *abbrev; } families[] = {
-        {"Opus",   "Op"},
-        {"Sonnet", "So"},
-        {"Haiku",  "Ha"},
-    };
+    int        parent_pid;     // of the render it was made for; 0 if none
+    int        grandparent_pid;
+    B32        valid;          // status is for working_directory
+    U64        session_key;
+    U64        made_us;        // time_microseconds clock
+    char       working_directory[sizeof(((Cached_State *)0)->working_directory)];
+    Git_Status status;
+};
 
-    // Find version number (first digit followed by dot and digit)
-    const char *version = NULL;
-    for(const char *p = model; *p; p++)
-    {
-        if(*p >= '0' && *p <= '9' && p[1] == '.' && p[2] >= '0' && p[2] <= '9')
-        { version = p; break; }
-    }
+// Also looks up Claude's pid, while there is time to spare, so the render
+// that follows doesn't have to
+internal void
+git_speculate(int parent_pid, Git_Speculation *speculation)
+{
+    speculation->valid = false;
+    speculation->parent_pid = parent_pid;
+    speculation->grandparent_pid = get_parent_pid_of(parent_pid);
 
-    // Find family name
-    const char *abbrev = NULL;
-    for(int i = 0; i < 3; i++)
-    {
-        if(strstr(model, families[i].name))
-        { abbrev = families[i].abbrev; break; }
-    }
+    Session_Identity identity;
+    session_identity_for_pid(parent_pid, speculation->grandparent_pid, &identity);
+    Cached_State cached;
+    if(!read_cached_state(&identity, &cached) || !cached.working_directory[0]) return;
+
+    memcpy(speculation->working_directory, cached.working_directory, sizeof(speculation->working_directory));
+    resolve_git_status(speculation->working_directory, &speculation->status, GIT_RESOLVE_CACHED);
+    if(speculation->status.valid && speculation->status.cache_state != CACHE_VALID) return;
+    speculation->session_key = identity.key;
+    speculation->made_us = time_microseconds();
+    speculation->valid = true;
+}
 
-    if(abbrev && version)
+// Everything after stdin: session identity, state resolution, usage, git
+// and the segment build. Shared by the in-process path and the resident
+// server; `parent_pid` is the render process's parent. `speculation` may be
+// NULL. Leaves the session in `identity` for the bookkeeping after output.
+// Under GIT_RESOLVE_BACKGROUND a repo with no cached counts sets
+// timings->git_deferred and builds nothing.
+internal enum Cache_State
+render_statusline(Output_Buffer *output_buffer, const Json_Parsed_Fields *fields,
+                  enum Stdin_Result stdin_result, int parent_pid, const Git_Speculation *speculation,
+                  enum Git_Resolve resolve, Session_Identity *identity, Render_Timings *timings)
+{
+    U64 time_phase = time_microseconds();
+
+    int known_pid = speculation && speculation->parent_pid == parent_pid ? speculation->grandparent_pid : 0;
+    session_identity_resolve(stdin_result != STDIN_NONE ? fields : NULL, parent_pid, known_pid, identity);
+
+    Display_State state;
+    resolve_state(fields, stdin_result, identity, &state);
+
+    // Usage quota: stdin's rate_limits when it has them (any known window
+    // carries a reset time), else the background fetch (~5us on cache hit)
+    if(state.five_hour_resets_at == 0 && state.seven_day_resets_at == 0)
     {
-        char *cursor = output;
-        U64 abbrev_len = strlen(abbrev);
-        memcpy(cursor, abbrev, abbrev_len); cursor += abbrev_len;
-        // Copy version: digits, dots, digits
-        while(*version && ((*version >= '0' && *version <= '9') || *version == '.'))
-            *cursor++ = *version++;
-        *cursor = '\0';
-        return (U64)(cursor - output);
+        Usage_Cache usage = read_usage_cache(identity);
+        state.five_hour_pct  = usage.five_hour_pct;
+        state.seven_day_pct  = usage.seven_day_pct;
     }
+    U64 time_parse = time_microseconds();
+    timings->parse_us = time_parse - time_phase;
+    perf_group_sample(timings->perf, PHASE_PARSE);
 
-    // Fallback: copy as-is
-    U64 len = strlen(model);
-    if(len >= output_capacity) len = output_capacity - 1;
-    memcpy(output, model, len);
-    output[len] = '\0';
-    return len;
-}
+    // Git status
+    Git_Status git_status;
+    timings->git_speculated = speculation && speculation->valid &&
+                              speculation->session_key == identity->key &&
+                              time_microseconds() - speculation->made_us < GIT_SPECULATION_MAX_AGE_MS * 1000 &&
+                              strcmp(speculation->working_directory, state.working_directory) == 0;
+    if(timings->git_speculated)
+        git_status = speculation->status;
+    else
+        resolve_git_status(state.working_directory, &git_status, resolve);
+    U64 time_git = time_microseconds();
+    timings->git_us = time_git - time_parse;
+    perf_group_sample(timings->perf, PHASE_GIT);
 
-//~ Branch Truncation
+    timings->git_deferred = git_status.valid && git_status.cache_state == CACHE_NONE && resolve != GIT_RESOLVE_FULL;
+    if(timings->git_deferred) return CACHE_NONE;
 
-internal const char *
-truncate_branch(const char *branch, int max_length, U64 *output_length)
-{
-    static char truncation_buffer[64];
-    int length = (int)strlen(branch);
-    if(length <= max_length) { *output_length = length; return branch; }
+    // Build output
+    build_statusline(output_buffer, &state, &git_status);
+    timings->build_us = time_microseconds() - time_git;
+    perf_group_sample(timings->perf, PHASE_BUILD);
 
-    int copy_length = max_length - 3;
-    memcpy(truncation_buffer, branch, copy_length);
-    truncation_buffer[copy_length] = '.';
-    truncation_buffer[copy_length + 1] = '.';
-    truncation_buffer[copy_length + 2] = '.';
-    truncation_buffer[copy_length + 3] = '\0';
-    *output_length = max_length;
-    return truncation_buffer;
+    return git_status.cache_state;
 }
 
-//~ Git Segment Builder (snprintf-free)
-
+// Timing suffix (only when debug enabled)
 internal void
-build_git_segment(Output_Buffer *buffer, Git_Status *git_status)
+output_debug_timing(Output_Buffer *output_buffer, U64 time_start)
 {
-    if(!git_status->valid) return;
-
-    // Branch text: ICON_BRANCH " " + branch name
-    char text[256];
-    char *cursor = text;
-    memcpy(cursor, ICON_BRANCH " ", sizeof(ICON_BRANCH " ") - 1);
-    cursor += sizeof(ICON_BRANCH " ") - 1;
-
-    U64 branch_length;
-    const char *branch_name = truncate_branch(git_status->branch, 20, &branch_length);
-    memcpy(cursor, branch_name, branch_length);
-    cursor += branch_length;
-    U64 text_length = (U64)(cursor - text);
-
-    const char *background; U64 background_length;
-    if(git_status->modified > 0 || git_status->staged > 0)
-    { background = ANSI_BG_ORANGE; background_length = sizeof(ANSI_BG_ORANGE)-1; }
+    U64 total_microseconds = time_microseconds() - time_start;
+    output_literal(output_buffer, "  " ANSI_FG_COMMENT);
+    if(total_microseconds >= 1000)
+    {
+        output_f64(output_buffer, total_microseconds / 1000.0, 1);
+        output_literal(output_buffer, "ms");
+    }
     else
-    { background = ANSI_BG_GREEN; background_length = sizeof(ANSI_BG_GREEN)-1; }
+    {
+        output_u64(output_buffer, total_microseconds);
+        output_literal(output_buffer, "us");
+    }
+    output_literal(output_buffer, ANSI_RESET);
+}
 
-    segment(buffer, background, background_length, ANSI_FG_BLACK, sizeof(ANSI_FG_BLACK)-1, text, text_length, false);
+//~ Debug Logging
 
-    // Status counts
-    if(git_status->staged > 0 || git_status->modified > 0 || git_status->stashes > 0 ||
-       git_status->ahead > 0 || git_status->behind > 0)
+internal void
+write_debug_log(const Session_Identity *identity, const Render_Timings *timings,
+                enum Cache_State cache_state, enum Stdin_Result stdin_result)
+{
+    U64 time_end = time_microseconds();
+
+    const char *cache_string;
+    switch(cache_state)
     {
-        char status_text[256];
-        cursor = status_text;
+    case CACHE_VALID: cache_string = "valid"; break;
+    case CACHE_STALE: cache_string = "stale"; break;
+    case CACHE_NONE:  cache_string = "miss";  break;
+    default:          cache_string = "?";     break;
+    }
 
-        if(git_status->ahead > 0)
-        {
-            memcpy(cursor, ANSI_FG_GREEN, sizeof(ANSI_FG_GREEN)-1); cursor += sizeof(ANSI_FG_GREEN)-1;
-            memcpy(cursor, UTF8_UP, 3); cursor += 3;
-            cursor += format_u32(cursor, git_status->ahead);
-            *cursor++ = ' ';
-        }
-        if(git_status->behind > 0)
-        {
-            memcpy(cursor, ANSI_FG_RED, sizeof(ANSI_FG_RED)-1); cursor += sizeof(ANSI_FG_RED)-1;
-            memcpy(cursor, UTF8_DOWN, 3); cursor += 3;
-            cursor += format_u32(cursor, git_status->behind);
-            *cursor++ = ' ';
-        }
-        if(git_status->staged > 0)
-        {
-            memcpy(cursor, ANSI_FG_GREEN, sizeof(ANSI_FG_GREEN)-1); cursor += sizeof(ANSI_FG_GREEN)-1;
-            memcpy(cursor, ICON_STAGED, sizeof(ICON_STAGED)-1); cursor += sizeof(ICON_STAGED)-1;
-            cursor += format_u32(cursor, git_status->staged);
-            *cursor++ = ' ';
-        }
-        if(git_status->modified > 0)
-        {
-            memcpy(cursor, ANSI_FG_ORANGE, sizeof(ANSI_FG_ORANGE)-1); cursor += sizeof(ANSI_FG_ORANGE)-1;
-            memcpy(cursor, ICON_MODIFIED, sizeof(ICON_MODIFIED)-1); cursor += sizeof(ICON_MODIFIED)-1;
-            cursor += format_u32(cursor, git_status->modified);
-            *cursor++ = ' ';
-        }
-        if(git_status->stashes > 0)
+    char line[1024];
+    String_Builder text = string_builder(line, sizeof(line));
+    string_append_literal(&text, "read=");
+    string_append_s64(&text, (S64)timings->read_us);
+    string_append_literal(&text, "us(");
+    string_append_cstring(&text, stdin_result == STDIN_COMPLETE ? "ok" :
+                                 stdin_result == STDIN_TRUNCATED ? "truncated" : "timeout");
+    string_append_literal(&text, ") parse=");
+    string_append_s64(&text, (S64)timings->parse_us);
+    string_append_literal(&text, "us git=");
+    string_append_s64(&text, (S64)timings->git_us);
+    string_append_literal(&text, "us(");
+    string_append_cstring(&text, cache_string);
+    if(timings->git_speculated) string_append_literal(&text, ",speculative");
+    string_append_literal(&text, ") build=");
+    string_append_s64(&text, (S64)timings->build_us);
+    string_append_literal(&text, "us total=");
+    string_append_s64(&text, (S64)(time_end - timings->start));
+    string_append_literal(&text, "us");
+
+    // perf.<phase>=ins:N,cyc:N,miss:N,pf:N,cs:N with '-' for missing counters
+    Perf_Group *perf = timings->perf;
+    if(perf && perf->leader_fd < 0)
+    {
+        string_append_literal(&text, " perf=off(errno=");
+        string_append_s64(&text, perf->open_errno);
+        string_append_char(&text, ')');
+    }
+    else if(perf)
+    {
+        static const char *phase_names[PHASE_COUNT] = {"read", "parse", "git", "build"};
+        static const char *counter_names[PERF_COUNTER_COUNT] = {"ins", "cyc", "miss", "pf", "cs"};
+        for(int phase = 0; phase < PHASE_COUNT; phase++)
         {
-            memcpy(cursor, ANSI_FG_PURPLE, sizeof(ANSI_FG_PURPLE)-1); cursor += sizeof(ANSI_FG_PURPLE)-1;
-            memcpy(cursor, ICON_STASH, sizeof(ICON_STASH)-1); cursor += sizeof(ICON_STASH)-1;
-            cursor += format_s64(cursor, git_status->stashes);
+            if(!perf->phase_sampled[phase]) continue;
+            string_append_literal(&text, " perf.");
+            string_append_cstring(&text, phase_names[phase]);
+            string_append_char(&text, '=');
+            for(int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+            {
+                if(counter) string_append_char(&text, ',');
+                string_append_cstring(&text, counter_names[counter]);
+                string_append_char(&text, ':');
+                if(perf->fds[counter] >= 0) string_append_s64(&text, (S64)perf->phase_counts[phase][counter]);
+                else string_append_char(&text, '-');
+            }
         }
+    }
+    string_append_char(&text, '\n');
+    U64 line_length = Min(text.length, sizeof(line) - 1);
+    line[line_length - 1] = '\n';
+
+    char log_path[SESSION_NAME_CAPACITY + 80];
+    String_Builder path = string_builder(log_path, sizeof(log_path));
+    string_append_literal(&path, "/tmp/statusline-");
+    string_append_s64(&path, getuid());
+    mkdir(log_path, 0700);
+    string_append_char(&path, '/');
+    string_append_cstring(&path, identity->name);
+    string_append_literal(&path, ".log");
 
-        // Trim trailing space
-        U64 status_length = (U64)(cursor - status_text);
-        if(status_length > 0 && status_text[status_length - 1] == ' ') status_length--;
-
-        segment(buffer, ANSI_BG_DARK, sizeof(ANSI_BG_DARK)-1, "", 0, status_text, status_length, false);
+    int file_desc = open(log_path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+    if(file_desc >= 0)
+    {
+        write(file_desc, line, line_length);
+        close(file_desc);
     }
 }
 
-//~ Display State
+//~ Timing Ring
+//
+// Every render, in-process or through the server, appends one fixed-size
+// record to its session's ring, /dev/shm/statusline-<uid>/timing-<session>.ring:
+// a mapped file of TIMING_RING_CAPACITY records that overwrites the oldest,
+// so telemetry stays on in production at the cost of a few stores.
+// `statusline --stats [session]` reads the rings back as per-phase
+// percentiles and the git cache-state mix.
+//
+// Writers claim a record by bumping the header's `next`; the record's
+// sequence is odd while it is written and 2 * (index + 1) once complete, so
+// a reader skips records that are empty, mid-write or overwritten under it.
 
-typedef struct Display_State Display_State;
-struct Display_State
+#define TIMING_RING_MAGIC    0x31525453u  // "STR1"
+#define TIMING_RING_VERSION  3
+#define TIMING_RING_CAPACITY 2048         // power of two
+
+typedef struct Timing_Record Timing_Record;
+struct Timing_Record
 {
-    char   working_directory[512];
-    char   model[64];
-    double cost_usd;
-    S64    lines_added;
-    S64    lines_removed;
-    S64    total_duration_ms;
-    S64    used_percent;
-    S64    context_size;
-    S64    last_update_sec;
-    double five_hour_pct;
-    double seven_day_pct;
-    char   vim_mode[32];
+    U64 sequence;
+    S64 written_milliseconds;
+    U32 phase_us[PHASE_COUNT];
+    U32 total_us;
+    U8  cache_state;
+    U8  stdin_result;          // enum Stdin_Result
+    U8  from_server;
+    U8  reserved[5];
 };
 
-//~ Stdin Reader
+typedef struct Timing_Ring_Header Timing_Ring_Header;
+struct Timing_Ring_Header
+{
+    U32 magic;
+    U32 version;
+    U32 capacity;
+    U32 record_size;
+    char session_name[SESSION_NAME_CAPACITY];
+    U32 checksum;              // CRC-32 of the fields above
+    U64 next;                  // records ever claimed
+    U8  reserved[32];
+};
+
+typedef struct Timing_Ring Timing_Ring;
+struct Timing_Ring
+{
+    Timing_Ring_Header header;
+    Timing_Record      records[TIMING_RING_CAPACITY];
+};
 
-#define STDIN_TIMEOUT_MS 50
+// The server renders for many sessions; keep the last ring mapped
+internal Timing_Ring *timing_ring;
+internal U64          timing_ring_session;
+
+internal U32
+timing_ring_header_checksum(const Timing_Ring_Header *header)
+{
+    return (U32)crc32(0, (const Bytef *)header, offsetof(Timing_Ring_Header, checksum));
+}
 
 internal B32
-read_stdin(char *buffer, U64 buffer_capacity, U64 *output_length)
+timing_ring_header_valid(const void *mapping)
 {
-    *output_length = 0;
-    struct pollfd poll_fd = {.fd = STDIN_FILENO, .events = POLLIN};
-    if(poll(&poll_fd, 1, STDIN_TIMEOUT_MS) <= 0) return false;
+    const Timing_Ring_Header *header = mapping;
+    return header->magic == TIMING_RING_MAGIC && header->version == TIMING_RING_VERSION &&
+           header->capacity == TIMING_RING_CAPACITY && header->record_size == sizeof(Timing_Record) &&
+           header->checksum == timing_ring_header_checksum(header);
+}
 
-    // Single read — JSON is <4KB, always arrives atomically via pipe (PIPE_BUF=4096)
-    ssize_t bytes_read = read(STDIN_FILENO, buffer, buffer_capacity - 1);
-    if(bytes_read <= 0) return false;
-    *output_length = (U64)bytes_read;
-    buffer[*output_length] = '\0';
-    return true;
+internal Timing_Ring *
+timing_ring_get(const Session_Identity *identity)
+{
+    if(timing_ring && timing_ring_session == identity->key) return timing_ring;
+    if(timing_ring) munmap(timing_ring, sizeof(Timing_Ring));
+    timing_ring = NULL;
+
+    int directory_fd = state_directory_open();
+    if(directory_fd < 0) return NULL;
+
+    char name[SESSION_NAME_CAPACITY + 16];
+    String_Builder ring_name = string_builder(name, sizeof(name));
+    string_append_literal(&ring_name, "timing-");
+    string_append_cstring(&ring_name, identity->name);
+    string_append_literal(&ring_name, ".ring");
+
+    Timing_Ring_Header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = TIMING_RING_MAGIC;
+    header.version = TIMING_RING_VERSION;
+    header.capacity = TIMING_RING_CAPACITY;
+    header.record_size = sizeof(Timing_Record);
+    memcpy(header.session_name, identity->name, sizeof(header.session_name));
+    header.checksum = timing_ring_header_checksum(&header);
+
+    timing_ring = shared_file_map(directory_fd, name, &header, sizeof(header), sizeof(Timing_Ring),
+                                  timing_ring_header_valid);
+    timing_ring_session = identity->key;
+    close(directory_fd);
+    return timing_ring;
 }
 
-//~ State Resolution (uses single-pass JSON parser)
+internal U32
+timing_clamp_us(U64 microseconds)
+{
+    return (U32)Min(microseconds, (U64)0xffffffffu);
+}
 
 internal void
-resolve_state(const char *input, B32 has_stdin, Display_State *state)
+timing_ring_append(const Session_Identity *identity, const Render_Timings *timings, enum Cache_State cache_state,
+                   enum Stdin_Result stdin_result, B32 from_server)
 {
-    Cached_State cached;
-    memset(&cached, 0, sizeof(cached));
-    read_cached_state(&cached);
-
-    memset(state, 0, sizeof(*state));
-
-    if(has_stdin)
-    {
-        Json_Parsed_Fields fields;
-        json_parse_all(input, &fields);
-
-        // Copy string fields
-        if(fields.current_dir_length > 0)
-        {
-            U64 cwd_length = Min(fields.current_dir_length, sizeof(state->working_directory) - 1);
-            memcpy(state->working_directory, fields.current_dir, cwd_length);
-            state->working_directory[cwd_length] = '\0';
-        }
-        else if(cached.working_directory[0])
-            strcpy(state->working_directory, cached.working_directory);
-
-        if(fields.display_name_length > 0)
-        {
-            U64 model_length = Min(fields.display_name_length, sizeof(state->model) - 1);
-            memcpy(state->model, fields.display_name, model_length);
-            state->model[model_length] = '\0';
-        }
-        else if(cached.model[0])
-            strcpy(state->model, cached.model);
-
-        if(fields.mode_length > 0)
-        {
-            U64 vim_mode_length = Min(fields.mode_length, sizeof(state->vim_mode) - 1);
-            memcpy(state->vim_mode, fields.mode, vim_mode_length);
-            state->vim_mode[vim_mode_length] = '\0';
-        }
+    Timing_Ring *ring = timing_ring_get(identity);
+    if(ring == NULL) return;
+
+    U64 index = __atomic_fetch_add(&ring->header.next, 1, __ATOMIC_RELAXED);
+    Timing_Record *record = &ring->records[index & (TIMING_RING_CAPACITY - 1)];
+    __atomic_store_n(&record->sequence, 2 * index + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    record->written_milliseconds    = time_milliseconds_realtime();
+    record->phase_us[PHASE_READ]    = timing_clamp_us(timings->read_us);
+    record->phase_us[PHASE_PARSE]   = timing_clamp_us(timings->parse_us);
+    record->phase_us[PHASE_GIT]     = timing_clamp_us(timings->git_us);
+    record->phase_us[PHASE_BUILD]   = timing_clamp_us(timings->build_us);
+    record->total_us                = timing_clamp_us(time_microseconds() - timings->start);
+    record->cache_state             = (U8)cache_state;
+    record->stdin_result            = (U8)stdin_result;
+    record->from_server             = (U8)from_server;
+
+    __atomic_store_n(&record->sequence, 2 * index + 2, __ATOMIC_RELEASE);
+}
 
-        state->cost_usd          = fields.total_cost_usd > 0 ? fields.total_cost_usd : cached.cost_usd;
-        state->lines_added       = fields.total_lines_added > 0 ? fields.total_lines_added : cached.lines_added;
-        state->lines_removed     = fields.total_lines_removed > 0 ? fields.total_lines_removed : cached.lines_removed;
-        state->total_duration_ms = fields.total_duration_ms > 0 ? fields.total_duration_ms : cached.duration_ms;
-        state->used_percent      = fields.used_percentage > 0 ? fields.used_percentage : cached.used_percent;
-        state->context_size      = fields.context_window_size > 0 ? fields.context_window_size : cached.context_size;
-        state->last_update_sec   = (S64)time(NULL);
+//~ Timing Stats
 
-        // Update cache
-        Cached_State new_cache;
-        new_cache.used_percent  = Max(fields.used_percentage, cached.used_percent);
-        new_cache.context_size  = Max(fields.context_window_size, cached.context_size);
-        new_cache.cost_usd      = fields.total_cost_usd > cached.cost_usd ? fields.total_cost_usd : cached.cost_usd;
-        new_cache.lines_added   = Max(fields.total_lines_added, cached.lines_added);
-        new_cache.lines_removed = Max(fields.total_lines_removed, cached.lines_removed);
-        new_cache.duration_ms   = Max(fields.total_duration_ms, cached.duration_ms);
-        new_cache.last_update_sec = state->last_update_sec;
+internal int
+compare_u32(const void *left, const void *right)
+{
+    U32 a = *(const U32 *)left, b = *(const U32 *)right;
+    return (a > b) - (a < b);
+}
 
-        memset(new_cache.working_directory, 0, sizeof(new_cache.working_directory));
-        memset(new_cache.model, 0, sizeof(new_cache.model));
-        if(fields.current_dir_length > 0)
-            memcpy(new_cache.working_directory, fields.current_dir, Min(fields.current_dir_length, sizeof(new_cache.working_directory) - 1));
-        else
-            memcpy(new_cache.working_directory, cached.working_directory, sizeof(new_cache.working_directory));
+// Nearest-rank percentile of an ascending array
+internal U32
+percentile_u32(const U32 *sorted, U32 count, double fraction)
+{
+    U32 rank = (U32)(fraction * count + 0.999999);
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
 
-        if(fields.display_name_length > 0)
-            memcpy(new_cache.model, fields.display_name, Min(fields.display_name_length, sizeof(new_cache.model) - 1));
-        else
-            memcpy(new_cache.model, cached.model, sizeof(new_cache.model));
+internal void
+print_ring_stats(int directory_fd, const char *name)
+{
+    int file_desc = openat(directory_fd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if(file_desc < 0) { fprintf(stderr, "%s: %s\n", name, strerror(errno)); return; }
+    struct stat file_stat;
+    const Timing_Ring *ring = MAP_FAILED;
+    if(fstat(file_desc, &file_stat) == 0 && file_stat.st_size == (off_t)sizeof(Timing_Ring))
+        ring = mmap(NULL, sizeof(Timing_Ring), PROT_READ, MAP_SHARED, file_desc, 0);
+    close(file_desc);
+    if(ring == MAP_FAILED || !timing_ring_header_valid(ring))
+    {
+        fprintf(stderr, "%s: not a timing ring\n", name);
+        if(ring != MAP_FAILED) munmap((void *)ring, sizeof(Timing_Ring));
+        return;
+    }
 
-        if(memcmp(&new_cache, &cached, sizeof(Cached_State)) != 0)
-            write_cached_state(&new_cache);
+    // Rows are the phases, then the total
+    static U32 samples[PHASE_COUNT + 1][TIMING_RING_CAPACITY];
+    U32 count = 0, cache_counts[3] = {0}, timeouts = 0, truncated = 0, served = 0;
+    S64 newest_milliseconds = 0;
+    for(U32 index = 0; index < TIMING_RING_CAPACITY; index++)
+    {
+        const Timing_Record *slot = &ring->records[index];
+        U64 sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        if(sequence == 0 || (sequence & 1)) continue;
+        Timing_Record record;
+        memcpy(&record, slot, sizeof(record));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != sequence) continue;
+
+        for(int phase = 0; phase < PHASE_COUNT; phase++) samples[phase][count] = record.phase_us[phase];
+        samples[PHASE_COUNT][count] = record.total_us;
+        if(record.cache_state <= CACHE_VALID) cache_counts[record.cache_state]++;
+        if(record.stdin_result == STDIN_NONE) timeouts++;
+        if(record.stdin_result == STDIN_TRUNCATED) truncated++;
+        if(record.from_server) served++;
+        newest_milliseconds = Max(newest_milliseconds, record.written_milliseconds);
+        count++;
     }
-    else
+    U64 renders = __atomic_load_n(&ring->header.next, __ATOMIC_RELAXED);
+    char session_name[SESSION_NAME_CAPACITY];
+    memcpy(session_name, ring->header.session_name, sizeof(session_name));
+    session_name[sizeof(session_name) - 1] = '\0';
+    munmap((void *)ring, sizeof(Timing_Ring));
+
+    printf("session %s: %llu renders, last %u kept", session_name, (unsigned long long)renders, count);
+    if(count == 0) { printf("\n\n"); return; }
+    printf(", newest %llds ago\n", (long long)((time_milliseconds_realtime() - newest_milliseconds) / 1000));
+
+    static const char *row_names[PHASE_COUNT + 1] = {"read", "parse", "git", "build", "total"};
+    printf("  %-8s %9s %9s %9s   (us)\n", "phase", "p50", "p99", "max");
+    for(int row = 0; row <= PHASE_COUNT; row++)
     {
-        if(cached.working_directory[0]) strcpy(state->working_directory, cached.working_directory);
-        if(cached.model[0]) strcpy(state->model, cached.model);
-        state->cost_usd          = cached.cost_usd;
-        state->lines_added       = cached.lines_added;
-        state->lines_removed     = cached.lines_removed;
-        state->total_duration_ms = cached.duration_ms;
-        state->used_percent      = cached.used_percent;
-        state->context_size      = cached.context_size;
-        state->last_update_sec   = cached.last_update_sec;
+        qsort(samples[row], count, sizeof(U32), compare_u32);
+        printf("  %-8s %9u %9u %9u\n", row_names[row], percentile_u32(samples[row], count, 0.50),
+               percentile_u32(samples[row], count, 0.99), samples[row][count - 1]);
     }
+    printf("  git cache: valid %u (%.1f%%)  stale %u (%.1f%%)  miss %u (%.1f%%)\n",
+           cache_counts[CACHE_VALID], 100.0 * cache_counts[CACHE_VALID] / count,
+           cache_counts[CACHE_STALE], 100.0 * cache_counts[CACHE_STALE] / count,
+           cache_counts[CACHE_NONE],  100.0 * cache_counts[CACHE_NONE]  / count);
+    printf("  stdin timeouts %u, truncated %u, via server %u\n\n", timeouts, truncated, served);
 }
-
-//~ Statusline Builder (snprintf-free)
-
-internal void
-build_statusline(Output_Buffer *buffer, Display_State *state, Git_Status *git_status)
+
+// `statusline --stats [session]`: one session's ring, or every ring
+internal int
+stats_main(const char *session)
 {
-    B32 first = true;
+    int directory_fd = state_directory_open();
+    if(directory_fd < 0) { fprintf(stderr, "statusline: no state directory\n"); return 1; }
 
-    // Vim mode (icon only, color indicates mode)
-    if(state->vim_mode[0])
+    int exit_code = 0;
+    if(session)
     {
-        const char *vim_background, *vim_foreground, *vim_icon;
-        U64 vim_background_length, vim_foreground_length, vim_icon_length;
-        B32 is_insert = (strcmp(state->vim_mode, "INSERT") == 0);
-        if(is_insert)
-        {
-            vim_background = ANSI_BG_GREEN; vim_background_length = sizeof(ANSI_BG_GREEN)-1;
-            vim_foreground = ANSI_FG_BLACK; vim_foreground_length = sizeof(ANSI_FG_BLACK)-1;
-            vim_icon = ICON_INSERT; vim_icon_length = sizeof(ICON_INSERT)-1;
-        }
+        // A session_id, or Claude's pid for sessions without one
+        char name[SESSION_NAME_CAPACITY + 16];
+        B32 numeric = session[0] && strspn(session, "0123456789") == strlen(session);
+        snprintf(name, sizeof(name), numeric ? "timing-pid-%s.ring" : "timing-%s.ring", session);
+        if(session_name_valid(session, strlen(session)) && faccessat(directory_fd, name, R_OK, 0) == 0)
+            print_ring_stats(directory_fd, name);
         else
         {
-            vim_background = ANSI_BG_DARK;  vim_background_length = sizeof(ANSI_BG_DARK)-1;
-            vim_foreground = ANSI_FG_WHITE; vim_foreground_length = sizeof(ANSI_FG_WHITE)-1;
-            vim_icon = ICON_NORMAL; vim_icon_length = sizeof(ICON_NORMAL)-1;
+            fprintf(stderr, "statusline: no timings for session %s\n", session);
+            exit_code = 1;
         }
-
-        char vim_text[64];
-        char *cursor = vim_text;
-        if(is_insert)
+    }
+    else
+    {
+        DIR *directory = fdopendir(dup(directory_fd));
+        U32 found = 0;
+        struct dirent *entry;
+        while(directory && (entry = readdir(directory)) != NULL)
         {
-            memcpy(cursor, ANSI_BOLD, sizeof(ANSI_BOLD)-1); cursor += sizeof(ANSI_BOLD)-1;
+            U64 name_length = strlen(entry->d_name);
+            if(strncmp(entry->d_name, "timing-", 7) != 0 || name_length < 13 ||
+               strcmp(entry->d_name + name_length - 5, ".ring") != 0)
+                continue;
+            print_ring_stats(directory_fd, entry->d_name);
+            found++;
         }
-        memcpy(cursor, vim_icon, vim_icon_length); cursor += vim_icon_length;
-
-        segment(buffer, vim_background, vim_background_length, vim_foreground, vim_foreground_length, vim_text, (U64)(cursor - vim_text), first);
-        first = false;
+        if(directory) closedir(directory);
+        if(found == 0) { fprintf(stderr, "statusline: no timings recorded yet\n"); exit_code = 1; }
     }
+    close(directory_fd);
+    return exit_code;
+}
 
-    // Model (abbreviated, bold)
-    {
-        char abbrev[32];
-        U64 abbrev_length = abbreviate_model(state->model, abbrev, sizeof(abbrev));
+//~ Resident Server
+//
+// `statusline --server` listens on $XDG_RUNTIME_DIR/statusline.sock (or
+// /tmp/statusline-<uid>/server.sock) and renders with the state table kept
+// mapped across requests. The exec'd binary becomes a thin client: it
+// forwards stdin, prints the reply, and renders in-process if anything goes
+// wrong. A missing server is started detached on first use; it exits after
+// SERVER_IDLE_TIMEOUT_S or once its executable has been replaced by
+// `make install`.
+//
+// While its stdin is still on the way, the client sends a payload-less
+// SERVER_FLAG_PREFETCH request, and the server speculates the git work for
+// that session's last directory before the real request arrives.
+//
+// Connections are served one at a time, so the server never computes git
+// counts itself: stale ones are shown while a background refresh (or the
+// watcher) replaces them, and for a repo with none cached at all it replies
+// SERVER_REPLY_DEFERRED and the client renders in-process. One slow repo
+// can't hold up the other sessions' renders.
+//
+// Set STATUSLINE_NO_SERVER to always render in-process.
+
+#define SERVER_MAGIC              0x31534c53u  // "SLS1"
+#define SERVER_FLAG_HAS_STDIN     (1u << 0)
+#define SERVER_FLAG_DEBUG         (1u << 1)
+#define SERVER_FLAG_PREFETCH      (1u << 2)
+#define SERVER_MAX_PAYLOAD        (16u << 20)
+#define SERVER_REPLY_DEFERRED     0xffffffffu  // reply length: render in-process
+#define SERVER_REQUEST_TIMEOUT_MS 100
+#define SERVER_REPLY_TIMEOUT_MS   1000
+#define SERVER_IDLE_TIMEOUT_S     1800
+#define SERVER_EXE_CHECK_S        5
+
+typedef struct Server_Request_Header Server_Request_Header;
+struct Server_Request_Header
+{
+    U32 magic;
+    U32 flags;
+    S32 parent_pid;
+    U32 payload_length;
+};
 
-        char model_text[128];
-        memcpy(model_text, ANSI_BOLD, sizeof(ANSI_BOLD)-1);
-        memcpy(model_text + sizeof(ANSI_BOLD)-1, abbrev, abbrev_length);
-        U64 text_length = sizeof(ANSI_BOLD)-1 + abbrev_length;
+typedef struct Server_Reply_Header Server_Reply_Header;
+struct Server_Reply_Header
+{
+    U32 magic;
+    U32 length;
+};
 
-        segment_literal(buffer, ANSI_BG_PURPLE, ANSI_FG_BLACK, model_text, text_length, first);
-        first = false;
-    }
+internal B32
+server_socket_path(char *output, U64 output_capacity)
+{
+    return runtime_socket_path("statusline.sock", "server.sock", output, output_capacity);
+}
 
-    // Path
+// Read exactly `length` bytes before `deadline` (time_microseconds clock)
+internal B32
+read_full(int file_desc, void *buffer, U64 length, U64 deadline)
+{
+    U64 total = 0;
+    while(total < length)
     {
-        char path_text[300];
-        memcpy(path_text, ICON_FOLDER " ", sizeof(ICON_FOLDER " ")-1);
-        U64 prefix_length = sizeof(ICON_FOLDER " ")-1;
-        U64 abbreviated_length = abbreviate_path(state->working_directory, path_text + prefix_length, sizeof(path_text) - prefix_length);
-
-        segment_literal(buffer, ANSI_BG_DARK, ANSI_FG_WHITE, path_text, prefix_length + abbreviated_length, false);
+        U64 now = time_microseconds();
+        if(now >= deadline) return false;
+        struct pollfd poll_fd = {.fd = file_desc, .events = POLLIN};
+        if(poll(&poll_fd, 1, (int)((deadline - now + 999) / 1000)) <= 0) return false;
+
+        ssize_t bytes_read = read(file_desc, (char *)buffer + total, length - total);
+        if(bytes_read <= 0) return false;
+        total += (U64)bytes_read;
     }
+    return true;
+}
 
-    // Git
-    if(git_status->valid)
-        build_git_segment(buffer, git_status);
+internal Git_Speculation server_speculation;
 
-    // Cost
-    {
-        const char *cost_background; U64 cost_background_length;
-        if(state->cost_usd >= 10.0)      { cost_background = ANSI_BG_RED;    cost_background_length = sizeof(ANSI_BG_RED)-1;    }
-        else if(state->cost_usd >= 5.0)  { cost_background = ANSI_BG_ORANGE; cost_background_length = sizeof(ANSI_BG_ORANGE)-1; }
-        else if(state->cost_usd >= 1.0)  { cost_background = ANSI_BG_CYAN;   cost_background_length = sizeof(ANSI_BG_CYAN)-1;   }
-        else                             { cost_background = ANSI_BG_MINT;   cost_background_length = sizeof(ANSI_BG_MINT)-1;   }
+internal void
+server_handle_connection(int client_fd)
+{
+    struct ucred credentials;
+    socklen_t credentials_length = sizeof(credentials);
+    if(getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED, &credentials, &credentials_length) != 0 ||
+       credentials.uid != getuid())
+        return;
 
-        char cost_text[64];
-        char *cursor = cost_text;
-        memcpy(cursor, ICON_DOLLAR " ", sizeof(ICON_DOLLAR " ")-1); cursor += sizeof(ICON_DOLLAR " ")-1;
-        cursor += format_f64(cursor, state->cost_usd, 2);
+    Render_Timings timings;
+    memset(&timings, 0, sizeof(timings));
+    timings.start = time_microseconds();
 
-        segment(buffer, cost_background, cost_background_length, ANSI_FG_BLACK, sizeof(ANSI_FG_BLACK)-1,
-                cost_text, (U64)(cursor - cost_text), false);
+    U64 deadline = timings.start + SERVER_REQUEST_TIMEOUT_MS * 1000;
+    Server_Request_Header header;
+    if(!read_full(client_fd, &header, sizeof(header), deadline)) return;
+    if(header.magic != SERVER_MAGIC || header.payload_length >= SERVER_MAX_PAYLOAD) return;
+    if(header.flags & SERVER_FLAG_PREFETCH)
+    {
+        git_speculate(header.parent_pid, &server_speculation);
+        return;
     }
 
-    // Usage quota
-    if(state->five_hour_pct >= 50 || state->seven_day_pct >= 50)
+    // The client has already read it to the end, so it is parsed whole
+    // here; a payload that stops inside the root object was truncated
+    Stdin_Arena input;
+    stdin_arena_init(&input);
+    if(!stdin_arena_reserve(&input, header.payload_length, NULL) ||
+       !read_full(client_fd, input.data, header.payload_length, deadline))
     {
-        char usage_text[256];
-        char *cursor = usage_text;
+        stdin_arena_release(&input);
+        return;
+    }
+    input.length = header.payload_length;
+    input.data[input.length] = '\0';
 
-        // 5h: white label, bold colored percentage
-        const char *color_5h;
-        U64 color_5h_len;
-        if(state->five_hour_pct >= 90)       { color_5h = ANSI_FG_RED;    color_5h_len = sizeof(ANSI_FG_RED)-1;    }
-        else if(state->five_hour_pct >= 80)  { color_5h = ANSI_FG_ORANGE; color_5h_len = sizeof(ANSI_FG_ORANGE)-1; }
-        else if(state->five_hour_pct >= 50)  { color_5h = ANSI_FG_YELLOW; color_5h_len = sizeof(ANSI_FG_YELLOW)-1; }
-        else                                 { color_5h = ANSI_FG_GREEN;  color_5h_len = sizeof(ANSI_FG_GREEN)-1;  }
+    Json_Parsed_Fields fields;
+    B32 complete = json_parse_all(input.data, &fields);
+    enum Stdin_Result stdin_result = !(header.flags & SERVER_FLAG_HAS_STDIN) ? STDIN_NONE :
+                                     complete ? STDIN_COMPLETE : STDIN_TRUNCATED;
+    B32 debug = (header.flags & SERVER_FLAG_DEBUG) != 0;
 
-        memcpy(cursor, ANSI_FG_WHITE, sizeof(ANSI_FG_WHITE)-1); cursor += sizeof(ANSI_FG_WHITE)-1;
-        memcpy(cursor, "5h ", 3); cursor += 3;
-        memcpy(cursor, ANSI_BOLD, sizeof(ANSI_BOLD)-1); cursor += sizeof(ANSI_BOLD)-1;
-        memcpy(cursor, color_5h, color_5h_len); cursor += color_5h_len;
-        cursor += format_u64(cursor, (U64)(state->five_hour_pct + 0.5));
-        *cursor++ = '%';
+    timings.read_us = time_microseconds() - timings.start;
 
-        // Faint separator
-        memcpy(cursor, " " ANSI_FG_WHITE, sizeof(" " ANSI_FG_WHITE)-1);
-        cursor += sizeof(" " ANSI_FG_WHITE)-1;
+    // The request is already read, so the log starts at parse
+    Perf_Group perf;
+    if(debug) perf_group_open(&perf);
+    timings.perf = debug ? &perf : NULL;
 
-        // 7d: white label, bold colored percentage
-        const char *color_7d;
-        U64 color_7d_len;
-        if(state->seven_day_pct >= 90)       { color_7d = ANSI_FG_RED;    color_7d_len = sizeof(ANSI_FG_RED)-1;    }
-        else if(state->seven_day_pct >= 80)  { color_7d = ANSI_FG_ORANGE; color_7d_len = sizeof(ANSI_FG_ORANGE)-1; }
-        else if(state->seven_day_pct >= 50)  { color_7d = ANSI_FG_YELLOW; color_7d_len = sizeof(ANSI_FG_YELLOW)-1; }
-        else                                 { color_7d = ANSI_FG_GREEN;  color_7d_len = sizeof(ANSI_FG_GREEN)-1;  }
+    Session_Identity identity;
+    Output_Buffer output_buffer;
+    memset(&output_buffer, 0, sizeof(output_buffer));
+    enum Cache_State cache_state = render_statusline(&output_buffer, &fields, stdin_result, header.parent_pid,
+                                                     &server_speculation, GIT_RESOLVE_BACKGROUND, &identity,
+                                                     &timings);
+    stdin_arena_release(&input);
+    if(timings.git_deferred)
+    {
+        // The client's own render does the bookkeeping
+        Server_Reply_Header reply = {SERVER_MAGIC, SERVER_REPLY_DEFERRED};
+        write(client_fd, &reply, sizeof(reply));
+        if(debug) perf_group_close(&perf);
+        return;
+    }
+    if(debug) output_debug_timing(&output_buffer, timings.start);
 
-        memcpy(cursor, "7d ", 3); cursor += 3;
-        memcpy(cursor, ANSI_BOLD, sizeof(ANSI_BOLD)-1); cursor += sizeof(ANSI_BOLD)-1;
-        memcpy(cursor, color_7d, color_7d_len); cursor += color_7d_len;
-        cursor += format_u64(cursor, (U64)(state->seven_day_pct + 0.5));
-        *cursor++ = '%';
+    Server_Reply_Header reply = {SERVER_MAGIC, (U32)output_buffer.length};
+    struct iovec parts[2] = {
+        {.iov_base = &reply, .iov_len = sizeof(reply)},
+        {.iov_base = output_buffer.data, .iov_len = output_buffer.length},
+    };
+    writev(client_fd, parts, 2);
 
-        segment_no_foreground(buffer, ANSI_BG_COMMENT, usage_text, (U64)(cursor - usage_text), false);
+    timing_ring_append(&identity, &timings, cache_state, stdin_result, true);
+    if(debug)
+    {
+        write_debug_log(&identity, &timings, cache_state, stdin_result);
+        perf_group_close(&perf);
     }
+    U32 files = OWNED_SESSION_SLOT | OWNED_TIMING_RING | (debug ? OWNED_DEBUG_LOG : 0);
+    if(session_alias_note(&identity)) files |= OWNED_SESSION_ALIAS;
+    owned_files_note(&identity, files);
+    reap_if_due();
+}
 
-    // Session duration + last update time
-    if(state->total_duration_ms > 0)
+internal int
+server_main(void)
+{
+    char socket_path[108];
+    if(!server_socket_path(socket_path, sizeof(socket_path))) return 1;
+
+    // One server per socket: the flock is held for the server's lifetime
+    char lock_path[128];
+    path_join(lock_path, sizeof(lock_path), socket_path, ".lock");
+    int lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if(lock_fd < 0) return 1;
+    if(flock(lock_fd, LOCK_EX | LOCK_NB) != 0) return 0;
+
+    char exe_path[512];
+    ssize_t exe_length = readlink("/proc/self/exe", exe_path, sizeof(exe_path) - 1);
+    if(exe_length <= 0) return 1;
+    exe_path[exe_length] = '\0';
+    struct stat exe_stat;
+    if(stat(exe_path, &exe_stat) != 0) return 1;
+
+    state_table_resident = true;
+
+    // SIGCHLD stays at its default: with it ignored, waitpid on a git child
+    // fails with ECHILD and no exit status. Detached children are reaped below.
+    signal(SIGPIPE, SIG_IGN);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(listen_fd < 0) return 1;
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, socket_path, strlen(socket_path));
+
+    unlink(socket_path);
+    mode_t previous_umask = umask(0077);
+    int bound = bind(listen_fd, (struct sockaddr *)&address, sizeof(address));
+    umask(previous_umask);
+    if(bound != 0 || listen(listen_fd, 64) != 0) return 1;
+
+    // Keep the state table mapped for the server's lifetime
+    state_table_get();
+
+    S64 last_exe_check_sec = (S64)time(NULL);
+    for(;;)
     {
-        char duration_text[256];
-        char *cursor = duration_text;
-        memcpy(cursor, ANSI_FG_WHITE ICON_CLOCK " ", sizeof(ANSI_FG_WHITE ICON_CLOCK " ")-1); cursor += sizeof(ANSI_FG_WHITE ICON_CLOCK " ")-1;
-        cursor += format_duration(state->total_duration_ms, cursor);
+        struct pollfd poll_fd = {.fd = listen_fd, .events = POLLIN};
+        int ready = poll(&poll_fd, 1, SERVER_IDLE_TIMEOUT_S * 1000);
+        if(ready == 0) break;
+        if(ready < 0) continue;
 
-        if(state->last_update_sec > 0)
+        int client_fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if(client_fd >= 0)
         {
-            // Faint separator
-            memcpy(cursor, " " ANSI_FG_COMMENT "| " ANSI_FG_WHITE, sizeof(" " ANSI_FG_COMMENT "| " ANSI_FG_WHITE)-1);
-            cursor += sizeof(" " ANSI_FG_COMMENT "| " ANSI_FG_WHITE)-1;
-
-            time_t update_time = (time_t)state->last_update_sec;
-            struct tm local_time;
-            localtime_r(&update_time, &local_time);
-
-            int hour12 = local_time.tm_hour % 12;
-            if(hour12 == 0) hour12 = 12;
-            const char *ampm = local_time.tm_hour < 12 ? " AM" : " PM";
-
-            cursor += format_u64(cursor, (U64)hour12);
-            *cursor++ = ':';
-            if(local_time.tm_min < 10) *cursor++ = '0';
-            cursor += format_u64(cursor, (U64)local_time.tm_min);
-            *cursor++ = ':';
-            if(local_time.tm_sec < 10) *cursor++ = '0';
-            cursor += format_u64(cursor, (U64)local_time.tm_sec);
-            memcpy(cursor, ampm, 3); cursor += 3;
+            server_handle_connection(client_fd);
+            close(client_fd);
         }
 
-        // Inline context bar after duration
-        memcpy(cursor, " " ANSI_FG_COMMENT "| ", sizeof(" " ANSI_FG_COMMENT "| ")-1);
-        cursor += sizeof(" " ANSI_FG_COMMENT "| ")-1;
-        cursor += make_context_bar(state->used_percent, state->context_size, cursor, sizeof(duration_text) - (U64)(cursor - duration_text));
-
-        segment_no_foreground(buffer, ANSI_BG_DARK, duration_text, (U64)(cursor - duration_text), false);
-    }
-
-    // Context warnings
-    if(state->used_percent >= 80)
-    {
-        char warning_text[128];
-        char *cursor = warning_text;
-        const char *warning_background; U64 warning_background_length;
+        // Detached children (refreshes, the watcher) have no double fork to
+        // hand them to init; spawns are single-threaded, so no waitpid of
+        // ours is racing this
+        while(waitpid(-1, NULL, WNOHANG) > 0) {}
 
-        if(state->used_percent >= 95)
-        {
-            memcpy(cursor, ANSI_BOLD, sizeof(ANSI_BOLD)-1); cursor += sizeof(ANSI_BOLD)-1;
-            memcpy(cursor, ICON_WARN " CRITICAL COMPACT", sizeof(ICON_WARN " CRITICAL COMPACT")-1);
-            cursor += sizeof(ICON_WARN " CRITICAL COMPACT")-1;
-            warning_background = ANSI_BG_RED; warning_background_length = sizeof(ANSI_BG_RED)-1;
-        }
-        else if(state->used_percent >= 90)
-        {
-            memcpy(cursor, ANSI_BOLD, sizeof(ANSI_BOLD)-1); cursor += sizeof(ANSI_BOLD)-1;
-            memcpy(cursor, ICON_WARN " LOW CTX COMPACT", sizeof(ICON_WARN " LOW CTX COMPACT")-1);
-            cursor += sizeof(ICON_WARN " LOW CTX COMPACT")-1;
-            warning_background = ANSI_BG_RED; warning_background_length = sizeof(ANSI_BG_RED)-1;
-        }
-        else
+        S64 now = (S64)time(NULL);
+        if(now - last_exe_check_sec >= SERVER_EXE_CHECK_S)
         {
-            memcpy(cursor, ICON_WARN " CTX 80%+", sizeof(ICON_WARN " CTX 80%+")-1);
-            cursor += sizeof(ICON_WARN " CTX 80%+")-1;
-            warning_background = ANSI_BG_YELLOW; warning_background_length = sizeof(ANSI_BG_YELLOW)-1;
+            last_exe_check_sec = now;
+            if(executable_changed(exe_path, &exe_stat)) break;
         }
-
-        segment(buffer, warning_background, warning_background_length, ANSI_FG_BLACK, sizeof(ANSI_FG_BLACK)-1,
-                warning_text, (U64)(cursor - warning_text), false);
     }
 
-    segment_end(buffer);
+    unlink(socket_path);
+    return 0;
 }
 
-//~ Debug Logging
-
-internal void
-write_debug_log(U64 time_start, U64 time_cleanup, U64 time_read, U64 time_parse,
-                U64 time_git, U64 time_build, enum Cache_State cache_state, B32 has_stdin)
+// -1 if there's no server to talk to; a missing one is started for next time
+internal int
+server_connect(void)
 {
-    U64 time_end = time_microseconds();
-    int grandparent_pid = get_grandparent_pid();
-
-    const char *cache_string;
-    switch(cache_state)
-    {
-    case CACHE_VALID: cache_string = "valid"; break;
-    case CACHE_STALE: cache_string = "stale"; break;
-    case CACHE_NONE:  cache_string = "miss";  break;
-    default:          cache_string = "?";     break;
-    }
+    if(getenv("STATUSLINE_NO_SERVER") != NULL) return -1;
 
-    char line[512];
-    int line_length = snprintf(line, sizeof(line),
-        "cleanup=%lluus read=%lluus(%s) parse=%lluus git=%lluus(%s) build=%lluus total=%lluus\n",
-        (unsigned long long)(time_cleanup - time_start),
-        (unsigned long long)(time_read - time_cleanup),
-        has_stdin ? "ok" : "timeout",
-        (unsigned long long)(time_parse - time_read),
-        (unsigned long long)(time_git - time_parse),
-        cache_string,
-        (unsigned long long)(time_build - time_git),
-        (unsigned long long)(time_end - time_start));
+    char socket_path[108];
+    if(!server_socket_path(socket_path, sizeof(socket_path))) return -1;
 
-    uid_t uid = getuid();
-    char directory_path[64];
-    snprintf(directory_path, sizeof(directory_path), "/tmp/statusline-%d", uid);
-    mkdir(directory_path, 0700);
+    int server_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(server_fd < 0) return -1;
 
-    char log_path[96];
-    snprintf(log_path, sizeof(log_path), "%s/%d.log", directory_path, grandparent_pid);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, socket_path, strlen(socket_path));
 
-    int file_desc = open(log_path, O_WRONLY | O_CREAT | O_APPEND, 0600);
-    if(file_desc >= 0)
+    if(connect(server_fd, (struct sockaddr *)&address, sizeof(address)) != 0)
     {
-        write(file_desc, line, line_length);
-        close(file_desc);
+        close(server_fd);
+        if(errno == ENOENT || errno == ECONNREFUSED) spawn_detached_self("--server", NULL);
+        return -1;
     }
+    return server_fd;
 }
 
-//~ Main
+// Ask the server to speculate for this session; false if there's no server
+internal B32
+server_prefetch(void)
+{
+    int server_fd = server_connect();
+    if(server_fd < 0) return false;
+    Server_Request_Header header = {SERVER_MAGIC, SERVER_FLAG_PREFETCH, (S32)getppid(), 0};
+    B32 sent = write(server_fd, &header, sizeof(header)) == (ssize_t)sizeof(header);
+    close(server_fd);
+    return sent;
+}
 
-int
-main(void)
+// Forward the payload to the resident server and print its reply.
+// Returns false (having written nothing) if the caller should render
+// in-process, as it should when the server defers.
+internal B32
+server_forward(const char *input, U64 input_length, enum Stdin_Result stdin_result, B32 debug)
 {
-    U64 time_start = time_microseconds();
-    B32 debug = (getenv("STATUSLINE_DEBUG") != NULL);
+    if(input_length >= SERVER_MAX_PAYLOAD) return false;
+    int server_fd = server_connect();
+    if(server_fd < 0) return false;
+
+    Server_Request_Header header;
+    header.magic = SERVER_MAGIC;
+    header.flags = (stdin_result != STDIN_NONE ? SERVER_FLAG_HAS_STDIN : 0) | (debug ? SERVER_FLAG_DEBUG : 0);
+    header.parent_pid = (S32)getppid();
+    header.payload_length = stdin_result != STDIN_NONE ? (U32)input_length : 0;
+
+    struct iovec parts[2] = {
+        {.iov_base = &header,        .iov_len = sizeof(header)},
+        {.iov_base = (void *)input,  .iov_len = header.payload_length},
+    };
+    if(writev(server_fd, parts, 2) != (ssize_t)(sizeof(header) + header.payload_length))
+    {
+        close(server_fd);
+        return false;
+    }
 
-    cleanup_stale_caches();
-    U64 time_cleanup = time_microseconds();
+    U64 deadline = time_microseconds() + SERVER_REPLY_TIMEOUT_MS * 1000;
+    Server_Reply_Header reply;
+    char reply_data[sizeof(((Output_Buffer *)0)->data)];
+    B32 ok = read_full(server_fd, &reply, sizeof(reply), deadline) &&
+             reply.magic == SERVER_MAGIC && reply.length <= sizeof(reply_data) &&
+             read_full(server_fd, reply_data, reply.length, deadline);
+    close(server_fd);
+    if(!ok) return false;
 
-    char input[8192];
-    U64 input_length;
-    B32 has_stdin = read_stdin(input, sizeof(input), &input_length);
-    U64 time_read = time_microseconds();
+    write(STDOUT_FILENO, reply_data, reply.length);
+    return true;
+}
 
-    Display_State state;
-    resolve_state(input, has_stdin, &state);
-    U64 time_parse = time_microseconds();
+//~ Main
 
-    // Usage quota (background fetch, ~5us on cache hit)
-    {
-        int gppid = get_grandparent_pid();
-        Usage_Cache usage = read_usage_cache(gppid);
-        state.five_hour_pct  = usage.five_hour_pct;
-        state.seven_day_pct  = usage.seven_day_pct;
-    }
+// Work that doesn't need the payload, done while read_stdin waits for it
+typedef struct Render_Prefetch Render_Prefetch;
+struct Render_Prefetch
+{
+    Git_Speculation git;       // in-process only; the server keeps its own
+};
 
-    // Git status
-    Git_Status git_status;
-    memset(&git_status, 0, sizeof(git_status));
-    if(state.working_directory[0] && git_read_branch_fast(state.working_directory, git_status.branch, sizeof(git_status.branch)))
-    {
-        git_status.valid = true;
-        git_status.stashes = git_read_stash_count(state.working_directory);
-        get_git_status_cached(state.working_directory, &git_status.modified, &git_status.staged,
-                              &git_status.ahead, &git_status.behind, &git_status.cache_state);
-    }
-    U64 time_git = time_microseconds();
+internal void
+prefetch_while_waiting(void *context)
+{
+    Render_Prefetch *prefetch = context;
+    if(server_prefetch()) return;
+    git_speculate(getppid(), &prefetch->git);
+}
 
-    // Build output
+int
+main(int argc, char **argv)
+{
+    if(argc > 1 && strcmp(argv[1], "--server") == 0) return server_main();
+    if(argc > 1 && strcmp(argv[1], "--watch") == 0) return watcher_main(argc > 2 ? argv[2] : NULL);
+    if(argc > 1 && strcmp(argv[1], "--stats") == 0) return stats_main(argc > 2 ? argv[2] : NULL);
+    if(argc > 1 && strcmp(argv[1], "--reap") == 0) return reaper_main();
+    if(argc > 1 && strcmp(argv[1], "--refresh-git") == 0) return git_refresh_main(argc > 2 ? argv[2] : NULL);
+    if(argc > 1 && strcmp(argv[1], "--refresh-usage") == 0) return usage_refresh_main(argc > 2 ? argv[2] : NULL);
+
+    B32 debug = (getenv("STATUSLINE_DEBUG") != NULL);
+    Perf_Group perf;
+    if(debug) perf_group_open(&perf);
+
+    Render_Timings timings;
+    memset(&timings, 0, sizeof(timings));
+    timings.start = time_microseconds();
+    timings.perf = debug ? &perf : NULL;
+
+    // Parsed as it is read; the server gets the raw bytes and parses again
+    Stdin_Arena input;
+    stdin_arena_init(&input);
+    Json_Parsed_Fields fields;
+    Render_Prefetch prefetch;
+    memset(&prefetch, 0, sizeof(prefetch));
+    enum Stdin_Result stdin_result = read_stdin(&input, &fields, prefetch_while_waiting, &prefetch);
+    timings.read_us = time_microseconds() - timings.start;
+    perf_group_sample(timings.perf, PHASE_READ);
+
+    if(server_forward(input.data, input.length, stdin_result, debug)) return 0;
+
+    Session_Identity identity;
     Output_Buffer output_buffer;
     memset(&output_buffer, 0, sizeof(output_buffer));
-    build_statusline(&output_buffer, &state, &git_status);
-    U64 time_build = time_microseconds();
+    enum Cache_State cache_state = render_statusline(&output_buffer, &fields, stdin_result, getppid(),
+                                                     &prefetch.git, GIT_RESOLVE_FULL, &identity, &timings);
 
-    // Timing suffix (only when debug enabled)
-    if(debug)
-    {
-        U64 time_now = time_microseconds();
-        U64 total_microseconds = time_now - time_start;
-        output_literal(&output_buffer, "  " ANSI_FG_COMMENT);
-        if(total_microseconds >= 1000)
-        {
-            output_f64(&output_buffer, total_microseconds / 1000.0, 1);
-            output_literal(&output_buffer, "ms");
-        }
-        else
-        {
-            output_u64(&output_buffer, total_microseconds);
-            output_literal(&output_buffer, "us");
-        }
-        output_literal(&output_buffer, ANSI_RESET);
-    }
+    if(debug) output_debug_timing(&output_buffer, timings.start);
 
     write(STDOUT_FILENO, output_buffer.data, output_buffer.length);
 
+    timing_ring_append(&identity, &timings, cache_state, stdin_result, false);
     if(debug)
-        write_debug_log(time_start, time_cleanup, time_read, time_parse, time_git, time_build, git_status.cache_state, has_stdin);
+        write_debug_log(&identity, &timings, cache_state, stdin_result);
+    U32 files = OWNED_SESSION_SLOT | OWNED_TIMING_RING | (debug ? OWNED_DEBUG_LOG : 0);
+    if(session_alias_note(&identity)) files |= OWNED_SESSION_ALIAS;
+    owned_files_note(&identity, files);
+    reap_if_due();
 
     return 0;
 }
@@ -6,16 +6,19 @@
 // Build: odin build . -o:speed -out:statusline_odin
 // Usage: Set in ~/.claude/settings.json statusLine.command
 //
-// Shared state files:
-//   /dev/shm/statusline-cache.<gppid>   - Per-session cached state
-//   /dev/shm/statusline-usage.<gppid>   - Per-session usage quota cache
-//   /dev/shm/statusline-cleanup         - Sentinel for cleanup interval
-//   /dev/shm/claude-git-<hash>          - Per-repo git status cache
+// Shared state files (versioned + CRC-checked, see Cache Files):
+//   /dev/shm/statusline-<uid>/          - Per-user directory (0700)
+//     odin-state.<gppid>                - Per-session cached state
+//     odin-usage.<gppid>                - Per-session usage quota cache
+//     odin-git-<hash>                   - Per-repo git status cache
+//     odin-cleanup                      - Sentinel for cleanup interval
 //   /tmp/statusline-<uid>/<pid>.log     - Debug timing logs
 
 package main
 
+import "core:c/libc"
 import "core:fmt"
+import "core:hash"
 import "core:strconv"
 import "core:strings"
 import "core:sys/posix"
@@ -1037,11 +1040,128 @@ git_read_branch_fast :: proc(
     return "", false
 }
 
+/* -------------------------------------------------------------------------- */
+/* Cache Files                                                                */
+/* -------------------------------------------------------------------------- */
+
+// Each cache file is a CacheHeader followed by exactly one record. Writers
+// publish a complete private temp file and rename it into place; readers
+// reject anything whose magic, layout version, length or CRC is off, so a
+// torn or foreign (e.g. C-layout) file reads as a miss rather than garbage.
+// Bump a record's *_VERSION whenever its layout changes.
+
+CACHE_FILE_MAGIC :: 0x314f4c53 // "SLO1"
+
+CacheHeader :: struct #packed {
+    magic:   u32,
+    version: u32,
+    length:  u32,
+    crc:     u32,
+}
+
+cache_dir :: proc() -> string {
+    @(static) dir_buf: [256]u8
+    @(static) dir: string
+    if len(dir) > 0 do return dir
+
+    // STATUSLINE_STATE_DIR: the benchmark's scratch directory
+    override := posix.getenv("STATUSLINE_STATE_DIR")
+    if override != nil && len(string(override)) > 0 && string(override)[0] == '/' {
+        dir = fmt.bprintf(dir_buf[:], "%s", string(override))
+    } else {
+        dir = fmt.bprintf(
+            dir_buf[:],
+            "/dev/shm/statusline-%d",
+            posix.getuid(),
+        )
+    }
+    dir_cstr := strings.clone_to_cstring(dir, context.temp_allocator)
+    posix.mkdir(dir_cstr, {.IRUSR, .IWUSR, .IXUSR})
+    return dir
+}
+
+cache_file_publish :: proc(path: string, version: u32, record: []u8) {
+    header := CacheHeader {
+        magic   = CACHE_FILE_MAGIC,
+        version = version,
+        length  = u32(len(record)),
+        crc     = hash.crc32(record),
+    }
+
+    tmp_buf: [128]u8
+    tmp_path := fmt.bprintf(
+        tmp_buf[:],
+        "%s.%d.tmp",
+        path,
+        posix.getpid(),
+    )
+    tmp_cstr := strings.clone_to_cstring(tmp_path, context.temp_allocator)
+    path_cstr := strings.clone_to_cstring(path, context.temp_allocator)
+
+    fd := posix.open(
+        tmp_cstr,
+        {.WRONLY, .CREAT, .TRUNC, .NOFOLLOW},
+        {.IRUSR, .IWUSR},
+    )
+    if fd < 0 do return
+
+    ok :=
+        int(posix.write(fd, &header, size_of(CacheHeader))) == size_of(CacheHeader) &&
+        int(posix.write(fd, raw_data(record), uint(len(record)))) == len(record)
+    posix.close(fd)
+
+    if !ok || libc.rename(tmp_cstr, path_cstr) != 0 {
+        posix.unlink(tmp_cstr)
+    }
+}
+
+// Fills `record` and returns the file's mtime (ms) when the file is valid
+cache_file_load :: proc(
+    path: string,
+    version: u32,
+    record: []u8,
+) -> (
+    ok: bool,
+    mtime_ms: i64,
+) {
+    path_cstr := strings.clone_to_cstring(path, context.temp_allocator)
+    fd := posix.open(path_cstr, {.NOFOLLOW})
+    if fd < 0 do return false, 0
+    defer posix.close(fd)
+
+    buf: [512]u8
+    want := size_of(CacheHeader) + len(record)
+    if want > len(buf) do return false, 0
+    n := posix.read(fd, raw_data(&buf), len(buf))
+    if int(n) != want do return false, 0
+
+    header: CacheHeader
+    copy(
+        (transmute([^]u8)&header)[:size_of(CacheHeader)],
+        buf[:size_of(CacheHeader)],
+    )
+    payload := buf[size_of(CacheHeader):want]
+    if header.magic != CACHE_FILE_MAGIC ||
+       header.version != version ||
+       int(header.length) != len(record) ||
+       header.crc != hash.crc32(payload) {
+        return false, 0
+    }
+    copy(record, payload)
+
+    st: posix.stat_t
+    if posix.fstat(fd, &st) == .OK {
+        mtime_ms = i64(st.st_mtim.tv_sec) * 1000 +
+            i64(st.st_mtim.tv_nsec) / 1_000_000
+    }
+    return true, mtime_ms
+}
+
 /* -------------------------------------------------------------------------- */
 /* State Cache (prevents flicker during API calls)                            */
 /* -------------------------------------------------------------------------- */
 
-CACHE_PATH_PREFIX :: "/dev/shm/statusline-cache."
+CACHE_STATE_VERSION :: 1
 
 CachedState :: struct #packed {
     used_pct:        i64,
@@ -1099,55 +1219,44 @@ get_grandparent_pid :: proc() -> int {
 }
 
 get_cache_path :: proc() -> string {
-    @(static) path_buf: [64]u8
+    @(static) path_buf: [96]u8
     gppid := get_grandparent_pid()
     return fmt.bprintf(
         path_buf[:],
-        "%s%d",
-        CACHE_PATH_PREFIX,
+        "%s/odin-state.%d",
+        cache_dir(),
         gppid,
     )
 }
 
 read_cached_state :: proc() -> CachedState {
-    cache_path := get_cache_path()
-    cache_cstr := strings.clone_to_cstring(
-        cache_path,
-        context.temp_allocator,
-    )
-    fd := posix.open(cache_cstr, {})
-    if fd < 0 do return {}
-    defer posix.close(fd)
-
     state: CachedState
-    buf := transmute([^]u8)&state
-    n := posix.read(fd, buf, size_of(CachedState))
-    if n != size_of(CachedState) do return {}
+    record := (transmute([^]u8)&state)[:size_of(CachedState)]
+    if ok, _ := cache_file_load(get_cache_path(), CACHE_STATE_VERSION, record); !ok {
+        return {}
+    }
     return state
 }
 
 write_cached_state :: proc(state: CachedState) {
-    cache_path := get_cache_path()
-    cache_cstr := strings.clone_to_cstring(
-        cache_path,
-        context.temp_allocator,
-    )
-    fd := posix.open(
-        cache_cstr,
-        {.WRONLY, .CREAT, .TRUNC},
-        {.IRUSR, .IWUSR},
-    )
-    if fd < 0 do return
-    defer posix.close(fd)
     s := state
-    buf := transmute([^]u8)&s
-    posix.write(fd, buf, size_of(CachedState))
+    record := (transmute([^]u8)&s)[:size_of(CachedState)]
+    cache_file_publish(get_cache_path(), CACHE_STATE_VERSION, record)
 }
 
 CLEANUP_INTERVAL_S :: 300
 
 cleanup_stale_caches :: proc() {
-    sentinel_cstr: cstring = "/dev/shm/statusline-cleanup"
+    sentinel_buf: [96]u8
+    sentinel_path := fmt.bprintf(
+        sentinel_buf[:],
+        "%s/odin-cleanup",
+        cache_dir(),
+    )
+    sentinel_cstr := strings.clone_to_cstring(
+        sentinel_path,
+        context.temp_allocator,
+    )
     st: posix.stat_t
     now_ms := current_time_ms()
     if posix.stat(sentinel_cstr, &st) == .OK {
@@ -1158,14 +1267,18 @@ cleanup_stale_caches :: proc() {
     }
     sentinel_fd := posix.open(
         sentinel_cstr,
-        {.WRONLY, .CREAT, .TRUNC},
-        {.IRUSR, .IWUSR, .IRGRP, .IWGRP, .IROTH, .IWOTH},
+        {.WRONLY, .CREAT, .TRUNC, .NOFOLLOW},
+        {.IRUSR, .IWUSR},
     )
     if sentinel_fd >= 0 do posix.close(sentinel_fd)
 
-    SHM_DIR :: "/dev/shm"
+    shm_dir := cache_dir()
+    shm_dir_cstr := strings.clone_to_cstring(
+        shm_dir,
+        context.temp_allocator,
+    )
 
-    dir := posix.opendir(SHM_DIR)
+    dir := posix.opendir(shm_dir_cstr)
     if dir == nil do return
     defer posix.closedir(dir)
 
@@ -1179,14 +1292,14 @@ cleanup_stale_caches :: proc() {
         pid_str: string
         if strings.has_prefix(
             name,
-            "statusline-cache.",
+            "odin-state.",
         ) {
-            pid_str = name[len("statusline-cache."):]
+            pid_str = name[len("odin-state."):]
         } else if strings.has_prefix(
             name,
-            "statusline-usage.",
+            "odin-usage.",
         ) {
-            pid_str = name[len("statusline-usage."):]
+            pid_str = name[len("odin-usage."):]
         } else {
             continue
         }
@@ -1197,11 +1310,11 @@ cleanup_stale_caches :: proc() {
             continue
         }
 
-        path_buf: [64]u8
+        path_buf: [128]u8
         path := fmt.bprintf(
             path_buf[:],
             "%s/%s",
-            SHM_DIR,
+            shm_dir,
             name,
         )
         path_cstr := strings.clone_to_cstring(
@@ -1261,6 +1374,8 @@ cleanup_stale_caches :: proc() {
 /* Git Status Cache                                                           */
 /* -------------------------------------------------------------------------- */
 
+GIT_CACHE_VERSION :: 1
+
 GitCache :: struct #packed {
     index_mtime_sec:  i64,
     index_mtime_nsec: i64,
@@ -1282,11 +1397,12 @@ hash_path :: proc(path: string) -> u32 {
 }
 
 get_git_cache_path :: proc(repo_path: string) -> string {
-    @(static) path_buf: [64]u8
+    @(static) path_buf: [96]u8
     h := hash_path(repo_path)
     return fmt.bprintf(
         path_buf[:],
-        "/dev/shm/claude-git-%08x",
+        "%s/odin-git-%08x",
+        cache_dir(),
         h,
     )
 }
@@ -1318,30 +1434,18 @@ read_git_cache :: proc(
     cache: GitCache,
     state: CacheState,
 ) {
-    cache_path := get_git_cache_path(repo_path)
-    cache_cstr := strings.clone_to_cstring(
-        cache_path,
-        context.temp_allocator,
+    record := (transmute([^]u8)&cache)[:size_of(GitCache)]
+    ok, written_ms := cache_file_load(
+        get_git_cache_path(repo_path),
+        GIT_CACHE_VERSION,
+        record,
     )
-
-    fd := posix.open(cache_cstr, {})
-    if fd < 0 do return {}, .NONE
-    defer posix.close(fd)
-
-    buf := transmute([^]u8)&cache
-    n := posix.read(fd, buf, size_of(GitCache))
-    if n != size_of(GitCache) do return {}, .NONE
+    if !ok do return {}, .NONE
 
     cached_repo := string(cstring(&cache.repo_path[0]))
     if cached_repo != repo_path do return {}, .NONE
 
-    cache_st: posix.stat_t
-    if posix.fstat(fd, &cache_st) != .OK {
-        return cache, .STALE
-    }
-    cache_age_ms := current_time_ms() -
-        (i64(cache_st.st_mtim.tv_sec) * 1000 +
-            i64(cache_st.st_mtim.tv_nsec) / 1_000_000)
+    cache_age_ms := current_time_ms() - written_ms
     if cache_age_ms > GIT_CACHE_TTL_MS {
         return cache, .STALE
     }
@@ -1396,22 +1500,8 @@ write_git_cache :: proc(
     cache.behind = behind
     copy(cache.repo_path[:], repo_path)
 
-    cache_path := get_git_cache_path(repo_path)
-    cache_cstr := strings.clone_to_cstring(
-        cache_path,
-        context.temp_allocator,
-    )
-
-    fd := posix.open(
-        cache_cstr,
-        {.WRONLY, .CREAT, .TRUNC},
-        {.IRUSR, .IWUSR, .IRGRP, .IROTH},
-    )
-    if fd < 0 do return
-    defer posix.close(fd)
-
-    buf := transmute([^]u8)&cache
-    posix.write(fd, buf, size_of(GitCache))
+    record := (transmute([^]u8)&cache)[:size_of(GitCache)]
+    cache_file_publish(get_git_cache_path(repo_path), GIT_CACHE_VERSION, record)
 }
 
 run_git_status :: proc(
@@ -1595,7 +1685,7 @@ get_git_status_cached :: proc(
 /* -------------------------------------------------------------------------- */
 
 USAGE_CACHE_TTL_S :: 60
-USAGE_CACHE_PREFIX :: "/dev/shm/statusline-usage."
+USAGE_CACHE_VERSION :: 1
 
 UsageCache :: struct #packed {
     fetch_time_sec:     i64,
@@ -1608,11 +1698,11 @@ UsageCache :: struct #packed {
 }
 
 get_usage_cache_path :: proc(gppid: int) -> string {
-    @(static) path_buf: [64]u8
+    @(static) path_buf: [96]u8
     return fmt.bprintf(
         path_buf[:],
-        "%s%d",
-        USAGE_CACHE_PREFIX,
+        "%s/odin-usage.%d",
+        cache_dir(),
         gppid,
     )
 }
@@ -1768,51 +1858,15 @@ refresh_usage_cache :: proc(gppid: int) {
     cache.seven_day_reset = seven_reset
     cache.opus_reset = opus_reset
 
-    cache_path := get_usage_cache_path(gppid)
-    cache_cstr := strings.clone_to_cstring(
-        cache_path,
-        context.temp_allocator,
-    )
-
-    cache_fd := posix.open(
-        cache_cstr,
-        {.WRONLY, .CREAT, .TRUNC},
-        {.IRUSR, .IWUSR},
-    )
-    if cache_fd >= 0 {
-        c := cache
-        posix.write(
-            cache_fd,
-            transmute([^]u8)&c,
-            size_of(UsageCache),
-        )
-        posix.close(cache_fd)
-    }
+    record := (transmute([^]u8)&cache)[:size_of(UsageCache)]
+    cache_file_publish(get_usage_cache_path(gppid), USAGE_CACHE_VERSION, record)
     posix._exit(0)
 }
 
 read_usage_cache :: proc(gppid: int) -> UsageCache {
-    cache_path := get_usage_cache_path(gppid)
-    cache_cstr := strings.clone_to_cstring(
-        cache_path,
-        context.temp_allocator,
-    )
-
-    fd := posix.open(cache_cstr, {})
-    if fd < 0 {
-        refresh_usage_cache(gppid)
-        return {}
-    }
-
     cache: UsageCache
-    n := posix.read(
-        fd,
-        transmute([^]u8)&cache,
-        size_of(UsageCache),
-    )
-    posix.close(fd)
-
-    if n != size_of(UsageCache) {
+    record := (transmute([^]u8)&cache)[:size_of(UsageCache)]
+    if ok, _ := cache_file_load(get_usage_cache_path(gppid), USAGE_CACHE_VERSION, record); !ok {
         refresh_usage_cache(gppid)
         return {}
     }